@@ -267,6 +267,25 @@ struct io_uring_probe {
 #define IOSQE_ASYNC		(1U << IOSQE_ASYNC_BIT)
 #endif /* IOSQE_ASYNC */
 
+#ifndef IORING_RECVSEND_FIXED_BUF
+/* zero-copy send was added together with the fixed buffer send flag */
+#define IORING_OP_SEND_ZC		47
+#define IORING_RECVSEND_FIXED_BUF	(1U << 2)
+#endif /* IORING_RECVSEND_FIXED_BUF */
+
+#ifndef IORING_SEND_ZC_REPORT_USAGE
+#define IORING_SEND_ZC_REPORT_USAGE	(1U << 3)
+#define IORING_NOTIF_USAGE_ZC_COPIED	(1U << 31)
+#endif /* IORING_SEND_ZC_REPORT_USAGE */
+
+#ifndef IORING_CQE_F_MORE
+#define IORING_CQE_F_MORE		(1U << 1)
+#endif /* IORING_CQE_F_MORE */
+
+#ifndef IORING_CQE_F_NOTIF
+#define IORING_CQE_F_NOTIF		(1U << 3)
+#endif /* IORING_CQE_F_NOTIF */
+
 #ifndef HAVE_IO_URING_REGISTER
 static inline int io_uring_register(int fd, unsigned int opcode, void *arg,
 	unsigned int nr_args)
@@ -14,5 +14,11 @@
 #ifndef UDPLITE_RECV_CSCOV
 # define UDPLITE_RECV_CSCOV   11 /* receiver partial coverage (threshold ) */
 #endif
+#ifndef UDP_SEGMENT
+# define UDP_SEGMENT	103 /* set GSO segmentation size */
+#endif
+#ifndef UDP_GRO
+# define UDP_GRO	104 /* this socket can receive UDP GRO packets */
+#endif
 
 #endif	/* LAPI_UDP_H__ */
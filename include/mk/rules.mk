@@ -49,6 +49,18 @@ else
 	@echo CC $(target_rel_dir)$@
 endif
 
+# Tests built as shared objects for tools/zygote/ltp-zygote, which provides libltp
+ifdef VERBOSE
+LINK_SO.c=$(CC) $(CPPFLAGS) $(CFLAGS) -fPIC -shared $(LDFLAGS)
+else
+LINK_SO.c=@echo CC $(target_rel_dir)$@; $(CC) $(CPPFLAGS) $(CFLAGS) -fPIC -shared $(LDFLAGS)
+endif
+
+SO_LDLIBS = $(filter-out -lltp,$(LTPLDLIBS) $(LDLIBS))
+
+%.so: %.c
+	$(LINK_SO.c) $< $(SO_LDLIBS) -o $@
+
 .PHONY: $(CHECK_TARGETS)
 $(CHECK_TARGETS): check-%: %.c
 ifdef VERBOSE
@@ -74,6 +74,20 @@
 #define TST_CHECKPOINT_WAKE2(id, nr_wake) \
         tst_safe_checkpoint_wake(__FILE__, __LINE__, NULL, id, nr_wake)
 
+/**
+ * TST_CHECKPOINT_WAKE_IDS() - Wakes up several checkpoints at once.
+ *
+ * @ids: An array of checkpoint ids.
+ * @nr_ids: A number of checkpoint ids in the array.
+ *
+ * Wakes up one process suspended on each of the checkpoints. This is faster
+ * than calling TST_CHECKPOINT_WAKE() in a loop since all the checkpoints share
+ * a single 10 seconds timeout. If an error happened or timeout was reached the
+ * function calls tst_brk(TBROK, ...) which exits the test.
+ */
+#define TST_CHECKPOINT_WAKE_IDS(ids, nr_ids) \
+        tst_safe_checkpoint_wake_ids(__FILE__, __LINE__, NULL, ids, nr_ids, 1)
+
 /**
  * TST_CHECKPOINT_WAKE_AND_WAIT() - Wakes up a checkpoint and immediately waits on it.
  *
@@ -31,6 +31,17 @@ int tst_checkpoint_wait(unsigned int id, unsigned int msec_timeout);
 int tst_checkpoint_wake(unsigned int id, unsigned int nr_wake,
                         unsigned int msec_timeout);
 
+/*
+ * Wakes up sleeping process(es)/thread(s) on several checkpoints at once.
+ *
+ * @ids: Array of checkpoint ids
+ * @nr_ids: Number of checkpoint ids in the array
+ * @nr_wake: Number of processes/threads to wake up on each checkpoint
+ * @msec_timeout: Timeout in milliseconds for all checkpoints together
+ */
+int tst_checkpoint_wake_ids(const unsigned int ids[], unsigned int nr_ids,
+			    unsigned int nr_wake, unsigned int msec_timeout);
+
 void tst_safe_checkpoint_wait(const char *file, const int lineno,
                               void (*cleanup_fn)(void), unsigned int id,
 			      unsigned int msec_timeout);
@@ -39,4 +50,9 @@ void tst_safe_checkpoint_wake(const char *file, const int lineno,
                               void (*cleanup_fn)(void), unsigned int id,
                               unsigned int nr_wake);
 
+void tst_safe_checkpoint_wake_ids(const char *file, const int lineno,
+				  void (*cleanup_fn)(void),
+				  const unsigned int ids[], unsigned int nr_ids,
+				  unsigned int nr_wake);
+
 #endif /* TST_CHECKPOINT_FN__ */
@@ -66,6 +66,16 @@ int tst_attach_device(const char *dev_path, const char *file_path);
  */
 uint64_t tst_get_device_size(const char *dev_path);
 
+/*
+ * Looks up the file backing a loop device.
+ *
+ * @dev_path Path to the loop device e.g. /dev/loop0
+ * @path The buffer to store the backing file path in
+ * @path_len The length of the buffer
+ * @return Zero on success, non-zero if dev_path is not an attached loop device.
+ */
+int tst_loop_backing_file(const char *dev_path, char *path, size_t path_len);
+
 /*
  * Detaches a file from a loop device fd. @dev_fd needs to be the
  * last descriptor opened. Call to this function will close it,
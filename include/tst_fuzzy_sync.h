@@ -12,9 +12,11 @@
  * and therefore impossible to mark accurately, the library may add randomised
  * delays to either thread in order to help find the exact race timing.
  *
- * Currently only two way races are explicitly supported, that is races
- * involving two threads or processes. We refer to the main test thread as
- * thread A and the child thread as thread B.
+ * The tst_fzsync_pair API supports two way races, that is races involving
+ * two threads or processes. We refer to the main test thread as thread A and
+ * the child thread as thread B. Races which need three or more threads to
+ * enter a critical window together can use the tst_fzsync_group API which
+ * works the same way, see tst_fzsync_group for details.
  *
  * In each thread you need a simple while- or for-loop which the tst_fzsync_*
  * functions are called in. In the simplest case thread A will look something
@@ -61,7 +63,9 @@
 
 #include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <time.h>
 #include "tst_atomic.h"
@@ -72,9 +76,51 @@
 #ifndef TST_FUZZY_SYNC_H__
 #define TST_FUZZY_SYNC_H__
 
+#if defined(__i386__) || defined(__x86_64__) || defined(__powerpc64__)
+# include "tst_tsc.h"
+# define TST_FZSYNC_HAVE_CYCLES
+#elif defined(__aarch64__)
+# define TST_FZSYNC_HAVE_CYCLES
+#endif
+
 /* how much of exec time is sampling allowed to take */
 #define SAMPLING_SLICE 0.5f
 
+/**
+ * The clock used to timestamp the race windows.
+ *
+ * By default the timestamps are taken with clock_gettime() and are in
+ * nanoseconds. When LTP_FZSYNC_CLOCK=cycles is set and the CPU has a usable
+ * cycle counter (rdtsc, cntvct_el0 or the timebase) the raw counter is read
+ * instead, which is much cheaper than clock_gettime(). The statistics are
+ * then kept in counter ticks, the delay calculation only uses ratios of times
+ * so the ticks are converted to nanoseconds only when the statistics are
+ * printed.
+ */
+struct tst_fzsync_clock {
+	/** Internal; Timestamps are read from the cycle counter */
+	bool cycles;
+	/** Internal; Nanoseconds per timestamp tick */
+	float ns_per_tick;
+};
+
+/** The number of buckets in tst_fzsync_hist */
+#define TST_FZSYNC_HIST_BUCKETS 20
+
+/**
+ * Histogram of a time over a range split into equally sized buckets
+ *
+ * Used to check how well the random delays cover the delay range.
+ */
+struct tst_fzsync_hist {
+	/** The number of samples below the range */
+	unsigned int below;
+	/** The number of samples in each bucket */
+	unsigned int buckets[TST_FZSYNC_HIST_BUCKETS];
+	/** The number of samples above the range */
+	unsigned int above;
+};
+
 /** Some statistics for a variable */
 struct tst_fzsync_stat {
 	float avg;
@@ -102,14 +148,16 @@ struct tst_fzsync_pair {
 	 * Defaults to 0.25.
 	 */
 	float avg_alpha;
+	/** Internal; The clock used for the timestamps */
+	struct tst_fzsync_clock clock;
 	/** Internal; Thread A start time */
-	struct timespec a_start;
+	uint64_t a_start;
 	/** Internal; Thread B start time */
-	struct timespec b_start;
+	uint64_t b_start;
 	/** Internal; Thread A end time */
-	struct timespec a_end;
+	uint64_t a_end;
 	/** Internal; Thread B end time */
-	struct timespec b_end;
+	uint64_t b_end;
 	/** Internal; Avg. difference between a_start and b_start */
 	struct tst_fzsync_stat diff_ss;
 	/** Internal; Avg. difference between a_start and a_end */
@@ -121,6 +169,20 @@ struct tst_fzsync_pair {
 	/** Internal; Number of spins while waiting for the slower thread */
 	int spins;
 	struct tst_fzsync_stat spins_avg;
+	/**
+	 * Internal; Histogram of start_b - start_a over the delay range
+	 *
+	 * Collected once the random delays have been introduced.
+	 */
+	struct tst_fzsync_hist start_hist;
+	/**
+	 * Internal; The start_hist of the last finished run
+	 *
+	 * Printed by tst_fzsync_pair_cleanup() together with its range.
+	 */
+	struct tst_fzsync_hist last_hist;
+	float last_hist_min;
+	float last_hist_max;
 	/**
 	 * Internal; Number of spins to use in the delay.
 	 *
@@ -183,6 +245,129 @@ struct tst_fzsync_pair {
 
 };
 
+/** Reads the cycle counter */
+static inline uint64_t tst_fzsync_cycles(void)
+{
+	uint64_t val = 0;
+
+#if defined(__aarch64__)
+	__asm__ __volatile__ ("isb; mrs %0, cntvct_el0" : "=r" (val) :: "memory");
+#elif defined(TST_FZSYNC_HAVE_CYCLES)
+	rdtscll(val);
+#endif
+
+	return val;
+}
+
+/** Wraps clock_gettime */
+static inline uint64_t tst_fzsync_clock_ns(void)
+{
+	struct timespec t;
+
+#ifdef CLOCK_MONOTONIC_RAW
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &t);
+#endif
+
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/**
+ * Take a timestamp
+ *
+ * @relates tst_fzsync_clock
+ */
+static inline uint64_t tst_fzsync_time(const struct tst_fzsync_clock *clk)
+{
+#ifdef TST_FZSYNC_HAVE_CYCLES
+	if (clk->cycles)
+		return tst_fzsync_cycles();
+#endif
+
+	return tst_fzsync_clock_ns();
+}
+
+/**
+ * Check that the x86 TSC ticks at a constant rate regardless of the CPU
+ * frequency and sleep states, otherwise the ticks cannot be converted into
+ * time.
+ */
+static inline bool tst_fzsync_tsc_stable(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	char line[4096];
+	bool ret = false;
+	FILE *f = fopen("/proc/cpuinfo", "r");
+
+	if (!f)
+		return false;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (strncmp(line, "flags", 5))
+			continue;
+
+		ret = strstr(line, " constant_tsc") && strstr(line, " nonstop_tsc");
+		break;
+	}
+
+	fclose(f);
+
+	return ret;
+#else
+	return true;
+#endif
+}
+
+/**
+ * Select and calibrate the clock
+ *
+ * @relates tst_fzsync_clock
+ *
+ * The cycle counter frequency is measured against clock_gettime() over 10ms,
+ * the result is cached for the rest of the process.
+ */
+static inline void tst_fzsync_clock_init(struct tst_fzsync_clock *clk)
+{
+	static float ns_per_tick;
+	const char *env = getenv("LTP_FZSYNC_CLOCK");
+
+	clk->cycles = false;
+	clk->ns_per_tick = 1;
+
+	if (!env || !strcmp(env, "monotonic"))
+		return;
+
+	if (strcmp(env, "cycles"))
+		tst_brk(TBROK, "Invalid LTP_FZSYNC_CLOCK='%s'", env);
+
+#ifdef TST_FZSYNC_HAVE_CYCLES
+	if (!ns_per_tick && tst_fzsync_tsc_stable()) {
+		uint64_t ns, ticks;
+
+		ns = tst_fzsync_clock_ns();
+		ticks = tst_fzsync_cycles();
+		usleep(10000);
+		ns = tst_fzsync_clock_ns() - ns;
+		ticks = tst_fzsync_cycles() - ticks;
+
+		if (ticks)
+			ns_per_tick = (float)ns / ticks;
+		else
+			ns_per_tick = -1;
+	}
+
+	if (ns_per_tick > 0) {
+		clk->cycles = true;
+		clk->ns_per_tick = ns_per_tick;
+		tst_res(TINFO, "Using cycle counter, %.3fns per tick", ns_per_tick);
+		return;
+	}
+#endif
+
+	tst_res(TINFO, "Cycle counter not usable, using clock_gettime()");
+}
+
 #define CHK(param, low, hi, def) do {					      \
 	pair->param = (pair->param ? pair->param : def);		      \
 	if (pair->param < low)						      \
@@ -207,19 +392,123 @@ static inline void tst_fzsync_pair_init(struct tst_fzsync_pair *pair)
 	CHK(max_dev_ratio, 0, 1, 0.1);
 	CHK(exec_loops, 20, INT_MAX, 3000000);
 
+	tst_fzsync_clock_init(&pair->clock);
+
 	if (tst_ncpus_available() <= 1)
 		pair->yield_in_wait = 1;
 }
 #undef CHK
 
 /**
- * Exit and join thread B if necessary.
+ * Add a sample to a histogram over the range [min, max)
+ *
+ * @relates tst_fzsync_hist
+ */
+static inline void tst_fzsync_hist_add(struct tst_fzsync_hist *hist,
+				       float sample, float min, float max)
+{
+	float pos = (sample - min) / (max - min);
+
+	if (pos < 0)
+		hist->below++;
+	else if (pos >= 1)
+		hist->above++;
+	else
+		hist->buckets[(int)(pos * TST_FZSYNC_HIST_BUCKETS)]++;
+}
+
+/**
+ * Return the number of samples in a histogram
+ *
+ * @relates tst_fzsync_hist
+ */
+static inline unsigned int tst_fzsync_hist_total(struct tst_fzsync_hist *hist)
+{
+	unsigned int i, total = hist->below + hist->above;
+
+	for (i = 0; i < TST_FZSYNC_HIST_BUCKETS; i++)
+		total += hist->buckets[i];
+
+	return total;
+}
+
+/**
+ * Write the start offset histogram of a run into the result stream
  *
  * @relates tst_fzsync_pair
  *
- * Call this from your cleanup function.
+ * The range is the delay range [-(end_b - start_b), end_a - start_a], that
+ * is from B starting before A so that B's window ends at the start of A's,
+ * to B starting when A's window ends. A flat histogram means that the whole
+ * window was explored, samples outside of the range are wasted iterations.
+ *
+ * The histogram is then kept as the last one for tst_fzsync_pair_hist_info()
+ * and cleared for the next run. Does nothing if no samples were collected,
+ * i.e. the sampling period did not end.
  */
-static inline void tst_fzsync_pair_cleanup(struct tst_fzsync_pair *pair)
+static inline void tst_fzsync_pair_hist_record(struct tst_fzsync_pair *pair)
+{
+	float ns = pair->clock.ns_per_tick;
+	float min = -pair->diff_sb.avg * ns, max = pair->diff_sa.avg * ns;
+
+	if (!tst_fzsync_hist_total(&pair->start_hist))
+		return;
+
+	tst_result_hist("fzsync start_b - start_a", "ns", min, max,
+			pair->start_hist.buckets, TST_FZSYNC_HIST_BUCKETS,
+			pair->start_hist.below, pair->start_hist.above);
+
+	pair->last_hist = pair->start_hist;
+	pair->last_hist_min = min;
+	pair->last_hist_max = max;
+	memset(&pair->start_hist, 0, sizeof(pair->start_hist));
+}
+
+/**
+ * Print the start offset histogram of the last run
+ *
+ * @relates tst_fzsync_pair
+ *
+ * Does nothing if there is no recorded histogram.
+ */
+static inline void tst_fzsync_pair_hist_info(struct tst_fzsync_pair *pair)
+{
+	struct tst_fzsync_hist *hist = &pair->last_hist;
+	float min = pair->last_hist_min, max = pair->last_hist_max;
+	float step = (max - min) / TST_FZSYNC_HIST_BUCKETS;
+	unsigned int i, total = tst_fzsync_hist_total(hist), peak = 0;
+	char bar[41];
+
+	if (!total)
+		return;
+
+	for (i = 0; i < TST_FZSYNC_HIST_BUCKETS; i++)
+		peak = MAX(peak, hist->buckets[i]);
+
+	tst_res(TINFO, "start_b - start_a histogram, %u samples, %.1f%% outside of the delay range",
+		total, 100.0f * (hist->below + hist->above) / total);
+	tst_res(TINFO, "%10s < %9.0fns: %u", "", min, hist->below);
+
+	for (i = 0; i < TST_FZSYNC_HIST_BUCKETS; i++) {
+		memset(bar, '#', sizeof(bar) - 1);
+		bar[peak ? 40 * hist->buckets[i] / peak : 0] = 0;
+
+		tst_res(TINFO, "[%9.0f, %9.0f)ns: %-8u %s",
+			min + i * step, min + (i + 1) * step,
+			hist->buckets[i], bar);
+	}
+
+	tst_res(TINFO, "%10s >= %8.0fns: %u", "", max, hist->above);
+}
+
+/**
+ * Exit and join thread B if necessary and record the run histogram.
+ *
+ * @relates tst_fzsync_pair
+ *
+ * Internal; called at the end of each run and on reset.
+ */
+static inline void tst_fzsync_pair_stop(struct tst_fzsync_pair *pair)
 {
 	if (pair->thread_b) {
 		/* Revoke thread B if parent hits accidental break */
@@ -228,6 +517,24 @@ static inline void tst_fzsync_pair_cleanup(struct tst_fzsync_pair *pair)
 		SAFE_PTHREAD_JOIN(pair->thread_b, NULL);
 		pair->thread_b = 0;
 	}
+
+	tst_fzsync_pair_hist_record(pair);
+}
+
+/**
+ * Exit and join thread B if necessary.
+ *
+ * @relates tst_fzsync_pair
+ *
+ * Call this from your cleanup function. It also prints the start offset
+ * histogram of the last run, the histograms of all runs are written into
+ * the result stream as they finish.
+ */
+static inline void tst_fzsync_pair_cleanup(struct tst_fzsync_pair *pair)
+{
+	tst_fzsync_pair_stop(pair);
+	tst_fzsync_pair_hist_info(pair);
+	memset(&pair->last_hist, 0, sizeof(pair->last_hist));
 }
 
 /**
@@ -262,7 +569,7 @@ static inline void tst_init_stat(struct tst_fzsync_stat *s)
 static inline void tst_fzsync_pair_reset(struct tst_fzsync_pair *pair,
 				  void *(*run_b)(void *))
 {
-	tst_fzsync_pair_cleanup(pair);
+	tst_fzsync_pair_stop(pair);
 
 	tst_init_stat(&pair->diff_ss);
 	tst_init_stat(&pair->diff_sa);
@@ -290,11 +597,12 @@ static inline void tst_fzsync_pair_reset(struct tst_fzsync_pair *pair,
  * @relates tst_fzsync_stat
  */
 static inline void tst_fzsync_stat_info(struct tst_fzsync_stat stat,
-					char *unit, char *name)
+					float scale, char *unit, char *name)
 {
 	tst_res(TINFO,
 		"%1$-17s: { avg = %3$5.0f%2$s, avg_dev = %4$5.0f%2$s, dev_ratio = %5$.2f }",
-		name, unit, stat.avg, stat.avg_dev, stat.dev_ratio);
+		name, unit, stat.avg * scale, stat.avg_dev * scale,
+		stat.dev_ratio);
 }
 
 /**
@@ -304,23 +612,15 @@ static inline void tst_fzsync_stat_info(struct tst_fzsync_stat stat,
  */
 static inline void tst_fzsync_pair_info(struct tst_fzsync_pair *pair)
 {
+	float ns = pair->clock.ns_per_tick;
+
 	tst_res(TINFO, "loop = %d, delay_bias = %d",
 		pair->exec_loop, pair->delay_bias);
-	tst_fzsync_stat_info(pair->diff_ss, "ns", "start_a - start_b");
-	tst_fzsync_stat_info(pair->diff_sa, "ns", "end_a - start_a");
-	tst_fzsync_stat_info(pair->diff_sb, "ns", "end_b - start_b");
-	tst_fzsync_stat_info(pair->diff_ab, "ns", "end_a - end_b");
-	tst_fzsync_stat_info(pair->spins_avg, "  ", "spins");
-}
-
-/** Wraps clock_gettime */
-static inline void tst_fzsync_time(struct timespec *t)
-{
-#ifdef CLOCK_MONOTONIC_RAW
-	clock_gettime(CLOCK_MONOTONIC_RAW, t);
-#else
-	clock_gettime(CLOCK_MONOTONIC, t);
-#endif
+	tst_fzsync_stat_info(pair->diff_ss, ns, "ns", "start_a - start_b");
+	tst_fzsync_stat_info(pair->diff_sa, ns, "ns", "end_a - start_a");
+	tst_fzsync_stat_info(pair->diff_sb, ns, "ns", "end_b - start_b");
+	tst_fzsync_stat_info(pair->diff_ab, ns, "ns", "end_a - end_b");
+	tst_fzsync_stat_info(pair->spins_avg, 1, "  ", "spins");
 }
 
 /**
@@ -361,10 +661,10 @@ static inline void tst_upd_stat(struct tst_fzsync_stat *s,
  */
 static inline void tst_upd_diff_stat(struct tst_fzsync_stat *s,
 				     float alpha,
-				     struct timespec t1,
-				     struct timespec t2)
+				     uint64_t t1,
+				     uint64_t t2)
 {
-	tst_upd_stat(s, alpha, tst_timespec_diff_ns(t1, t2));
+	tst_upd_stat(s, alpha, (int64_t)(t1 - t2));
 }
 
 /**
@@ -485,6 +785,13 @@ static inline void tst_fzsync_pair_update(struct tst_fzsync_pair *pair)
 			tst_fzsync_pair_info(pair);
 		}
 	} else if (fabsf(pair->diff_ab.avg) >= 1) {
+		/* The previous iteration ran with a random delay */
+		if (pair->sampling < 0) {
+			tst_fzsync_hist_add(&pair->start_hist,
+					    (int64_t)(pair->b_start - pair->a_start),
+					    -pair->diff_sb.avg, pair->diff_sa.avg);
+		}
+
 		per_spin_time = fabsf(pair->diff_ab.avg) / MAX(pair->spins_avg.avg, 1.0f);
 		time_delay = drand48() * (pair->diff_sa.avg + pair->diff_sb.avg)
 			- pair->diff_sb.avg;
@@ -659,7 +966,7 @@ static inline int tst_fzsync_run_a(struct tst_fzsync_pair *pair)
 	tst_fzsync_wait_a(pair);
 
 	if (pair->exit) {
-		tst_fzsync_pair_cleanup(pair);
+		tst_fzsync_pair_stop(pair);
 		return 0;
 	}
 
@@ -715,7 +1022,7 @@ static inline void tst_fzsync_start_race_a(struct tst_fzsync_pair *pair)
 			delay++;
 	}
 
-	tst_fzsync_time(&pair->a_start);
+	pair->a_start = tst_fzsync_time(&pair->clock);
 }
 
 /**
@@ -726,7 +1033,7 @@ static inline void tst_fzsync_start_race_a(struct tst_fzsync_pair *pair)
  */
 static inline void tst_fzsync_end_race_a(struct tst_fzsync_pair *pair)
 {
-	tst_fzsync_time(&pair->a_end);
+	pair->a_end = tst_fzsync_time(&pair->clock);
 	tst_fzsync_pair_wait(&pair->a_cntr, &pair->b_cntr,
 			     &pair->spins, &pair->exit, pair->yield_in_wait);
 }
@@ -754,7 +1061,7 @@ static inline void tst_fzsync_start_race_b(struct tst_fzsync_pair *pair)
 			delay--;
 	}
 
-	tst_fzsync_time(&pair->b_start);
+	pair->b_start = tst_fzsync_time(&pair->clock);
 }
 
 /**
@@ -765,7 +1072,7 @@ static inline void tst_fzsync_start_race_b(struct tst_fzsync_pair *pair)
  */
 static inline void tst_fzsync_end_race_b(struct tst_fzsync_pair *pair)
 {
-	tst_fzsync_time(&pair->b_end);
+	pair->b_end = tst_fzsync_time(&pair->clock);
 	tst_fzsync_pair_wait(&pair->b_cntr, &pair->a_cntr,
 			     &pair->spins, &pair->exit, pair->yield_in_wait);
 }
@@ -800,4 +1107,500 @@ static inline void tst_fzsync_pair_add_bias(struct tst_fzsync_pair *pair, int ch
 		pair->delay_bias += change;
 }
 
+/**
+ * The maximum number of threads in a tst_fzsync_group
+ */
+#define TST_FZSYNC_GROUP_MAX 16
+
+/**
+ * The per thread state of a N-way race.
+ *
+ * All the fields are internal and should only be accessed by library
+ * functions. The statistics are kept relative to thread 0 which also updates
+ * them.
+ */
+struct tst_fzsync_group_thread {
+	/** Internal; Thread start time */
+	uint64_t start;
+	/** Internal; Thread end time */
+	uint64_t end;
+	/** Internal; Avg. difference between start and thread 0 start */
+	struct tst_fzsync_stat diff_ss;
+	/** Internal; Avg. difference between start and end */
+	struct tst_fzsync_stat diff_se;
+	/** Internal; Avg. difference between end and thread 0 end */
+	struct tst_fzsync_stat diff_ee;
+	/** Internal; Number of spins while waiting for the slower threads */
+	int spins;
+	struct tst_fzsync_stat spins_avg;
+	/** Internal; Number of spins to use in the delay, always >= 0 */
+	int delay;
+	int delay_bias;
+	/** Internal; The thread or 0 */
+	pthread_t thread;
+};
+
+/**
+ * The state of a N-way synchronisation or race.
+ *
+ * This is a generalisation of tst_fzsync_pair for races which need three or
+ * more threads to enter a critical window together. The threads are
+ * identified by an index, thread 0 is the main test thread and plays the
+ * role of thread A, that is it decides when to stop and calculates the
+ * delays.
+ *
+ * The number of threads has to be set before calling tst_fzsync_group_init(),
+ * the rest of the parameters have the same meaning and defaults as the ones
+ * in tst_fzsync_pair.
+ *
+ * In thread 0 the loop looks like:
+ *
+ * tst_fzsync_group_reset(&group, run_thread);
+ * while (tst_fzsync_group_run(&group, 0)) {
+ *	tst_fzsync_group_start_race(&group, 0);
+ *	// Do some dodgy syscall
+ *	tst_fzsync_group_end_race(&group, 0);
+ * }
+ *
+ * Then in the rest of the threads (run_thread):
+ *
+ * unsigned int id = (uintptr_t)arg;
+ *
+ * while (tst_fzsync_group_run(&group, id)) {
+ *	tst_fzsync_group_start_race(&group, id);
+ *	// Do something which can race with the other threads
+ *	tst_fzsync_group_end_race(&group, id);
+ * }
+ *
+ * Internal fields should only be accessed by library functions.
+ */
+struct tst_fzsync_group {
+	/** The number of racing threads including thread 0 */
+	unsigned int nthreads;
+	/** @sa tst_fzsync_pair.avg_alpha */
+	float avg_alpha;
+	/** Internal; The clock used for the timestamps */
+	struct tst_fzsync_clock clock;
+	/** @sa tst_fzsync_pair.min_samples */
+	int min_samples;
+	/** @sa tst_fzsync_pair.max_dev_ratio */
+	float max_dev_ratio;
+	/** @sa tst_fzsync_pair.exec_loops */
+	int exec_loops;
+	/** Internal; The number of samples left or the sampling state */
+	int sampling;
+	/** Internal; Number of threads waiting in tst_fzsync_group_wait() */
+	tst_atomic_t arrived;
+	/** Internal; Incremented each time all threads arrived */
+	tst_atomic_t generation;
+	/** Internal; Used by tst_fzsync_group_cleanup() and group_wait() */
+	tst_atomic_t exit;
+	/** Internal; The test time remaining on tst_fzsync_group_reset() */
+	float exec_time_start;
+	/** Internal; The current loop index */
+	int exec_loop;
+	/** @sa tst_fzsync_pair.yield_in_wait */
+	bool yield_in_wait;
+	/** Internal; The per thread state */
+	struct tst_fzsync_group_thread threads[TST_FZSYNC_GROUP_MAX];
+};
+
+#define CHK(param, low, hi, def) do {					      \
+	group->param = (group->param ? group->param : def);		      \
+	if (group->param < low)						      \
+		tst_brk(TBROK, #param " is less than the lower bound " #low); \
+	if (group->param > hi)						      \
+		tst_brk(TBROK, #param " is more than the upper bound " #hi);  \
+	} while (0)
+/**
+ * Ensures that any Fuzzy Sync group parameters are properly set
+ *
+ * @relates tst_fzsync_group
+ *
+ * The nthreads field must be set before calling this function.
+ *
+ * @sa tst_fzsync_pair_init()
+ */
+static inline void tst_fzsync_group_init(struct tst_fzsync_group *group)
+{
+	CHK(nthreads, 2, TST_FZSYNC_GROUP_MAX, 0);
+	CHK(avg_alpha, 0, 1, 0.25);
+	CHK(min_samples, 20, INT_MAX, 1024);
+	CHK(max_dev_ratio, 0, 1, 0.1);
+	CHK(exec_loops, 20, INT_MAX, 3000000);
+
+	tst_fzsync_clock_init(&group->clock);
+
+	if (tst_ncpus_available() < group->nthreads)
+		group->yield_in_wait = 1;
+}
+#undef CHK
+
+/**
+ * Exit and join the threads started by tst_fzsync_group_reset()
+ *
+ * @relates tst_fzsync_group
+ *
+ * Call this from your cleanup function.
+ */
+static inline void tst_fzsync_group_cleanup(struct tst_fzsync_group *group)
+{
+	unsigned int i;
+
+	for (i = 1; i < group->nthreads; i++) {
+		if (!group->threads[i].thread)
+			continue;
+
+		if (!group->exit)
+			tst_atomic_store(1, &group->exit);
+
+		SAFE_PTHREAD_JOIN(group->threads[i].thread, NULL);
+		group->threads[i].thread = 0;
+	}
+}
+
+/**
+ * Reset or initialise fzsync group.
+ *
+ * @relates tst_fzsync_group
+ * @param group The state structure initialised with tst_fzsync_group_init().
+ * @param run The function defining threads 1 to nthreads - 1 or NULL.
+ *
+ * Call this from thread 0 just before entering the main loop. The thread
+ * index is passed to run as (void *)(uintptr_t)index.
+ *
+ * @sa tst_fzsync_pair_reset()
+ */
+static inline void tst_fzsync_group_reset(struct tst_fzsync_group *group,
+					  void *(*run)(void *))
+{
+	struct tst_fzsync_group_thread *t;
+	unsigned int i;
+
+	tst_fzsync_group_cleanup(group);
+
+	for (i = 0; i < group->nthreads; i++) {
+		t = &group->threads[i];
+
+		tst_init_stat(&t->diff_ss);
+		tst_init_stat(&t->diff_se);
+		tst_init_stat(&t->diff_ee);
+		tst_init_stat(&t->spins_avg);
+		t->spins = 0;
+		t->delay = 0;
+		t->delay_bias = 0;
+	}
+
+	group->sampling = group->min_samples;
+	group->exec_loop = 0;
+
+	group->arrived = 0;
+	group->generation = 0;
+	group->exit = 0;
+
+	for (i = 1; run && i < group->nthreads; i++) {
+		SAFE_PTHREAD_CREATE(&group->threads[i].thread, 0, run,
+				    (void *)(uintptr_t)i);
+	}
+
+	group->exec_time_start = (float)tst_remaining_runtime();
+}
+
+/**
+ * Print some synchronisation statistics
+ *
+ * @relates tst_fzsync_group
+ */
+static inline void tst_fzsync_group_info(struct tst_fzsync_group *group)
+{
+	struct tst_fzsync_group_thread *t;
+	float ns = group->clock.ns_per_tick;
+	unsigned int i;
+
+	tst_res(TINFO, "loop = %d, threads = %u",
+		group->exec_loop, group->nthreads);
+
+	for (i = 0; i < group->nthreads; i++) {
+		t = &group->threads[i];
+
+		tst_res(TINFO, "thread %u: delay_bias = %d", i, t->delay_bias);
+		if (i) {
+			tst_fzsync_stat_info(t->diff_ss, ns, "ns", "start - start_0");
+			tst_fzsync_stat_info(t->diff_ee, ns, "ns", "end - end_0");
+		}
+		tst_fzsync_stat_info(t->diff_se, ns, "ns", "end - start");
+		tst_fzsync_stat_info(t->spins_avg, 1, "  ", "spins");
+	}
+}
+
+/**
+ * Calculate various statistics and the per thread delays
+ *
+ * @relates tst_fzsync_group
+ *
+ * This is tst_fzsync_pair_update() generalised to N threads. Each thread i
+ * is offset against thread 0 by a random time picked from
+ * [-(end_i - start_i), end_0 - start_0], which for two threads is exactly the
+ * delay range used by the pair. Since a thread can only delay itself, the
+ * offsets are then shifted so that the earliest thread has zero delay.
+ *
+ * The time per spin is estimated from the time the threads which finished
+ * early spent spinning in tst_fzsync_group_end_race() waiting for the last
+ * one.
+ */
+static inline void tst_fzsync_group_update(struct tst_fzsync_group *group)
+{
+	struct tst_fzsync_group_thread *t, *t0 = &group->threads[0];
+	float alpha = group->avg_alpha;
+	float max_dev = group->max_dev_ratio;
+	float per_spin_time, wait_time = 0, spins = 0, last_end = 0;
+	float offsets[TST_FZSYNC_GROUP_MAX];
+	float min_offset = 0;
+	int over_max_dev = 0;
+	unsigned int i;
+
+	for (i = 0; i < group->nthreads; i++) {
+		t = &group->threads[i];
+
+		t->delay = 0;
+		over_max_dev |= t->diff_ss.dev_ratio > max_dev
+			|| t->diff_se.dev_ratio > max_dev
+			|| t->diff_ee.dev_ratio > max_dev
+			|| t->spins_avg.dev_ratio > max_dev;
+	}
+
+	if (group->sampling > 0 || over_max_dev) {
+		for (i = 0; i < group->nthreads; i++) {
+			t = &group->threads[i];
+
+			if (i) {
+				tst_upd_diff_stat(&t->diff_ss, alpha,
+						  t->start, t0->start);
+				tst_upd_diff_stat(&t->diff_ee, alpha,
+						  t->end, t0->end);
+			}
+			tst_upd_diff_stat(&t->diff_se, alpha,
+					  t->end, t->start);
+			tst_upd_stat(&t->spins_avg, alpha, t->spins);
+		}
+
+		if (group->sampling > 0 && --group->sampling == 0) {
+			tst_res(TINFO, "Minimum sampling period ended");
+			tst_fzsync_group_info(group);
+		}
+		goto out;
+	}
+
+	for (i = 0; i < group->nthreads; i++)
+		last_end = MAX(last_end, group->threads[i].diff_ee.avg);
+
+	for (i = 0; i < group->nthreads; i++) {
+		t = &group->threads[i];
+
+		wait_time += last_end - t->diff_ee.avg;
+		spins += t->spins_avg.avg;
+	}
+
+	if (wait_time < 1) {
+		if (!group->sampling) {
+			tst_res(TWARN, "Can't calculate random delay");
+			tst_fzsync_group_info(group);
+			group->sampling = -1;
+		}
+		goto out;
+	}
+
+	per_spin_time = wait_time / MAX(spins, 1.0f);
+
+	for (i = 0; i < group->nthreads; i++) {
+		t = &group->threads[i];
+
+		offsets[i] = t->delay_bias * per_spin_time;
+		if (i) {
+			offsets[i] += drand48() * (t0->diff_se.avg + t->diff_se.avg)
+				- t->diff_se.avg;
+		}
+		min_offset = MIN(min_offset, offsets[i]);
+	}
+
+	for (i = 0; i < group->nthreads; i++) {
+		group->threads[i].delay =
+			(int)(1.1 * (offsets[i] - min_offset) / per_spin_time);
+	}
+
+	if (!group->sampling) {
+		tst_res(TINFO,
+			"Reached deviation ratios < %.2f, introducing randomness",
+			group->max_dev_ratio);
+		tst_res(TINFO, "Time per spin is %.2fns",
+			per_spin_time * group->clock.ns_per_tick);
+		tst_fzsync_group_info(group);
+		group->sampling = -1;
+	}
+
+out:
+	for (i = 0; i < group->nthreads; i++)
+		group->threads[i].spins = 0;
+}
+
+/**
+ * Wait for all the other threads in the group
+ *
+ * @relates tst_fzsync_group
+ * @param group The group state
+ * @param spins A pointer to the spin counter or NULL
+ *
+ * A spinning generation barrier, the last thread to arrive resets the
+ * arrival counter and releases the others by incrementing the generation.
+ * Like tst_fzsync_pair_wait() it never sleeps in futex and returns early
+ * when the exit flag is set.
+ */
+static inline void tst_fzsync_group_spin(struct tst_fzsync_group *group,
+					 int *spins)
+{
+	int gen = tst_atomic_load(&group->generation);
+
+	if (tst_atomic_inc(&group->arrived) == (int)group->nthreads) {
+		tst_atomic_store(0, &group->arrived);
+		tst_atomic_inc(&group->generation);
+		return;
+	}
+
+	while (tst_atomic_load(&group->generation) == gen
+	       && !tst_atomic_load(&group->exit)) {
+		if (spins)
+			(*spins)++;
+
+		if (group->yield_in_wait)
+			sched_yield();
+	}
+}
+
+/**
+ * Wait in thread id for all the other threads
+ *
+ * @relates tst_fzsync_group
+ * @sa tst_fzsync_wait_a
+ */
+static inline void tst_fzsync_group_wait(struct tst_fzsync_group *group,
+					 unsigned int id LTP_ATTRIBUTE_UNUSED)
+{
+	tst_fzsync_group_spin(group, NULL);
+}
+
+/**
+ * Decide whether to continue running thread id
+ *
+ * @relates tst_fzsync_group
+ *
+ * Thread 0 checks the time and loop limits and requests exit from all the
+ * threads once they are exceeded.
+ *
+ * @return True to continue and false to break.
+ * @sa tst_fzsync_run_a
+ */
+static inline int tst_fzsync_group_run(struct tst_fzsync_group *group,
+				       unsigned int id)
+{
+	float rem_p;
+
+	if (id) {
+		tst_fzsync_group_spin(group, NULL);
+		return !tst_atomic_load(&group->exit);
+	}
+
+	rem_p = 1 - tst_remaining_runtime() / group->exec_time_start;
+
+	if ((SAMPLING_SLICE < rem_p) && (group->sampling > 0)) {
+		tst_res(TINFO, "Stopped sampling at %d (out of %d) samples, "
+			"sampling time reached 50%% of the total time limit",
+			group->exec_loop, group->min_samples);
+		group->sampling = 0;
+		tst_fzsync_group_info(group);
+	}
+
+	if (rem_p >= 1) {
+		tst_res(TINFO,
+			"Exceeded execution time, requesting exit");
+		tst_atomic_store(1, &group->exit);
+	}
+
+	if (++group->exec_loop > group->exec_loops) {
+		tst_res(TINFO,
+			"Exceeded execution loops, requesting exit");
+		tst_atomic_store(1, &group->exit);
+	}
+
+	tst_fzsync_group_spin(group, NULL);
+
+	if (group->exit) {
+		tst_fzsync_group_cleanup(group);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Marks the start of a race region in thread id
+ *
+ * @relates tst_fzsync_group
+ * @sa tst_fzsync_start_race_a
+ */
+static inline void tst_fzsync_group_start_race(struct tst_fzsync_group *group,
+					       unsigned int id)
+{
+	struct tst_fzsync_group_thread *t = &group->threads[id];
+	volatile int delay;
+
+	if (!id)
+		tst_fzsync_group_update(group);
+
+	tst_fzsync_group_spin(group, NULL);
+
+	delay = t->delay;
+	if (group->yield_in_wait) {
+		while (delay > 0) {
+			sched_yield();
+			delay--;
+		}
+	} else {
+		while (delay > 0)
+			delay--;
+	}
+
+	t->start = tst_fzsync_time(&group->clock);
+}
+
+/**
+ * Marks the end of a race region in thread id
+ *
+ * @relates tst_fzsync_group
+ * @sa tst_fzsync_start_race_a
+ */
+static inline void tst_fzsync_group_end_race(struct tst_fzsync_group *group,
+					     unsigned int id)
+{
+	struct tst_fzsync_group_thread *t = &group->threads[id];
+
+	t->end = tst_fzsync_time(&group->clock);
+	tst_fzsync_group_spin(group, &t->spins);
+}
+
+/**
+ * Add some amount to the delay bias of thread id
+ *
+ * @relates tst_fzsync_group
+ * @param change The amount to add, a positive change delays the thread
+ * relative to the others.
+ *
+ * @sa tst_fzsync_pair_add_bias
+ */
+static inline void tst_fzsync_group_add_bias(struct tst_fzsync_group *group,
+					     unsigned int id, int change)
+{
+	if (group->sampling > 0)
+		group->threads[id].delay_bias += change;
+}
+
 #endif /* TST_FUZZY_SYNC_H__ */
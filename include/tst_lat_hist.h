@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (c) Linux Test Project, 2026
+ */
+
+/*
+ * Log-linear latency histogram.
+ *
+ * There are TST_LAT_SUB buckets for each power of two, i.e. the bucket width
+ * is at most 1/TST_LAT_SUB of the value, so the percentiles are accurate to
+ * about 3% over the whole range. The latencies are in ns, values above
+ * 2^TST_LAT_MAX_BITS ns (~18 minutes) are clamped.
+ *
+ * The histogram is not thread safe, collect one per thread and merge them
+ * with tst_lat_hist_merge() at the end.
+ */
+
+#ifndef TST_LAT_HIST_H__
+#define TST_LAT_HIST_H__
+
+#include <stdint.h>
+#include <time.h>
+#include "tst_minmax.h"
+
+#define TST_LAT_SUB_BITS	5
+#define TST_LAT_SUB		(1 << TST_LAT_SUB_BITS)
+#define TST_LAT_MAX_BITS	40
+#define TST_LAT_BUCKETS	\
+	((TST_LAT_MAX_BITS - TST_LAT_SUB_BITS + 1) * TST_LAT_SUB)
+
+struct tst_lat_hist {
+	uint64_t buckets[TST_LAT_BUCKETS];
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t total;
+};
+
+/**
+ * tst_lat_ts_diff_ns() - Returns end - start in ns.
+ *
+ * @end: A later timestamp.
+ * @start: An earlier timestamp.
+ *
+ * Returns zero if the end is before the start.
+ */
+static inline uint64_t tst_lat_ts_diff_ns(const struct timespec *end,
+					  const struct timespec *start)
+{
+	int64_t ns = (end->tv_sec - start->tv_sec) * 1000000000LL +
+		end->tv_nsec - start->tv_nsec;
+
+	return ns > 0 ? ns : 0;
+}
+
+/**
+ * tst_lat_bucket() - Returns the index of the bucket for a latency.
+ *
+ * @ns: A latency in ns.
+ */
+static inline unsigned int tst_lat_bucket(uint64_t ns)
+{
+	unsigned int shift;
+
+	if (ns < TST_LAT_SUB)
+		return ns;
+
+	if (ns >= 1ULL << TST_LAT_MAX_BITS)
+		return TST_LAT_BUCKETS - 1;
+
+	shift = 63 - __builtin_clzll(ns) - TST_LAT_SUB_BITS;
+
+	return (shift + 1) * TST_LAT_SUB + (ns >> shift) - TST_LAT_SUB;
+}
+
+/**
+ * tst_lat_bucket_max() - Returns the highest latency in a bucket.
+ *
+ * @idx: A bucket index.
+ */
+static inline uint64_t tst_lat_bucket_max(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < TST_LAT_SUB)
+		return idx;
+
+	shift = idx / TST_LAT_SUB - 1;
+
+	return ((uint64_t)(idx % TST_LAT_SUB + TST_LAT_SUB + 1) << shift) - 1;
+}
+
+/**
+ * tst_lat_hist_add() - Adds a latency into the histogram.
+ *
+ * @hist: A histogram.
+ * @ns: A latency in ns.
+ */
+static inline void tst_lat_hist_add(struct tst_lat_hist *hist, uint64_t ns)
+{
+	if (!hist->count || ns < hist->min)
+		hist->min = ns;
+
+	if (ns > hist->max)
+		hist->max = ns;
+
+	hist->buckets[tst_lat_bucket(ns)]++;
+	hist->count++;
+	hist->total += ns;
+}
+
+/**
+ * tst_lat_hist_merge() - Adds the samples of one histogram into another.
+ *
+ * @dst: A histogram to merge into.
+ * @src: A histogram to merge from.
+ */
+static inline void tst_lat_hist_merge(struct tst_lat_hist *dst,
+				      const struct tst_lat_hist *src)
+{
+	unsigned int i;
+
+	if (!src->count)
+		return;
+
+	for (i = 0; i < TST_LAT_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+
+	if (!dst->count || src->min < dst->min)
+		dst->min = src->min;
+
+	dst->max = MAX(dst->max, src->max);
+	dst->count += src->count;
+	dst->total += src->total;
+}
+
+/**
+ * tst_lat_hist_percentile() - Returns a latency percentile in ns.
+ *
+ * @hist: A histogram.
+ * @p: A percentile as a fraction, e.g. 0.99.
+ *
+ * Returns the upper bound of the bucket the percentile falls into, but at
+ * most the maximal latency, or zero if the histogram is empty.
+ */
+static inline uint64_t tst_lat_hist_percentile(const struct tst_lat_hist *hist,
+					       double p)
+{
+	uint64_t rank = p * hist->count, cnt = 0;
+	unsigned int i;
+
+	if (!hist->count)
+		return 0;
+
+	if (rank >= hist->count)
+		rank = hist->count - 1;
+
+	for (i = 0; i < TST_LAT_BUCKETS; i++) {
+		cnt += hist->buckets[i];
+		if (cnt > rank)
+			return MIN(tst_lat_bucket_max(i), hist->max);
+	}
+
+	return hist->max;
+}
+
+#endif /* TST_LAT_HIST_H__ */
@@ -19,6 +19,25 @@
  */
 void tst_pollute_memory(size_t maxsize, int fillchar);
 
+enum tst_pollute_flags {
+	/*
+	 * Split the work between one process per allowed CPU. Each NUMA node
+	 * gets a share proportional to its free memory and the processes are
+	 * bound to the node CPUs so that the memory is allocated locally.
+	 */
+	TST_POLLUTE_PARALLEL = 0x01,
+	/* Prefault the mappings with MAP_POPULATE */
+	TST_POLLUTE_POPULATE = 0x02,
+	/* Ask for transparent huge pages to reduce the number of faults */
+	TST_POLLUTE_THP = 0x04,
+};
+
+/*
+ * The same as tst_pollute_memory() with tst_pollute_flags to speed up the
+ * pollution on machines with a lot of memory.
+ */
+void tst_pollute_memory_flags(size_t maxsize, int fillchar, unsigned int flags);
+
 /*
  * Read the value of MemAvailable from /proc/meminfo, if no support on
  * older kernels, return 'MemFree + Cached' for instead.
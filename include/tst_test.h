@@ -141,6 +141,25 @@ void tst_printf(const char *const fmt, ...)
  */
 void tst_flush(void);
 
+/**
+ * tst_result_hist() - Writes a histogram into the result stream.
+ *
+ * @name: A histogram name.
+ * @unit: A unit of the histogram range.
+ * @min: A start of the histogram range.
+ * @max: An end of the histogram range.
+ * @buckets: An array of counts for equally sized buckets covering the range.
+ * @buckets_cnt: A number of buckets.
+ * @below: A number of samples below the range.
+ * @above: A number of samples above the range.
+ *
+ * Writes a ``HIST`` record into ``LTP_RESULT_FD``, does nothing when the
+ * result stream is not enabled.
+ */
+void tst_result_hist(const char *name, const char *unit, double min, double max,
+		     const unsigned int *buckets, unsigned int buckets_cnt,
+		     unsigned int below, unsigned int above);
+
 pid_t safe_fork(const char *filename, unsigned int lineno);
 /**
  * SAFE_FORK() - Forks a test child.
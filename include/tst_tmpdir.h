@@ -44,6 +44,16 @@ char *tst_tmpdir_path(void);
 char *tst_tmpdir_genpath(const char *fmt, ...)
 	__attribute__((format(printf, 1, 2)));
 
+/**
+ * tst_get_startwd - Returns the directory the test was started in.
+ *
+ * Useful for resolving relative paths passed on the command line, since the
+ * test runs in the tmpdir.
+ *
+ * return: An absolute path of the start working directory.
+ */
+const char *tst_get_startwd(void);
+
 /*
  * Make sure nobody uses old API functions in new code.
  */
@@ -18,10 +18,12 @@ test1[59]
 test2[04]
 tst_bool_expr
 tst_capability02
+tst_checkpoint_latency
 tst_device
 tst_expiration_timer
-tst_fuzzy_sync0[1-3]
+tst_fuzzy_sync0[1-4]
 tst_needs_cmds0[1-36-8]
+tst_numa_count_pages
 tst_res_hexd
 tst_safe_sscanf
 tst_strstatus}"
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (c) Linux Test Project, 2026
+ */
+
+/*\
+ * Microbenchmark for checkpoint round trip latency.
+ *
+ * The parent and the child ping-pong on a single checkpoint and the average
+ * round trip time is printed, then the parent wakes several children at once
+ * with the bulk wake.
+ */
+
+#include "tst_test.h"
+#include "tst_clocks.h"
+#include "tst_timer.h"
+
+#define ROUND_TRIPS 10000
+#define BULK_CHILDREN 4
+
+static void pingpong(void)
+{
+	struct timespec start, end;
+	unsigned int i;
+
+	if (!SAFE_FORK()) {
+		for (i = 0; i < ROUND_TRIPS; i++) {
+			TST_CHECKPOINT_WAIT(0);
+			TST_CHECKPOINT_WAKE(0);
+		}
+		exit(0);
+	}
+
+	tst_clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < ROUND_TRIPS; i++)
+		TST_CHECKPOINT_WAKE_AND_WAIT(0);
+
+	tst_clock_gettime(CLOCK_MONOTONIC, &end);
+
+	tst_reap_children();
+
+	tst_res(TPASS, "%u round trips, average %.2f us", ROUND_TRIPS,
+		(double)tst_timespec_diff_us(end, start) / ROUND_TRIPS);
+}
+
+static void bulk_wake(void)
+{
+	unsigned int i, ids[BULK_CHILDREN];
+
+	for (i = 0; i < BULK_CHILDREN; i++) {
+		ids[i] = i + 1;
+
+		if (!SAFE_FORK()) {
+			TST_CHECKPOINT_WAIT(i + 1);
+			exit(0);
+		}
+	}
+
+	TST_CHECKPOINT_WAKE_IDS(ids, BULK_CHILDREN);
+
+	tst_reap_children();
+
+	tst_res(TPASS, "Woken up %u checkpoints at once", BULK_CHILDREN);
+}
+
+static void run(void)
+{
+	pingpong();
+	bulk_wake();
+}
+
+static struct tst_test test = {
+	.test_all = run,
+	.forks_child = 1,
+	.needs_checkpoints = 1,
+};
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (c) Linux Test Project, 2026
+ */
+/*
+ * This verifies that the Fuzzy Sync group API can make the critical
+ * sections of three threads overlap when they are not aligned.
+ *
+ * It is tst_fuzzy_sync01 extended to three threads. Each thread increments
+ * the 'H' counter when entering its critical section and decrements it when
+ * leaving. The thread which sees all the other threads inside of their
+ * critical sections when entering its own records a hit.
+ *
+ *   |   #  |
+ * 0 +------+
+ *   | #    |
+ * 1 +------+
+ *   |    #   |
+ * 2 +--------+
+ *
+ * The delay times are cubed, see tst_fuzzy_sync01, so that a delay range is
+ * required to align the critical sections.
+ */
+
+#include "tst_test.h"
+#include "tst_fuzzy_sync.h"
+
+#define THREADS 3
+#define TIME_SCALE(x) ((x) * (x) * (x))
+
+/* The time signature of a code path containing a critical section. */
+struct window {
+	/* The delay until the start of the critical section */
+	const int critical_s;
+	/* The length of the critical section */
+	const int critical_t;
+	/* The remaining delay until the method returns */
+	const int return_t;
+};
+
+static const struct window races[][THREADS] = {
+	/* Already aligned */
+	{ { 0, 1, 0 }, { 0, 1, 0 }, { 0, 1, 0 } },
+	{ { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 } },
+
+	/* Same lengths, different critical section offsets */
+	{ { 3, 1, 1 }, { 1, 1, 3 }, { 2, 1, 2 } },
+	{ { 1, 1, 3 }, { 3, 1, 1 }, { 2, 1, 2 } },
+
+	/* Different lengths */
+	{ { 3, 1, 0 }, { 0, 1, 2 }, { 1, 1, 1 } },
+	{ { 0, 1, 3 }, { 2, 1, 0 }, { 0, 1, 1 } },
+	{ { 2, 1, 1 }, { 0, 1, 0 }, { 1, 1, 3 } },
+};
+
+static tst_atomic_t H;
+static tst_atomic_t hits;
+static unsigned int race;
+static struct tst_fzsync_group group;
+
+static void setup(void)
+{
+	group.nthreads = THREADS;
+	group.min_samples = 10000;
+
+	tst_fzsync_group_init(&group);
+}
+
+static void cleanup(void)
+{
+	tst_fzsync_group_cleanup(&group);
+}
+
+static void delay(const int t)
+{
+	int k = TIME_SCALE(t);
+
+	while (k--)
+		sched_yield();
+}
+
+static void critical_window(unsigned int id)
+{
+	const struct window w = races[race][id];
+
+	tst_fzsync_group_start_race(&group, id);
+	delay(w.critical_s);
+
+	if (tst_atomic_add_return(1, &H) == THREADS)
+		tst_atomic_inc(&hits);
+	delay(w.critical_t);
+	tst_atomic_add_return(-1, &H);
+
+	delay(w.return_t);
+	tst_fzsync_group_end_race(&group, id);
+}
+
+static void *worker(void *arg)
+{
+	unsigned int id = (uintptr_t)arg;
+
+	while (tst_fzsync_group_run(&group, id))
+		critical_window(id);
+
+	return NULL;
+}
+
+static void run(unsigned int i)
+{
+	int critical = 0, loops = 0;
+
+	race = i;
+	tst_atomic_store(0, &hits);
+
+	tst_fzsync_group_reset(&group, worker);
+
+	while (tst_fzsync_group_run(&group, 0)) {
+		critical_window(0);
+		loops++;
+
+		if (tst_atomic_load(&H))
+			tst_brk(TBROK, "Counter should now be zero");
+
+		critical = tst_atomic_load(&hits);
+		if (critical > 100) {
+			tst_fzsync_group_cleanup(&group);
+			tst_atomic_store(0, &group.exit);
+			break;
+		}
+	}
+
+	/* See tst_fuzzy_sync01 */
+	if (group.exit) {
+		tst_res(TCONF, "Test may not be able to generate a valid result");
+		return;
+	}
+
+	tst_res(critical > 50 ? TPASS : TFAIL,
+		"race %u: all %d threads overlapped %d times in %d loops",
+		i, THREADS, critical, loops);
+}
+
+static struct tst_test test = {
+	.tcnt = ARRAY_SIZE(races),
+	.test = run,
+	.setup = setup,
+	.cleanup = cleanup,
+	.runtime = 150,
+};
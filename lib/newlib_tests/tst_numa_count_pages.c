@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (c) Linux Test Project, 2026
+ */
+
+/*\
+ * Microbenchmark for tst_nodemap_count_pages().
+ *
+ * Faults in an anonymous mapping, counts the pages per node with
+ * tst_nodemap_count_pages() and with a plain per-page get_mempolicy() loop,
+ * checks that both agree and prints how long each of them took. The default
+ * size is kept small for the newlib test run, use -s for a real benchmark.
+ */
+
+#include "config.h"
+#ifdef HAVE_NUMA_V2
+# include <numa.h>
+# include <numaif.h>
+#endif
+#include "tst_test.h"
+#include "tst_numa.h"
+#include "tst_clocks.h"
+#include "tst_timer.h"
+
+#ifdef HAVE_NUMA_V2
+
+static char *str_size_mb;
+static size_t size = 64 * 1024 * 1024;
+static struct tst_nodemap *nodes;
+static void *ptr;
+
+static void count_per_page(unsigned int *counters)
+{
+	size_t page_size = getpagesize();
+	size_t i;
+	unsigned int j;
+	int node;
+
+	for (i = 0; i < size; i += page_size) {
+		if (get_mempolicy(&node, NULL, 0, ptr + i,
+				  MPOL_F_NODE | MPOL_F_ADDR))
+			tst_brk(TBROK | TERRNO, "get_mempolicy() failed");
+
+		for (j = 0; j < nodes->cnt; j++) {
+			if (nodes->map[j] == (unsigned int)node) {
+				counters[j]++;
+				break;
+			}
+		}
+	}
+}
+
+static void setup(void)
+{
+	long size_mb;
+
+	if (tst_parse_long(str_size_mb, &size_mb, 1, 1024 * 1024))
+		tst_brk(TBROK, "Invalid size '%s'", str_size_mb);
+
+	if (str_size_mb)
+		size = size_mb * 1024 * 1024;
+
+	nodes = tst_get_nodemap(TST_NUMA_MEM, size / 1024);
+	if (!nodes->cnt)
+		tst_brk(TCONF, "No NUMA memory nodes");
+
+	ptr = tst_numa_map(NULL, size);
+	tst_numa_fault(ptr, size);
+}
+
+static void run(void)
+{
+	unsigned int counters[nodes->cnt];
+	struct timespec start, end;
+	unsigned int i;
+	long long batched_us, per_page_us;
+
+	memset(counters, 0, sizeof(counters));
+	tst_nodemap_reset_counters(nodes);
+
+	tst_clock_gettime(CLOCK_MONOTONIC, &start);
+	tst_nodemap_count_pages(nodes, ptr, size);
+	tst_clock_gettime(CLOCK_MONOTONIC, &end);
+	batched_us = tst_timespec_diff_us(end, start);
+
+	tst_clock_gettime(CLOCK_MONOTONIC, &start);
+	count_per_page(counters);
+	tst_clock_gettime(CLOCK_MONOTONIC, &end);
+	per_page_us = tst_timespec_diff_us(end, start);
+
+	for (i = 0; i < nodes->cnt; i++) {
+		if (nodes->counters[i] != counters[i]) {
+			tst_res(TFAIL, "Node %u has %u pages, expected %u",
+				nodes->map[i], nodes->counters[i], counters[i]);
+			return;
+		}
+	}
+
+	tst_nodemap_print_counters(nodes);
+
+	tst_res(TPASS, "%zu MB counted in %lli us, per page get_mempolicy() %lli us",
+		size / (1024 * 1024), batched_us, per_page_us);
+}
+
+static void cleanup(void)
+{
+	if (ptr)
+		tst_numa_unmap(ptr, size);
+
+	if (nodes)
+		tst_nodemap_free(nodes);
+}
+
+static struct tst_test test = {
+	.setup = setup,
+	.cleanup = cleanup,
+	.test_all = run,
+	.options = (struct tst_option[]) {
+		{"s:", &str_size_mb, "Size of the mapping in MB (default 64)"},
+		{}
+	},
+};
+
+#else
+
+TST_TEST_TCONF(NUMA_ERROR_MSG);
+
+#endif /* HAVE_NUMA_V2 */
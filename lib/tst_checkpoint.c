@@ -24,10 +24,13 @@
 #include <stdint.h>
 #include <limits.h>
 #include <errno.h>
+#include <sched.h>
+#include <time.h>
 #include <sys/syscall.h>
 
 #include "test.h"
 #include "safe_macros.h"
+#include "tst_atomic.h"
 #include "lapi/futex.h"
 
 #define DEFAULT_MSEC_TIMEOUT 10000
@@ -35,6 +38,31 @@
 futex_t *tst_futexes;
 unsigned int tst_max_futexes;
 
+/*
+ * Each checkpoint uses a pair of words in the futex page. The first one is
+ * the futex the waiters sleep on, the second one counts the waiters that are
+ * about to sleep or are sleeping on it so that the waker can sleep until
+ * enough of them arrive instead of polling.
+ */
+#define CHECKPOINT_FUTEX(id) (&tst_futexes[2 * (id)])
+#define CHECKPOINT_WAITERS(id) ((tst_atomic_t *)&tst_futexes[2 * (id) + 1])
+
+#define CHECKPOINT_MAX_YIELDS 1000
+#define CHECKPOINT_POLL_NS 1000000LL
+
+static int checkpoint_id_valid(unsigned int id)
+{
+	if (!tst_max_futexes)
+		tst_brkm(TBROK, NULL, "Set test.needs_checkpoints = 1");
+
+	if (id >= tst_max_futexes / 2) {
+		errno = EOVERFLOW;
+		return 0;
+	}
+
+	return 1;
+}
+
 void tst_checkpoint_init(const char *file, const int lineno,
                          void (*cleanup_fn)(void))
 {
@@ -83,54 +111,131 @@ void tst_checkpoint_init(const char *file, const int lineno,
 int tst_checkpoint_wait(unsigned int id, unsigned int msec_timeout)
 {
 	struct timespec timeout;
+	tst_atomic_t *waiters;
 	int ret;
 
-	if (!tst_max_futexes)
-		tst_brkm(TBROK, NULL, "Set test.needs_checkpoints = 1");
-
-	if (id >= tst_max_futexes) {
-		errno = EOVERFLOW;
+	if (!checkpoint_id_valid(id))
 		return -1;
-	}
+
+	waiters = CHECKPOINT_WAITERS(id);
 
 	timeout.tv_sec = msec_timeout/1000;
 	timeout.tv_nsec = (msec_timeout%1000) * 1000000;
 
+	tst_atomic_inc(waiters);
+	syscall(SYS_futex, waiters, FUTEX_WAKE, INT_MAX, NULL);
+
 	do {
-		ret = syscall(SYS_futex, &tst_futexes[id], FUTEX_WAIT,
-			      tst_futexes[id], &timeout);
+		ret = syscall(SYS_futex, CHECKPOINT_FUTEX(id), FUTEX_WAIT,
+			      *CHECKPOINT_FUTEX(id), &timeout);
 	} while (ret == -1 && errno == EINTR);
 
+	tst_atomic_dec(waiters);
+
 	return ret;
 }
 
-int tst_checkpoint_wake(unsigned int id, unsigned int nr_wake,
-                        unsigned int msec_timeout)
+static long long deadline_remaining_ns(const struct timespec *deadline)
 {
-	unsigned int msecs = 0, waked = 0;
+	struct timespec now;
 
-	if (!tst_max_futexes)
-		tst_brkm(TBROK, NULL, "Set test.needs_checkpoints = 1");
+	clock_gettime(CLOCK_MONOTONIC, &now);
 
-	if (id >= tst_max_futexes) {
-		errno = EOVERFLOW;
-		return -1;
-	}
+	return (deadline->tv_sec - now.tv_sec) * 1000000000LL +
+	       (deadline->tv_nsec - now.tv_nsec);
+}
+
+static int checkpoint_wake(unsigned int id, unsigned int nr_wake,
+			   const struct timespec *deadline)
+{
+	tst_atomic_t *waiters = CHECKPOINT_WAITERS(id);
+	unsigned int waked = 0;
+	struct timespec timeout;
+	long long remaining;
+	int32_t nr_waiters;
+	unsigned int yields = 0;
 
 	for (;;) {
-		waked += syscall(SYS_futex, &tst_futexes[id], FUTEX_WAKE,
+		waked += syscall(SYS_futex, CHECKPOINT_FUTEX(id), FUTEX_WAKE,
 				 INT_MAX, NULL);
 
 		if (waked == nr_wake)
-			break;
-
-		usleep(1000);
-		msecs++;
+			return 0;
 
-		if (msecs >= msec_timeout) {
+		remaining = deadline_remaining_ns(deadline);
+		if (remaining <= 0) {
 			errno = ETIMEDOUT;
 			return -1;
 		}
+
+		nr_waiters = tst_atomic_load(waiters);
+
+		/*
+		 * A waiter is either just about to sleep on the futex or has
+		 * been woken up and did not decrement the counter yet, both
+		 * windows are short. The counter stays up for good if a waiter
+		 * was killed in between, so stop spinning after a while and
+		 * poll the counter with short sleeps instead.
+		 */
+		if (nr_waiters && yields < CHECKPOINT_MAX_YIELDS) {
+			yields++;
+			sched_yield();
+			continue;
+		}
+
+		if (nr_waiters)
+			remaining = MIN(remaining, CHECKPOINT_POLL_NS);
+
+		/* Sleep until a waiter arrives */
+		timeout.tv_sec = remaining / 1000000000;
+		timeout.tv_nsec = remaining % 1000000000;
+
+		syscall(SYS_futex, waiters, FUTEX_WAIT, nr_waiters, &timeout);
+	}
+}
+
+static void set_deadline(struct timespec *deadline, unsigned int msec_timeout)
+{
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+
+	deadline->tv_sec += msec_timeout / 1000;
+	deadline->tv_nsec += (msec_timeout % 1000) * 1000000;
+
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
+
+int tst_checkpoint_wake(unsigned int id, unsigned int nr_wake,
+                        unsigned int msec_timeout)
+{
+	struct timespec deadline;
+
+	if (!checkpoint_id_valid(id))
+		return -1;
+
+	set_deadline(&deadline, msec_timeout);
+
+	return checkpoint_wake(id, nr_wake, &deadline);
+}
+
+int tst_checkpoint_wake_ids(const unsigned int ids[], unsigned int nr_ids,
+			    unsigned int nr_wake, unsigned int msec_timeout)
+{
+	struct timespec deadline;
+	unsigned int i;
+
+	for (i = 0; i < nr_ids; i++) {
+		if (!checkpoint_id_valid(ids[i]))
+			return -1;
+	}
+
+	set_deadline(&deadline, msec_timeout);
+
+	for (i = 0; i < nr_ids; i++) {
+		if (checkpoint_wake(ids[i], nr_wake, &deadline))
+			return -1;
 	}
 
 	return 0;
@@ -166,3 +271,18 @@ void tst_safe_checkpoint_wake(const char *file, const int lineno,
 			DEFAULT_MSEC_TIMEOUT);
 	}
 }
+
+void tst_safe_checkpoint_wake_ids(const char *file, const int lineno,
+				  void (*cleanup_fn)(void),
+				  const unsigned int ids[], unsigned int nr_ids,
+				  unsigned int nr_wake)
+{
+	int ret = tst_checkpoint_wake_ids(ids, nr_ids, nr_wake,
+					  DEFAULT_MSEC_TIMEOUT);
+
+	if (ret) {
+		tst_brkm_(file, lineno, TBROK | TERRNO, cleanup_fn,
+			"tst_checkpoint_wake_ids(%u ids, %u, %i) failed",
+			nr_ids, nr_wake, DEFAULT_MSEC_TIMEOUT);
+	}
+}
@@ -239,6 +239,37 @@ uint64_t tst_get_device_size(const char *dev_path)
 	return size/1024/1024;
 }
 
+int tst_loop_backing_file(const char *dev, char *path, size_t path_len)
+{
+	char sys_path[PATH_MAX];
+	struct stat st;
+	ssize_t len;
+	int fd;
+
+	if (stat(dev, &st) || !S_ISBLK(st.st_mode))
+		return 1;
+
+	snprintf(sys_path, sizeof(sys_path), "/sys/dev/block/%u:%u/loop/backing_file",
+		 major(st.st_rdev), minor(st.st_rdev));
+
+	fd = open(sys_path, O_RDONLY);
+	if (fd < 0)
+		return 1;
+
+	len = read(fd, path, path_len - 1);
+	close(fd);
+
+	if (len <= 0)
+		return 1;
+
+	path[len] = 0;
+
+	if (path[len - 1] == '\n')
+		path[len - 1] = 0;
+
+	return 0;
+}
+
 int tst_detach_device_by_fd(const char *dev, int dev_fd)
 {
 	int ret, i;
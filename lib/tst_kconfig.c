@@ -7,6 +7,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/utsname.h>
 
 #define TST_NO_DEFAULT_MAIN
@@ -75,15 +79,10 @@ static const char *kconfig_path(char *path_buf, size_t path_buf_len)
 
 static char is_gzip;
 
-static FILE *open_kconfig(void)
+static FILE *open_kconfig(const char *path)
 {
 	FILE *fp;
 	char buf[1064];
-	char path_buf[1024];
-	const char *path = kconfig_path(path_buf, sizeof(path_buf));
-
-	if (!path)
-		return NULL;
 
 	tst_res(TINFO, "Parsing kernel config '%s'", path);
 
@@ -102,20 +101,31 @@ static FILE *open_kconfig(void)
 	return fp;
 }
 
-static void close_kconfig(FILE *fp)
+static int close_kconfig(FILE *fp)
 {
 	if (is_gzip)
-		pclose(fp);
-	else
-		fclose(fp);
+		return pclose(fp);
+
+	return fclose(fp);
 }
 
-static inline int kconfig_parse_line(const char *line,
-                                     struct tst_kconfig_var *vars,
-                                     unsigned int vars_len)
+struct kconfig_entry {
+	const char *id;
+	unsigned int id_len;
+	char choice;
+	const char *val;
+	unsigned int val_len;
+};
+
+/*
+ * Parses a single line of the config, returns 1 and fills in the entry if a
+ * variable was found on the line.
+ */
+static inline int kconfig_parse_entry(const char *line,
+                                      struct kconfig_entry *entry)
 {
-	unsigned int i, var_len = 0;
-	const char *var;
+	unsigned int var_len = 0, val_len = 0;
+	const char *var, *val;
 	int is_not_set = 0;
 
 	while (isspace(*line))
@@ -147,75 +157,423 @@ static inline int kconfig_parse_line(const char *line,
 	}
 
 out:
+	entry->id = var;
+	entry->id_len = var_len;
+	entry->val = NULL;
+	entry->val_len = 0;
 
-	for (i = 0; i < vars_len; i++) {
-		const char *val;
-		unsigned int val_len = 0;
+	if (is_not_set) {
+		entry->choice = 'n';
+		return 1;
+	}
 
-		if (vars[i].id_len != var_len)
-			continue;
+	val = var + var_len;
+
+	while (isspace(*val))
+		val++;
+
+	if (*val != '=')
+		return 0;
+
+	val++;
+
+	while (isspace(*val))
+		val++;
+
+	while (val[val_len] && !isspace(val[val_len]))
+		val_len++;
+
+	if (val_len == 1 && (val[0] == 'y' || val[0] == 'm')) {
+		entry->choice = val[0];
+		return 1;
+	}
+
+	entry->choice = 'v';
+	entry->val = val;
+	entry->val_len = val_len;
+
+	return 1;
+}
+
+/*
+ * Parsed kernel config cache.
+ *
+ * The whole config is parsed once into a table of variables sorted by name
+ * that is stored in a file and mapped by the subsequent test processes. The
+ * file is named after a hash of the kernel build id, uname and the config
+ * file, so a different kernel or config ends up in a different file.
+ *
+ * The file starts with a header, followed by the sorted entries and the
+ * strings the entries point to.
+ */
+#define KCONFIG_CACHE_MAGIC "LTPKCFG1"
+
+struct kconfig_cache_hdr {
+	char magic[8];
+	uint64_t key;
+	uint32_t entries;
+	uint32_t size;
+};
+
+struct kconfig_cache_entry {
+	uint32_t id_off;
+	uint32_t val_off;
+	char choice;
+};
+
+static struct kconfig_cache_hdr *kconfig_cache;
+static size_t kconfig_cache_size;
+static int kconfig_cache_mapped;
+
+static uint64_t fnv1a(uint64_t hash, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	while (len--) {
+		hash ^= *(p++);
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static uint64_t kconfig_cache_key(const char *path)
+{
+	uint64_t key = 0xcbf29ce484222325ULL;
+	char notes[4096];
+	struct utsname un;
+	struct stat st;
+	ssize_t len;
+	int fd;
+
+	uname(&un);
+	key = fnv1a(key, un.release, strlen(un.release));
+	key = fnv1a(key, un.version, strlen(un.version));
+	key = fnv1a(key, un.machine, strlen(un.machine));
+	key = fnv1a(key, path, strlen(path));
+
+	/* The kernel build id note */
+	fd = open("/sys/kernel/notes", O_RDONLY);
+	if (fd >= 0) {
+		len = read(fd, notes, sizeof(notes));
+		if (len > 0)
+			key = fnv1a(key, notes, len);
+		close(fd);
+	}
+
+	/* Files in /proc are regenerated for each boot */
+	if (strncmp(path, "/proc/", 6) && !stat(path, &st)) {
+		key = fnv1a(key, &st.st_dev, sizeof(st.st_dev));
+		key = fnv1a(key, &st.st_ino, sizeof(st.st_ino));
+		key = fnv1a(key, &st.st_size, sizeof(st.st_size));
+		key = fnv1a(key, &st.st_mtim, sizeof(st.st_mtim));
+	}
+
+	return key;
+}
+
+static void kconfig_cache_path(char *buf, size_t buf_len, uint64_t key)
+{
+	const char *dir = getenv("LTP_KCONFIG_CACHE_DIR");
+
+	if (!dir)
+		dir = getenv("TMPDIR");
+
+	if (!dir || dir[0] != '/')
+		dir = "/tmp";
+
+	snprintf(buf, buf_len, "%s/ltp_kconfig_%016llx", dir,
+		 (unsigned long long)key);
+}
+
+static int kconfig_cache_valid(struct kconfig_cache_hdr *hdr, size_t size,
+			       uint64_t key)
+{
+	if (size < sizeof(*hdr))
+		return 0;
+
+	if (memcmp(hdr->magic, KCONFIG_CACHE_MAGIC, sizeof(hdr->magic)))
+		return 0;
+
+	if (hdr->key != key || hdr->size != size)
+		return 0;
+
+	if (hdr->entries > (size - sizeof(*hdr)) / sizeof(struct kconfig_cache_entry))
+		return 0;
+
+	/* The string table has to be terminated */
+	return ((char *)hdr)[size - 1] == 0;
+}
+
+static void kconfig_cache_unmap(void)
+{
+	if (!kconfig_cache)
+		return;
+
+	if (kconfig_cache_mapped)
+		munmap(kconfig_cache, kconfig_cache_size);
+	else
+		free(kconfig_cache);
+
+	kconfig_cache = NULL;
+}
+
+static int kconfig_cache_map(const char *cache_path, uint64_t key)
+{
+	struct stat st;
+	void *ptr;
+	int fd;
+
+	fd = open(cache_path, O_RDONLY);
+	if (fd < 0)
+		return 1;
 
-		if (strncmp(vars[i].id, var, var_len))
+	/* Do not trust files that could have been planted by other users */
+	if (fstat(fd, &st) || (st.st_uid != geteuid() && st.st_uid != 0) ||
+	    (st.st_mode & 022)) {
+		close(fd);
+		return 1;
+	}
+
+	ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (ptr == MAP_FAILED)
+		return 1;
+
+	if (!kconfig_cache_valid(ptr, st.st_size, key)) {
+		munmap(ptr, st.st_size);
+		return 1;
+	}
+
+	kconfig_cache = ptr;
+	kconfig_cache_size = st.st_size;
+	kconfig_cache_mapped = 1;
+
+	return 0;
+}
+
+struct kconfig_cache_var {
+	char *id;
+	char *val;
+	char choice;
+	unsigned int line;
+};
+
+static int kconfig_cache_var_cmp(const void *a, const void *b)
+{
+	const struct kconfig_cache_var *va = a, *vb = b;
+	int ret = strcmp(va->id, vb->id);
+
+	if (ret)
+		return ret;
+
+	return va->line < vb->line ? -1 : va->line > vb->line;
+}
+
+/*
+ * Parses the whole config and builds the cache in memory, the last
+ * definition of a variable wins.
+ */
+static int kconfig_cache_build(FILE *fp, uint64_t key)
+{
+	struct kconfig_cache_var *vars = NULL;
+	unsigned int vars_len = 0, vars_cnt = 0, i, entries = 0;
+	struct kconfig_cache_entry *entry;
+	struct kconfig_entry e;
+	char *line = NULL, *buf;
+	size_t line_len = 0, size, str_off;
+	int ret;
+
+	while (getline(&line, &line_len, fp) > 0) {
+		if (!kconfig_parse_entry(line, &e))
 			continue;
 
-		if (is_not_set) {
-			vars[i].choice = 'n';
-			return 1;
+		if (vars_cnt >= vars_len) {
+			vars_len = vars_len ? 2 * vars_len : 1024;
+			vars = SAFE_REALLOC(vars, vars_len * sizeof(*vars));
 		}
 
-		val = var + var_len;
+		vars[vars_cnt].id = strndup(e.id, e.id_len);
+		vars[vars_cnt].val = e.val ? strndup(e.val, e.val_len) : NULL;
+		vars[vars_cnt].choice = e.choice;
+		vars[vars_cnt].line = vars_cnt;
+		vars_cnt++;
+	}
+
+	free(line);
 
-		while (isspace(*val))
-			val++;
+	ret = ferror(fp) ? -1 : (int)vars_cnt;
 
-		if (*val != '=')
-			return 0;
+	qsort(vars, vars_cnt, sizeof(*vars), kconfig_cache_var_cmp);
 
-		val++;
+	size = sizeof(struct kconfig_cache_hdr);
 
-		while (isspace(*val))
-			val++;
+	for (i = 0; i < vars_cnt; i++) {
+		if (i + 1 < vars_cnt && !strcmp(vars[i].id, vars[i+1].id))
+			continue;
 
-		while (!isspace(val[val_len]))
-			val_len++;
+		size += sizeof(struct kconfig_cache_entry);
+		size += strlen(vars[i].id) + 1;
+		if (vars[i].val)
+			size += strlen(vars[i].val) + 1;
 
-		if (val_len == 1) {
-			switch (val[0]) {
-			case 'y':
-				vars[i].choice = 'y';
-				return 1;
-			case 'm':
-				vars[i].choice = 'm';
-				return 1;
-			}
+		entries++;
+	}
+
+	/* The empty string for variables without a value */
+	size += 1;
+
+	kconfig_cache = SAFE_MALLOC(size);
+	kconfig_cache_size = size;
+	kconfig_cache_mapped = 0;
+
+	buf = (char *)kconfig_cache;
+	memset(buf, 0, size);
+
+	memcpy(kconfig_cache->magic, KCONFIG_CACHE_MAGIC, sizeof(kconfig_cache->magic));
+	kconfig_cache->key = key;
+	kconfig_cache->entries = entries;
+	kconfig_cache->size = size;
+
+	entry = (struct kconfig_cache_entry *)(kconfig_cache + 1);
+	str_off = sizeof(*kconfig_cache) + entries * sizeof(*entry);
+
+	for (i = 0; i < vars_cnt; i++) {
+		if (i + 1 < vars_cnt && !strcmp(vars[i].id, vars[i+1].id))
+			goto next;
+
+		entry->choice = vars[i].choice;
+		entry->id_off = str_off;
+		strcpy(buf + str_off, vars[i].id);
+		str_off += strlen(vars[i].id) + 1;
+
+		if (vars[i].val) {
+			entry->val_off = str_off;
+			strcpy(buf + str_off, vars[i].val);
+			str_off += strlen(vars[i].val) + 1;
+		} else {
+			entry->val_off = size - 1;
 		}
 
-		vars[i].choice = 'v';
-		vars[i].val = strndup(val, val_len);
+		entry++;
+next:
+		free(vars[i].id);
+		free(vars[i].val);
 	}
 
-	return 0;
+	free(vars);
+
+	return ret;
+}
+
+static void kconfig_cache_store(const char *cache_path)
+{
+	char tmp_path[PATH_MAX + 8];
+	char *buf = (char *)kconfig_cache;
+	size_t size = kconfig_cache_size;
+	ssize_t ret;
+	int fd;
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", cache_path);
+
+	fd = mkstemp(tmp_path);
+	if (fd < 0)
+		return;
+
+	if (fchmod(fd, 0644))
+		goto err;
+
+	while (size) {
+		ret = write(fd, buf, size);
+		if (ret <= 0)
+			goto err;
+
+		buf += ret;
+		size -= ret;
+	}
+
+	if (close(fd)) {
+		unlink(tmp_path);
+		return;
+	}
+
+	/* Concurrent writers produce the same content, last one wins */
+	if (rename(tmp_path, cache_path))
+		unlink(tmp_path);
+
+	return;
+err:
+	close(fd);
+	unlink(tmp_path);
+}
+
+static int kconfig_cache_entry_cmp(const void *id, const void *e)
+{
+	const struct kconfig_cache_entry *entry = e;
+
+	return strcmp(id, (char *)kconfig_cache + entry->id_off);
+}
+
+static void kconfig_cache_lookup(struct tst_kconfig_var vars[], size_t vars_len)
+{
+	struct kconfig_cache_entry *entry;
+	size_t i;
+
+	for (i = 0; i < vars_len; i++) {
+		entry = bsearch(vars[i].id, kconfig_cache + 1,
+				kconfig_cache->entries, sizeof(*entry),
+				kconfig_cache_entry_cmp);
+		if (!entry)
+			continue;
+
+		vars[i].choice = entry->choice;
+
+		if (entry->choice == 'v')
+			vars[i].val = strdup((char *)kconfig_cache + entry->val_off);
+	}
 }
 
 void tst_kconfig_read(struct tst_kconfig_var vars[], size_t vars_len)
 {
-	char line[128];
-	unsigned int vars_found = 0;
+	char path_buf[1024];
+	char cache_path[PATH_MAX];
+	const char *path;
+	uint64_t key;
+	FILE *fp;
+	int parsed;
 
-	FILE *fp = open_kconfig();
-	if (!fp)
+	path = kconfig_path(path_buf, sizeof(path_buf));
+	if (!path)
 		tst_brk(TBROK, "Cannot parse kernel .config");
 
-	while (fgets(line, sizeof(line), fp)) {
-		if (kconfig_parse_line(line, vars, vars_len))
-			vars_found++;
+	key = kconfig_cache_key(path);
+
+	if (kconfig_cache && kconfig_cache->key == key)
+		goto lookup;
+
+	kconfig_cache_unmap();
+	kconfig_cache_path(cache_path, sizeof(cache_path), key);
 
-		if (vars_found == vars_len)
-			goto exit;
+	if (!kconfig_cache_map(cache_path, key))
+		goto lookup;
+
+	fp = open_kconfig(path);
+	parsed = kconfig_cache_build(fp, key);
+
+	/*
+	 * Do not store a failed or empty parse, e.g. zcat missing, the cache
+	 * key would not change and all later runs would read the empty cache.
+	 */
+	if (close_kconfig(fp) || parsed <= 0) {
+		tst_res(TINFO, "Failed to parse '%s', not caching it", path);
+		goto lookup;
 	}
 
-exit:
-	close_kconfig(fp);
+	kconfig_cache_store(cache_path);
+
+lookup:
+	kconfig_cache_lookup(vars, vars_len);
 }
 
 static size_t array_len(const char *const kconfigs[])
@@ -523,6 +881,9 @@ int tst_kconfig_check(const char *const kconfigs[])
 
 	tst_kconfig_read(vars, var_cnt);
 
+	if (kconfig_cache_mapped)
+		tst_res(TINFO, "Kernel config checked against the cached config");
+
 	for (i = 0; i < expr_cnt; i++) {
 		int val = tst_bool_expr_eval(exprs[i], map);
 
@@ -4,12 +4,19 @@
  * Copyright (c) Linux Test Project, 2021-2023
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <unistd.h>
 #include <limits.h>
+#include <sched.h>
 #include <sys/sysinfo.h>
+#include <sys/wait.h>
 #include <stdlib.h>
 
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
 #define TST_NO_DEFAULT_MAIN
 #include "tst_test.h"
 #include "tst_memutils.h"
@@ -18,13 +25,17 @@
 #include "lapi/syscalls.h"
 
 #define BLOCKSIZE (16 * 1024 * 1024)
+#define NODE_PATH "/sys/devices/system/node"
 
-void tst_pollute_memory(size_t maxsize, int fillchar)
+/*
+ * Returns how much memory can be polluted without invoking OOM killer or zero
+ * if there is not enough free memory.
+ */
+static size_t pollute_size(size_t maxsize)
 {
-	size_t i, map_count = 0, safety = 0, blocksize = BLOCKSIZE;
+	size_t safety = 0;
 	unsigned long long freeram;
 	size_t min_free;
-	void **map_blocks;
 	struct sysinfo info;
 
 	SAFE_FILE_SCANF("/proc/sys/vm/min_free_kbytes", "%zi", &min_free);
@@ -51,7 +62,7 @@ void tst_pollute_memory(size_t maxsize, int fillchar)
 
 	/* Not enough free memory to avoid invoking OOM killer */
 	if (freeram <= safety)
-		return;
+		return 0;
 
 	if (!maxsize)
 		maxsize = SIZE_MAX;
@@ -59,32 +70,277 @@ void tst_pollute_memory(size_t maxsize, int fillchar)
 	if (freeram - safety < maxsize / info.mem_unit)
 		maxsize = (freeram - safety) * info.mem_unit;
 
-	blocksize = MIN(maxsize, blocksize);
-	map_count = maxsize / blocksize;
-	map_blocks = SAFE_MALLOC(map_count * sizeof(void *));
+	return maxsize;
+}
+
+static void fill_block(void *ptr, int fillchar, size_t size)
+{
+#ifdef __SSE2__
+	/*
+	 * Use non-temporal stores, the memory is not going to be read so
+	 * there is no point in pulling it into the cache.
+	 */
+	__m128i val = _mm_set1_epi8(fillchar);
+	__m128i *p = ptr;
+	size_t i, cnt = size / sizeof(*p);
+
+	for (i = 0; i < cnt; i++)
+		_mm_stream_si128(p + i, val);
+
+	_mm_sfence();
+	memset(p + cnt, fillchar, size % sizeof(*p));
+#else
+	memset(ptr, fillchar, size);
+#endif
+}
+
+/*
+ * Maps and fills up to maxsize of memory in blocks, returns the number of
+ * blocks that were mapped.
+ */
+static size_t pollute_blocks(void ***map_blocks, size_t maxsize, int fillchar,
+			     unsigned int flags, size_t *blocksize)
+{
+	size_t i, map_count;
+	int mmap_flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	void **blocks;
+
+	if (flags & TST_POLLUTE_POPULATE)
+		mmap_flags |= MAP_POPULATE;
+
+	*blocksize = MIN(maxsize, BLOCKSIZE);
+	map_count = maxsize / *blocksize;
+	blocks = SAFE_MALLOC(map_count * sizeof(void *));
 
 	/*
 	 * Keep allocating until the first failure. The address space may be
 	 * too fragmented or just smaller than maxsize.
 	 */
 	for (i = 0; i < map_count; i++) {
-		map_blocks[i] = mmap(NULL, blocksize, PROT_READ | PROT_WRITE,
-			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		blocks[i] = mmap(NULL, *blocksize, PROT_READ | PROT_WRITE,
+			mmap_flags, -1, 0);
 
-		if (map_blocks[i] == MAP_FAILED) {
+		if (blocks[i] == MAP_FAILED) {
 			map_count = i;
 			break;
 		}
 
-		memset(map_blocks[i], fillchar, blocksize);
+		if (flags & TST_POLLUTE_THP)
+			madvise(blocks[i], *blocksize, MADV_HUGEPAGE);
+
+		fill_block(blocks[i], fillchar, *blocksize);
+	}
+
+	*map_blocks = blocks;
+
+	return map_count;
+}
+
+struct pollute_worker {
+	int cpu;
+	size_t size;
+	pid_t pid;
+};
+
+static unsigned int parse_cpulist(const char *path, cpu_set_t *allowed,
+				  int *cpus, unsigned int cpus_len)
+{
+	unsigned int cnt = 0;
+	int first, last;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+
+	while (fscanf(f, "%d", &first) == 1) {
+		last = first;
+
+		if (fgetc(f) == '-' && fscanf(f, "%d", &last) == 1)
+			fgetc(f);
+
+		for (; first <= last && first < CPU_SETSIZE; first++) {
+			if (CPU_ISSET(first, allowed) && cnt < cpus_len)
+				cpus[cnt++] = first;
+		}
+	}
+
+	fclose(f);
+
+	return cnt;
+}
+
+/*
+ * Splits the memory between one worker per allowed CPU. Each NUMA node gets
+ * a share proportional to its free memory, which is split evenly between the
+ * CPUs of the node. Workers are bound to the CPUs so that the pages are
+ * allocated on their local node. Memory only nodes are skipped.
+ */
+static unsigned int plan_workers(struct pollute_worker *workers,
+				 unsigned int workers_len, size_t maxsize)
+{
+	int cpus[CPU_SETSIZE];
+	unsigned long long node_free[CPU_SETSIZE], total_free = 0;
+	unsigned int node_cpus[CPU_SETSIZE];
+	unsigned int node, nodes = 0, cnt = 0, i;
+	cpu_set_t allowed;
+	char path[128];
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed))
+		tst_brk(TBROK | TERRNO, "sched_getaffinity()");
+
+	for (node = 0; node < CPU_SETSIZE && cnt < workers_len; node++) {
+		snprintf(path, sizeof(path), NODE_PATH "/node%u", node);
+
+		if (access(path, F_OK))
+			continue;
+
+		snprintf(path, sizeof(path), NODE_PATH "/node%u/cpulist", node);
+		node_cpus[nodes] = parse_cpulist(path, &allowed, cpus + cnt,
+						 workers_len - cnt);
+
+		if (!node_cpus[nodes])
+			continue;
+
+		snprintf(path, sizeof(path), NODE_PATH "/node%u/meminfo", node);
+		if (FILE_LINES_SCANF(path, "Node %*u MemFree: %llu",
+				     &node_free[nodes]))
+			node_free[nodes] = 1;
+
+		total_free += node_free[nodes];
+		cnt += node_cpus[nodes];
+		nodes++;
 	}
 
+	/* Kernel without NUMA support */
+	if (!nodes) {
+		for (i = 0; i < CPU_SETSIZE && cnt < workers_len; i++) {
+			if (CPU_ISSET(i, &allowed))
+				cpus[cnt++] = i;
+		}
+
+		node_cpus[0] = cnt;
+		node_free[0] = total_free = 1;
+		nodes = 1;
+	}
+
+	cnt = 0;
+
+	for (node = 0; node < nodes; node++) {
+		size_t size = (double)maxsize * node_free[node] / total_free /
+			      node_cpus[node];
+
+		for (i = 0; i < node_cpus[node]; i++) {
+			workers[cnt].cpu = cpus[cnt];
+			workers[cnt].size = size;
+			cnt++;
+		}
+	}
+
+	return cnt;
+}
+
+static void pollute_worker(struct pollute_worker *worker, int fillchar,
+			   unsigned int flags, int done_fd, int release_fd)
+{
+	size_t blocksize;
+	void **blocks;
+	cpu_set_t set;
+	char buf;
+
+	CPU_ZERO(&set);
+	CPU_SET(worker->cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+
+	if (worker->size)
+		pollute_blocks(&blocks, worker->size, fillchar, flags, &blocksize);
+
+	/* Keep the memory until all workers have finished */
+	if (write(done_fd, "", 1) != 1 || read(release_fd, &buf, 1) < 0)
+		_exit(1);
+
+	_exit(0);
+}
+
+static void pollute_memory_parallel(size_t maxsize, int fillchar,
+				    unsigned int flags)
+{
+	unsigned int i, workers_cnt, done = 0;
+	struct pollute_worker *workers;
+	int done_pipe[2], release_pipe[2], status;
+	char buf;
+
+	workers = SAFE_MALLOC(CPU_SETSIZE * sizeof(*workers));
+	workers_cnt = plan_workers(workers, CPU_SETSIZE, maxsize);
+
+	SAFE_PIPE(done_pipe);
+	SAFE_PIPE(release_pipe);
+
+	for (i = 0; i < workers_cnt; i++) {
+		workers[i].pid = fork();
+
+		if (workers[i].pid < 0)
+			tst_brk(TBROK | TERRNO, "fork()");
+
+		if (!workers[i].pid) {
+			SAFE_CLOSE(done_pipe[0]);
+			SAFE_CLOSE(release_pipe[1]);
+			pollute_worker(&workers[i], fillchar, flags,
+				       done_pipe[1], release_pipe[0]);
+		}
+	}
+
+	SAFE_CLOSE(done_pipe[1]);
+	SAFE_CLOSE(release_pipe[0]);
+
+	/* Returns EOF early if all workers died */
+	while (done < workers_cnt && SAFE_READ(0, done_pipe[0], &buf, 1) == 1)
+		done++;
+
+	SAFE_CLOSE(release_pipe[1]);
+	SAFE_CLOSE(done_pipe[0]);
+
+	for (i = 0; i < workers_cnt; i++) {
+		SAFE_WAITPID(workers[i].pid, &status, 0);
+
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			tst_res(TWARN, "Memory pollution worker on CPU %i %s",
+				workers[i].cpu, tst_strstatus(status));
+		}
+	}
+
+	free(workers);
+}
+
+void tst_pollute_memory_flags(size_t maxsize, int fillchar, unsigned int flags)
+{
+	size_t i, map_count, blocksize;
+	void **map_blocks;
+
+	maxsize = pollute_size(maxsize);
+
+	if (!maxsize)
+		return;
+
+	if (flags & TST_POLLUTE_PARALLEL) {
+		pollute_memory_parallel(maxsize, fillchar, flags);
+		return;
+	}
+
+	map_count = pollute_blocks(&map_blocks, maxsize, fillchar, flags,
+				   &blocksize);
+
 	for (i = 0; i < map_count; i++)
 		SAFE_MUNMAP(map_blocks[i], blocksize);
 
 	free(map_blocks);
 }
 
+void tst_pollute_memory(size_t maxsize, int fillchar)
+{
+	tst_pollute_memory_flags(maxsize, fillchar, 0);
+}
+
 long long tst_available_mem(void)
 {
 	unsigned long long mem_available = 0;
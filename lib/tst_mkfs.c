@@ -15,13 +15,235 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
 #include "test.h"
 #include "ltp_priv.h"
 #include "tst_mkfs.h"
 #include "tst_device.h"
+#include "lapi/ficlone.h"
+#include "lapi/syscalls.h"
 
 #define OPTS_MAX 32
 
+#define MKFS_CACHE_ENV "LTP_MKFS_CACHE_DIR"
+
+/*
+ * Images of these filesystems cannot be shared, the kernel refuses to mount
+ * two filesystems with the same UUID at the same time.
+ */
+static const char *const mkfs_cache_skiplist[] = {
+	"bcachefs",
+	"btrfs",
+	"xfs",
+	NULL
+};
+
+static uint64_t fnv1a_hash(const char *str)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (; *str; str++) {
+		hash ^= (unsigned char)*str;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/*
+ * The cached images are keyed by everything that affects the mkfs result,
+ * the mkfs binary identity changes when mkfs is upgraded.
+ */
+static int mkfs_cache_path(char *path, size_t path_len, const char *mkfs,
+			   const char *dev, const char *fs_type,
+			   const char *fs_opts_str, const char *extra_opts_str)
+{
+	const char *cache_dir = getenv(MKFS_CACHE_ENV);
+	char mkfs_path[PATH_MAX], key[3 * 1024];
+	struct stat st;
+	uint64_t size;
+	int fd, ret;
+
+	if (!cache_dir || !cache_dir[0])
+		return 1;
+
+	if (tst_fs_in_skiplist(fs_type, mkfs_cache_skiplist))
+		return 1;
+
+	if (tst_get_path(mkfs, mkfs_path, sizeof(mkfs_path)) ||
+	    stat(mkfs_path, &st))
+		return 1;
+
+	fd = open(dev, O_RDONLY);
+	if (fd < 0)
+		return 1;
+
+	ret = ioctl(fd, BLKGETSIZE64, &size);
+	close(fd);
+
+	if (ret)
+		return 1;
+
+	snprintf(key, sizeof(key), "%s\n%" PRIu64 "\n%s\n%s\n%lu:%lu:%lld:%lld",
+		 fs_type, size, fs_opts_str, extra_opts_str,
+		 (unsigned long)st.st_dev, (unsigned long)st.st_ino,
+		 (long long)st.st_size, (long long)st.st_mtime);
+
+	if (mkdir(cache_dir, 0755) && errno != EEXIST)
+		return 1;
+
+	snprintf(path, path_len, "%s/%s-%016" PRIx64 ".img",
+		 cache_dir, fs_type, fnv1a_hash(key));
+
+	return 0;
+}
+
+static int copy_range(int src_fd, int dst_fd, off_t off, off_t len)
+{
+	loff_t in = off, out = off;
+	char buf[64 * 1024];
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = syscall(__NR_copy_file_range, src_fd, &in, dst_fd, &out,
+			      len, 0);
+		if (ret <= 0)
+			break;
+
+		len -= ret;
+	}
+
+	/* copy_file_range() unsupported or cross filesystem on old kernels */
+	while (len > 0) {
+		ret = pread(src_fd, buf, MIN(len, (off_t)sizeof(buf)), in);
+		if (ret <= 0)
+			return 1;
+
+		if (pwrite(dst_fd, buf, ret, in) != ret)
+			return 1;
+
+		in += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Copies the whole file, reflinked if possible, otherwise only the data
+ * extents are copied and the holes are preserved.
+ */
+static int copy_image(int src_fd, int dst_fd)
+{
+	off_t data, hole = 0, size;
+
+	size = lseek(src_fd, 0, SEEK_END);
+	if (size < 0)
+		return 1;
+
+	if (ftruncate(dst_fd, 0) || ftruncate(dst_fd, size))
+		return 1;
+
+	if (!ioctl(dst_fd, FICLONE, src_fd))
+		return 0;
+
+	while ((data = lseek(src_fd, hole, SEEK_DATA)) >= 0) {
+		hole = lseek(src_fd, data, SEEK_HOLE);
+		if (hole < 0)
+			return 1;
+
+		if (copy_range(src_fd, dst_fd, data, hole - data))
+			return 1;
+	}
+
+	return errno != ENXIO;
+}
+
+static int mkfs_cache_restore(const char *cache_path, const char *dev,
+			      const char *backing_file)
+{
+	int src_fd, dst_fd, dev_fd, ret;
+
+	/*
+	 * Write back and drop the device page cache left by the previous test
+	 * first, so that dirty pages are not written over the restored image.
+	 */
+	dev_fd = open(dev, O_RDONLY);
+	if (dev_fd < 0)
+		return 1;
+
+	if (fsync(dev_fd) || ioctl(dev_fd, BLKFLSBUF, 0)) {
+		close(dev_fd);
+		return 1;
+	}
+
+	src_fd = open(cache_path, O_RDONLY);
+	if (src_fd < 0) {
+		close(dev_fd);
+		return 1;
+	}
+
+	dst_fd = open(backing_file, O_WRONLY);
+	if (dst_fd < 0) {
+		close(src_fd);
+		close(dev_fd);
+		return 1;
+	}
+
+	ret = copy_image(src_fd, dst_fd);
+	close(src_fd);
+	ret |= close(dst_fd);
+
+	/* Drop the pages read while the image was being replaced */
+	ret |= ioctl(dev_fd, BLKFLSBUF, 0);
+	close(dev_fd);
+
+	return ret;
+}
+
+static void mkfs_cache_store(const char *cache_path, const char *dev,
+			     const char *backing_file)
+{
+	char tmp_path[PATH_MAX + 16];
+	int src_fd, dst_fd, dev_fd, ret;
+
+	/* Make sure all data written by mkfs reached the backing file */
+	dev_fd = open(dev, O_RDONLY);
+	if (dev_fd < 0)
+		return;
+
+	ret = fsync(dev_fd);
+	close(dev_fd);
+
+	if (ret)
+		return;
+
+	src_fd = open(backing_file, O_RDONLY);
+	if (src_fd < 0)
+		return;
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%i", cache_path, getpid());
+
+	dst_fd = open(tmp_path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+	if (dst_fd < 0) {
+		close(src_fd);
+		return;
+	}
+
+	ret = copy_image(src_fd, dst_fd);
+	close(src_fd);
+	ret |= close(dst_fd);
+
+	/* Concurrent tests may store the same image, rename() is atomic */
+	if (ret || rename(tmp_path, cache_path))
+		unlink(tmp_path);
+}
+
 void tst_mkfs_(const char *file, const int lineno, void (cleanup_fn)(void),
 	       const char *dev, const char *fs_type,
 	       const char *const fs_opts[], const char *const extra_opts[])
@@ -31,6 +253,8 @@ void tst_mkfs_(const char *file, const int lineno, void (cleanup_fn)(void),
 	const char *argv[OPTS_MAX] = {mkfs};
 	char fs_opts_str[1024] = "";
 	char extra_opts_str[1024] = "";
+	char cache_path[PATH_MAX], backing_file[PATH_MAX];
+	int use_cache;
 
 	if (!dev) {
 		tst_brkm_(file, lineno, TBROK, cleanup_fn,
@@ -88,6 +312,18 @@ void tst_mkfs_(const char *file, const int lineno, void (cleanup_fn)(void),
 
 	argv[pos] = NULL;
 
+	use_cache = !tst_loop_backing_file(dev, backing_file, sizeof(backing_file)) &&
+		    !mkfs_cache_path(cache_path, sizeof(cache_path), mkfs, dev,
+				     fs_type, fs_opts_str, extra_opts_str);
+
+	if (use_cache && !access(cache_path, R_OK) &&
+	    !mkfs_cache_restore(cache_path, dev, backing_file)) {
+		tst_resm_(file, lineno, TINFO,
+			"Restored %s with %s opts='%s' extra opts='%s' from %s",
+			dev, fs_type, fs_opts_str, extra_opts_str, cache_path);
+		return;
+	}
+
 	if (tst_clear_device(dev)) {
 		tst_brkm_(file, lineno, TBROK, cleanup_fn,
 			"tst_clear_device() failed");
@@ -110,6 +346,9 @@ void tst_mkfs_(const char *file, const int lineno, void (cleanup_fn)(void),
 		tst_brkm_(file, lineno, TBROK, cleanup_fn,
 			"%s failed with exit code %i", mkfs, ret);
 	}
+
+	if (use_cache)
+		mkfs_cache_store(cache_path, dev, backing_file);
 }
 
 const char *tst_dev_fs_type(void)
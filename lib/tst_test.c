@@ -18,6 +18,8 @@
 #include <sys/utsname.h>
 #include <sys/wait.h>
 #include <math.h>
+#include <fcntl.h>
+#include <time.h>
 
 #define TST_NO_DEFAULT_MAIN
 #include "tst_test.h"
@@ -37,6 +39,7 @@
 #include "old_resource.h"
 #include "old_device.h"
 #include "old_tmpdir.h"
+#include "ujson_writer.h"
 #include "ltp-version.h"
 
 /*
@@ -61,6 +64,7 @@ static int iterations = 1;
 static float duration = -1;
 static float timeout_mul = -1;
 static int reproducible_output;
+static const char *output_prefix;
 
 struct context {
 	int32_t lib_pid;
@@ -86,10 +90,59 @@ struct results {
 	tst_atomic_t broken;
 };
 
+/*
+ * Wall clock spent in the library and test phases, see LTP_PHASE_TIMES.
+ */
+enum phase {
+	PHASE_SETUP,
+	PHASE_KCONFIG,
+	PHASE_HUGEPAGES,
+	PHASE_DEVICE,
+	PHASE_MKFS,
+	PHASE_MOUNT,
+	PHASE_CGROUP,
+	PHASE_TESTRUN,
+	PHASE_TEST_SETUP,
+	PHASE_TEST_RUN,
+	PHASE_TEST_CLEANUP,
+	PHASE_CLEANUP,
+	PHASE_CNT,
+};
+
+static const char *const phase_names[PHASE_CNT] = {
+	[PHASE_SETUP] = "setup",
+	[PHASE_KCONFIG] = "kconfig",
+	[PHASE_HUGEPAGES] = "hugepages",
+	[PHASE_DEVICE] = "device",
+	[PHASE_MKFS] = "mkfs",
+	[PHASE_MOUNT] = "mount",
+	[PHASE_CGROUP] = "cgroup",
+	[PHASE_TESTRUN] = "testrun",
+	[PHASE_TEST_SETUP] = "test_setup",
+	[PHASE_TEST_RUN] = "test_run",
+	[PHASE_TEST_CLEANUP] = "test_cleanup",
+	[PHASE_CLEANUP] = "cleanup",
+};
+
+/*
+ * Phases that are indented in the report. The library stages are not, since
+ * they are part of the setup phase only for tests that are not executed for
+ * several filesystems.
+ */
+static const int phase_sub[PHASE_CNT] = {
+	[PHASE_TEST_SETUP] = 1,
+	[PHASE_TEST_RUN] = 1,
+	[PHASE_TEST_CLEANUP] = 1,
+};
+
 struct ipc_region {
 	int32_t magic;
 	struct context context;
 	struct results results;
+	/* Sequence number of the records in the result stream */
+	tst_atomic_t result_seq;
+	/* Phase times in microseconds, summed over all processes */
+	uint64_t phase_us[PHASE_CNT];
 	futex_t futexes[];
 };
 
@@ -113,6 +166,69 @@ long TST_RET;
 static void do_cleanup(void);
 static void do_exit(int ret) __attribute__ ((noreturn));
 
+/*
+ * Set in the per-filesystem runner processes, see run_tcases_per_fs().
+ */
+static int fs_runner;
+static void fs_runner_exit(int ret) __attribute__ ((noreturn));
+
+static struct tst_device tdev;
+
+/*
+ * File descriptor for the machine readable result stream, see LTP_RESULT_FD.
+ */
+static int result_fd = -1;
+
+static void setup_result_stream(void)
+{
+	const char *fd_env = getenv("LTP_RESULT_FD");
+	const char *format_env = getenv("LTP_RESULT_FORMAT");
+	char *end;
+	long fd;
+
+	if (format_env && strcmp(format_env, "json"))
+		tst_brk(TBROK, "Unsupported LTP_RESULT_FORMAT='%s'", format_env);
+
+	if (!fd_env)
+		return;
+
+	errno = 0;
+	fd = strtol(fd_env, &end, 10);
+	if (errno || *end || end == fd_env || fd < 0 || fd > INT_MAX)
+		tst_brk(TBROK, "Invalid LTP_RESULT_FD='%s'", fd_env);
+
+	if (fcntl(fd, F_GETFL) < 0)
+		tst_brk(TBROK | TERRNO, "LTP_RESULT_FD=%li is not open", fd);
+
+	result_fd = fd;
+}
+
+static void phase_start(struct timespec *start)
+{
+	tst_clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+static void phase_end(enum phase phase, struct timespec *start)
+{
+	struct timespec now;
+	uint64_t us;
+
+	if (!ipc || (!start->tv_sec && !start->tv_nsec))
+		return;
+
+	tst_clock_gettime(CLOCK_MONOTONIC, &now);
+	us = tst_timespec_diff_us(now, *start);
+
+#if HAVE_ATOMIC_MEMORY_MODEL == 1
+	__atomic_add_fetch(&ipc->phase_us[phase], us, __ATOMIC_SEQ_CST);
+#else
+	__sync_add_and_fetch(&ipc->phase_us[phase], us);
+#endif
+
+	start->tv_sec = 0;
+	start->tv_nsec = 0;
+}
+
 static void setup_ipc(void)
 {
 	size_t size = getpagesize();
@@ -209,6 +325,8 @@ void tst_reinit(void)
 	tst_futexes = ipc->futexes;
 	tst_max_futexes = (size - offsetof(struct ipc_region, futexes)) / sizeof(futex_t);
 
+	setup_result_stream();
+
 	if (context->tdebug)
 		tst_res(TINFO, "Restored metadata for PID %d", getpid());
 }
@@ -281,12 +399,191 @@ static void update_results(int ttype)
 	}
 }
 
+/*
+ * Each record is a single line that is written with a single write() so that
+ * records from different processes do not interleave as long as they fit into
+ * PIPE_BUF. The writer newlines and indentation are dropped here.
+ */
+struct result_record {
+	size_t used;
+	int newline;
+	char buf[PIPE_BUF];
+};
+
+static int result_record_out(struct ujson_writer *self, const char *buf,
+			     size_t buf_size)
+{
+	struct result_record *rec = self->out_priv;
+	size_t i;
+
+	for (i = 0; i < buf_size; i++) {
+		if (buf[i] == '\n') {
+			rec->newline = 1;
+			continue;
+		}
+
+		if (rec->newline && buf[i] == ' ')
+			continue;
+
+		rec->newline = 0;
+
+		/* Reserve space for the record terminating newline */
+		if (rec->used >= sizeof(rec->buf) - 1)
+			return 1;
+
+		rec->buf[rec->used++] = buf[i];
+	}
+
+	return 0;
+}
+
+static void result_record_start(ujson_writer *writer, const char *type)
+{
+	struct timespec ts;
+
+	/* Failures are reported by dropping the record */
+	writer->err_print = NULL;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	ujson_obj_start(writer, NULL);
+
+	if (ipc)
+		ujson_int_add(writer, "seq", tst_atomic_inc(&ipc->result_seq));
+
+	ujson_int_add(writer, "time_sec", ts.tv_sec);
+	ujson_int_add(writer, "time_nsec", ts.tv_nsec);
+	ujson_int_add(writer, "pid", getpid());
+	ujson_str_add(writer, "type", type);
+}
+
+static void result_record_finish(ujson_writer *writer)
+{
+	struct result_record *rec = writer->out_priv;
+	char *buf = rec->buf;
+	int ret;
+
+	ujson_obj_finish(writer);
+
+	if (ujson_writer_err(writer))
+		return;
+
+	rec->buf[rec->used++] = '\n';
+
+	while (rec->used) {
+		ret = write(result_fd, buf, rec->used);
+		if (ret <= 0)
+			break;
+
+		buf += ret;
+		rec->used -= ret;
+	}
+}
+
+static void write_result_record(const char *file, const int lineno,
+				const char *res, const char *fmt, va_list va,
+				const char *str_errno, int int_errno)
+{
+	struct result_record rec = {};
+	ujson_writer writer = UJSON_WRITER_INIT(result_record_out, &rec);
+	char msg[1024];
+
+	vsnprintf(msg, sizeof(msg), fmt, va);
+
+	result_record_start(&writer, res);
+	ujson_str_add(&writer, "file", file);
+	ujson_int_add(&writer, "line", lineno);
+	ujson_str_add(&writer, "msg", msg);
+
+	if (str_errno) {
+		ujson_int_add(&writer, "errno", int_errno);
+		ujson_str_add(&writer, "errno_name", str_errno);
+	}
+
+	if (tst_test && tst_test->test_variants)
+		ujson_int_add(&writer, "variant", tst_variant);
+
+	if (tdev.fs_type)
+		ujson_str_add(&writer, "fs_type", tdev.fs_type);
+
+	result_record_finish(&writer);
+}
+
+void tst_result_hist(const char *name, const char *unit, double min, double max,
+		     const unsigned int *buckets, unsigned int buckets_cnt,
+		     unsigned int below, unsigned int above)
+{
+	struct result_record rec = {};
+	ujson_writer writer = UJSON_WRITER_INIT(result_record_out, &rec);
+	unsigned int i;
+
+	if (result_fd < 0)
+		return;
+
+	result_record_start(&writer, "HIST");
+	ujson_str_add(&writer, "name", name);
+	ujson_str_add(&writer, "unit", unit);
+	ujson_float_add(&writer, "min", min);
+	ujson_float_add(&writer, "max", max);
+	ujson_int_add(&writer, "below", below);
+	ujson_int_add(&writer, "above", above);
+	ujson_arr_start(&writer, "buckets");
+
+	for (i = 0; i < buckets_cnt; i++)
+		ujson_int_add(&writer, NULL, buckets[i]);
+
+	ujson_arr_finish(&writer);
+	result_record_finish(&writer);
+}
+
+static void report_phase_times(void)
+{
+	const char *env = getenv("LTP_PHASE_TIMES");
+	unsigned int i;
+	uint64_t us;
+
+	if (!ipc)
+		return;
+
+	if (result_fd >= 0) {
+		struct result_record rec = {};
+		ujson_writer writer = UJSON_WRITER_INIT(result_record_out, &rec);
+
+		result_record_start(&writer, "PHASES");
+		ujson_obj_start(&writer, "phase_us");
+
+		for (i = 0; i < PHASE_CNT; i++)
+			ujson_int_add(&writer, phase_names[i], ipc->phase_us[i]);
+
+		ujson_obj_finish(&writer);
+		result_record_finish(&writer);
+	}
+
+	if (!env || (strcmp(env, "1") && strcmp(env, "y")))
+		return;
+
+	fprintf(stderr, "\nPhase times:\n");
+
+	for (i = 0; i < PHASE_CNT; i++) {
+		us = ipc->phase_us[i];
+
+		if (!us && i != PHASE_SETUP && i != PHASE_TESTRUN &&
+		    i != PHASE_CLEANUP)
+			continue;
+
+		fprintf(stderr, "%*s%-*s %llu.%06llus\n", phase_sub[i], "",
+			14 - phase_sub[i], phase_names[i],
+			(unsigned long long)us / 1000000,
+			(unsigned long long)us % 1000000);
+	}
+}
+
 static void print_result(const char *file, const int lineno, int ttype,
 			 const char *fmt, va_list va)
 {
 	char buf[1024];
 	char *str = buf;
-	int ret, size = sizeof(buf), ssize, int_errno, buflen;
+	int ret, size = sizeof(buf), ssize, int_errno = 0, buflen;
 	const char *str_errno = NULL;
 	const char *res;
 
@@ -332,6 +629,21 @@ static void print_result(const char *file, const int lineno, int ttype,
 		str_errno = tst_strerrno(int_errno);
 	}
 
+	if (result_fd >= 0) {
+		va_list va_rec;
+
+		va_copy(va_rec, va);
+		write_result_record(file, lineno, res, fmt, va_rec,
+				    str_errno, int_errno);
+		va_end(va_rec);
+	}
+
+	if (output_prefix) {
+		ret = snprintf(str, size, "[%s] ", output_prefix);
+		str += ret;
+		size -= ret;
+	}
+
 	ret = snprintf(str, size, "%s:%i: ", file, lineno);
 	str += ret;
 	size -= ret;
@@ -406,8 +718,19 @@ static void tst_cvres(const char *file, const int lineno, int ttype,
 	update_results(TTYPE_RESULT(ttype));
 }
 
+/*
+ * Started once the test setup is finished, the test run ends either in
+ * testrun() or in tst_brk() called from the test function.
+ */
+static struct timespec test_run_start;
+
 static void do_test_cleanup(void)
 {
+	struct timespec start;
+
+	phase_end(PHASE_TEST_RUN, &test_run_start);
+	phase_start(&start);
+
 	tst_brk_handler = tst_cvres;
 
 	if (tst_test->cleanup)
@@ -416,6 +739,8 @@ static void do_test_cleanup(void)
 	tst_free_all();
 
 	tst_brk_handler = tst_vbrk_;
+
+	phase_end(PHASE_TEST_CLEANUP, &start);
 }
 
 void tst_vbrk_(const char *file, const int lineno, int ttype, const char *fmt,
@@ -658,9 +983,16 @@ static void print_help(void)
 	fprintf(stderr, "LTP_COLORIZE_OUTPUT      Force colorized output behaviour (y/1 always, n/0: never)\n");
 	fprintf(stderr, "LTP_DEV                  Path to the block device to be used (for .needs_device)\n");
 	fprintf(stderr, "LTP_DEV_FS_TYPE          Filesystem used for testing (default: %s)\n", DEFAULT_FS_TYPE);
+	fprintf(stderr, "LTP_FZSYNC_CLOCK         Fuzzy sync clock (monotonic|cycles, default: monotonic)\n");
+	fprintf(stderr, "LTP_KCONFIG_CACHE_DIR    Directory to cache parsed kernel config in (default: TMPDIR)\n");
+	fprintf(stderr, "LTP_MKFS_CACHE_DIR       Directory to cache formatted filesystem images in\n");
+	fprintf(stderr, "LTP_PHASE_TIMES          Values 1 or y print time spent in the library and test phases at exit\n");
 	fprintf(stderr, "LTP_REPRODUCIBLE_OUTPUT  Values 1 or y discard the actual content of the messages printed by the test\n");
+	fprintf(stderr, "LTP_RESULT_FD            File descriptor to write machine readable result records to\n");
+	fprintf(stderr, "LTP_RESULT_FORMAT        Format of the result records (default: json)\n");
 	fprintf(stderr, "LTP_SINGLE_FS_TYPE       Specifies filesystem instead all supported (for .all_filesystems)\n");
 	fprintf(stderr, "LTP_FORCE_SINGLE_FS_TYPE Testing only. The same as LTP_SINGLE_FS_TYPE but ignores test skiplist.\n");
+	fprintf(stderr, "LTP_FS_JOBS              Number of filesystems tested in parallel (for .all_filesystems, default: 1)\n");
 	fprintf(stderr, "LTP_TIMEOUT_MUL          Timeout multiplier (must be a number >=1)\n");
 	fprintf(stderr, "LTP_RUNTIME_MUL          Runtime multiplier (must be a number >=1)\n");
 	fprintf(stderr, "LTP_VIRT_OVERRIDE        Overrides virtual machine detection (values: \"\"|kvm|microsoft|xen|zvm)\n");
@@ -1002,6 +1334,9 @@ static void print_failure_hints(void)
  */
 static void do_exit(int ret)
 {
+	if (fs_runner)
+		fs_runner_exit(ret);
+
 	if (results) {
 		if (results->passed && ret == TCONF)
 			ret = 0;
@@ -1112,7 +1447,6 @@ static const char *get_tcid(char *argv[])
 	return argv[0];
 }
 
-static struct tst_device tdev;
 struct tst_device *tst_device;
 
 static void assert_test_fn(void)
@@ -1253,13 +1587,20 @@ static void prepare_device(struct tst_fs *fs)
 	fs = fs ?: &dummy;
 
 	const char *const extra[] = {fs->mkfs_size_opt, NULL};
+	struct timespec start;
 
-	if (tst_test->format_device)
+	if (tst_test->format_device) {
+		phase_start(&start);
 		SAFE_MKFS(tdev.dev, tdev.fs_type, fs->mkfs_opts, extra);
+		phase_end(PHASE_MKFS, &start);
+	}
+
+	phase_start(&start);
 
 	if (tst_test->needs_rofs) {
 		prepare_and_mount_ro_fs(tdev.dev, tst_test->mntpoint,
 					tdev.fs_type);
+		phase_end(PHASE_MOUNT, &start);
 		return;
 	}
 
@@ -1270,6 +1611,7 @@ static void prepare_device(struct tst_fs *fs)
 		SAFE_MOUNT(get_device_name(tdev.fs_type), tst_test->mntpoint,
 				tdev.fs_type, fs->mnt_flags, mnt_data);
 		context->mntpoint_mounted = 1;
+		phase_end(PHASE_MOUNT, &start);
 	}
 }
 
@@ -1347,6 +1689,9 @@ static void do_setup(int argc, char *argv[])
 {
 	char *tdebug_env = getenv("LTP_ENABLE_DEBUG");
 	char *reproducible_env = getenv("LTP_REPRODUCIBLE_OUTPUT");
+	struct timespec setup_start, start;
+
+	phase_start(&setup_start);
 
 	if (!tst_test)
 		tst_brk(TBROK, "No tests to run");
@@ -1377,6 +1722,8 @@ static void do_setup(int argc, char *argv[])
 	    (!strcmp(reproducible_env, "1") || !strcmp(reproducible_env, "y")))
 		reproducible_output = 1;
 
+	setup_result_stream();
+
 	assert_test_fn();
 
 	TCID = tcid = get_tcid(argv);
@@ -1390,8 +1737,14 @@ static void do_setup(int argc, char *argv[])
 		context->tdebug = 1;
 	}
 
-	if (tst_test->needs_kconfigs && tst_kconfig_check(tst_test->needs_kconfigs))
-		tst_brk(TCONF, "Aborting due to unsuitable kernel config, see above!");
+	if (tst_test->needs_kconfigs) {
+		phase_start(&start);
+
+		if (tst_kconfig_check(tst_test->needs_kconfigs))
+			tst_brk(TCONF, "Aborting due to unsuitable kernel config, see above!");
+
+		phase_end(PHASE_KCONFIG, &start);
+	}
 
 	if (tst_test->needs_root && geteuid() != 0)
 		tst_brk(TCONF, "Test needs to be run as root");
@@ -1446,8 +1799,11 @@ static void do_setup(int argc, char *argv[])
 	if (tst_test->min_swap_avail > (unsigned long)(tst_available_swap() / 1024))
 		tst_brk(TCONF, "Test needs at least %luMB SwapFree", tst_test->min_swap_avail);
 
-	if (tst_test->hugepages.number)
+	if (tst_test->hugepages.number) {
+		phase_start(&start);
 		tst_reserve_hugepages(&tst_test->hugepages);
+		phase_end(PHASE_HUGEPAGES, &start);
+	}
 
 	if (tst_test->bufs)
 		tst_buffers_alloc(tst_test->bufs);
@@ -1508,11 +1864,14 @@ static void do_setup(int argc, char *argv[])
 		prepare_and_mount_hugetlb_fs();
 
 	if (tst_test->needs_device && !context->mntpoint_mounted) {
+		phase_start(&start);
 		tdev.dev = tst_acquire_device_(NULL, tst_test->dev_min_size);
 
 		if (!tdev.dev)
 			tst_brk(TCONF, "Failed to acquire device");
 
+		phase_end(PHASE_DEVICE, &start);
+
 		tdev.size = tst_get_device_size(tdev.dev);
 
 		tst_device = &tdev;
@@ -1550,10 +1909,15 @@ static void do_setup(int argc, char *argv[])
 	if (tst_test->taint_check)
 		tst_taint_init(tst_test->taint_check);
 
-	if (tst_test->needs_cgroup_ctrls)
+	if (tst_test->needs_cgroup_ctrls) {
+		phase_start(&start);
 		do_cgroup_requires();
-	else if (tst_test->needs_cgroup_ver)
+		phase_end(PHASE_CGROUP, &start);
+	} else if (tst_test->needs_cgroup_ver) {
 		tst_brk(TBROK, "tst_test->needs_cgroup_ctrls must be set");
+	}
+
+	phase_end(PHASE_SETUP, &setup_start);
 }
 
 static void do_test_setup(void)
@@ -1587,6 +1951,10 @@ static void do_test_setup(void)
 
 static void do_cleanup(void)
 {
+	struct timespec start;
+
+	phase_start(&start);
+
 	if (tst_test->needs_cgroup_ctrls)
 		tst_cg_cleanup();
 
@@ -1610,6 +1978,9 @@ static void do_cleanup(void)
 	if (tst_test->restore_wallclock)
 		tst_wallclock_restore();
 
+	phase_end(PHASE_CLEANUP, &start);
+	report_phase_times();
+
 	cleanup_ipc();
 }
 
@@ -1699,10 +2070,16 @@ static void testrun(void)
 	unsigned int i = 0;
 	unsigned long long stop_time = 0;
 	int cont = 1;
+	struct timespec start;
 
 	heartbeat();
 	add_paths();
+
+	phase_start(&start);
 	do_test_setup();
+	phase_end(PHASE_TEST_SETUP, &start);
+
+	phase_start(&test_run_start);
 
 	if (duration > 0)
 		stop_time = get_time_ms() + (unsigned long long)(duration * 1000);
@@ -1841,6 +2218,7 @@ void tst_set_runtime(int runtime)
 
 static int fork_testrun(void)
 {
+	struct timespec start;
 	int status;
 
 	SAFE_SIGNAL(SIGINT, sigint_handler);
@@ -1850,6 +2228,8 @@ static int fork_testrun(void)
 
 	show_failure_hints = 1;
 
+	phase_start(&start);
+
 	test_pid = fork();
 	if (test_pid < 0)
 		tst_brk(TBROK | TERRNO, "fork()");
@@ -1865,6 +2245,7 @@ static int fork_testrun(void)
 	}
 
 	SAFE_WAITPID(test_pid, &status, 0);
+	phase_end(PHASE_TESTRUN, &start);
 	alarm(0);
 	SAFE_SIGNAL(SIGTERM, SIG_DFL);
 	SAFE_SIGNAL(SIGINT, SIG_DFL);
@@ -1947,16 +2328,262 @@ static int run_tcase_on_fs(struct tst_fs *fs, const char *fs_type)
 	return ret;
 }
 
+struct fs_runner {
+	pid_t pid;
+	const char *fs_type;
+	char dev[PATH_MAX];
+};
+
+static struct fs_runner *fs_runners;
+static volatile unsigned int fs_runners_cnt;
+
+static unsigned int get_fs_jobs(void)
+{
+	static int fs_jobs;
+	const char *jobs_env;
+
+	if (fs_jobs)
+		return fs_jobs;
+
+	fs_jobs = 1;
+	jobs_env = getenv("LTP_FS_JOBS");
+
+	if (jobs_env && tst_parse_int(jobs_env, &fs_jobs, 1, INT_MAX)) {
+		tst_brk(TBROK, "Failed to parse LTP_FS_JOBS='%s'", jobs_env);
+	}
+
+	if (fs_jobs == 1)
+		return fs_jobs;
+
+	/*
+	 * Checkpoints and re-initialized children use the single shared IPC
+	 * region which cannot be split between concurrent test runs and a
+	 * user supplied device cannot be formatted concurrently either.
+	 */
+	if (tst_test->needs_checkpoints || tst_test->child_needs_reinit) {
+		tst_res(TINFO, "Test uses shared IPC, ignoring LTP_FS_JOBS");
+		fs_jobs = 1;
+	} else if (getenv("LTP_DEV")) {
+		tst_res(TINFO, "LTP_DEV is set, ignoring LTP_FS_JOBS");
+		fs_jobs = 1;
+	}
+
+	return fs_jobs;
+}
+
+static void fs_runner_exit(int ret)
+{
+	if (context->mntpoint_mounted) {
+		tst_umount(tst_test->mntpoint);
+		context->mntpoint_mounted = 0;
+	}
+
+	/* Propagate test abort to the library process */
+	if (context->abort_flag || ret == TBROK)
+		tst_atomic_inc(&ipc->context.abort_flag);
+
+	exit(ret);
+}
+
+static void run_fs_runner(struct tst_fs *fs, struct fs_runner *runner)
+{
+	struct context *fs_context;
+
+	/* The parent handler would forward signals to our stale sibling list */
+	SAFE_SIGNAL(SIGINT, SIG_DFL);
+	SAFE_SIGNAL(SIGTERM, SIG_DFL);
+
+	/*
+	 * Each runner has a private copy of the context shared only with its
+	 * test process, so that the main_pid, timeout heartbeat and mount state
+	 * do not clash between runners. Results are still counted in the IPC
+	 * region shared by all of them.
+	 */
+	fs_context = SAFE_MMAP(NULL, sizeof(*fs_context), PROT_READ | PROT_WRITE,
+			       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	*fs_context = *context;
+	context = fs_context;
+	context->lib_pid = getpid();
+	context->main_pid = 0;
+
+	fs_runner = 1;
+	output_prefix = runner->fs_type;
+
+	SAFE_CHDIR(runner->fs_type);
+
+	if (access(tst_test->mntpoint, F_OK))
+		SAFE_MKDIR(tst_test->mntpoint, 0777);
+
+	if (tst_test->resource_files)
+		copy_resources();
+
+	tdev.dev = runner->dev;
+	tdev.size = tst_get_device_size(tdev.dev);
+
+	fs_runner_exit(run_tcase_on_fs(fs, runner->fs_type));
+}
+
+static void start_fs_runner(struct tst_fs *fs, const char *fs_type)
+{
+	struct fs_runner *runner = &fs_runners[fs_runners_cnt];
+	char img_path[PATH_MAX];
+	struct timespec start;
+	const char *dev;
+
+	/* Directories are reused by subsequent test variants */
+	if (access(fs_type, F_OK))
+		SAFE_MKDIR(fs_type, 0777);
+
+	snprintf(img_path, sizeof(img_path), "%s/test_dev.img", fs_type);
+
+	/* Loop devices are acquired serially to avoid races on free devices */
+	phase_start(&start);
+	dev = tst_acquire_loop_device(tst_test->dev_min_size, img_path);
+	if (!dev)
+		tst_brk(TBROK, "Failed to acquire device for %s", fs_type);
+
+	phase_end(PHASE_DEVICE, &start);
+
+	strncpy(runner->dev, dev, sizeof(runner->dev) - 1);
+	runner->dev[sizeof(runner->dev) - 1] = 0;
+	runner->fs_type = fs_type;
+
+	tst_flush();
+
+	runner->pid = fork();
+	if (runner->pid < 0)
+		tst_brk(TBROK | TERRNO, "fork()");
+
+	if (!runner->pid)
+		run_fs_runner(fs, runner);
+
+	fs_runners_cnt++;
+}
+
+static void reap_fs_runner(void)
+{
+	unsigned int i;
+	int status;
+	pid_t pid;
+
+	pid = SAFE_WAITPID(-1, &status, 0);
+
+	for (i = 0; i < fs_runners_cnt; i++) {
+		if (fs_runners[i].pid == pid)
+			break;
+	}
+
+	if (i >= fs_runners_cnt)
+		tst_brk(TBROK, "Reaped unknown child %i", pid);
+
+	if (WIFSIGNALED(status)) {
+		tst_res(TWARN, "Runner for %s killed by %s",
+			fs_runners[i].fs_type, tst_strsig(WTERMSIG(status)));
+	} else if (WIFEXITED(status)) {
+		switch (WEXITSTATUS(status)) {
+		case 0:
+		case TFAIL:
+		case TBROK:
+		case TCONF:
+			break;
+		default:
+			tst_res(TWARN, "Runner for %s exited with %i",
+				fs_runners[i].fs_type, WEXITSTATUS(status));
+		}
+	}
+
+	tst_detach_device(fs_runners[i].dev);
+
+	fs_runners[i] = fs_runners[--fs_runners_cnt];
+}
+
+static void fs_runners_sigint_handler(int sig)
+{
+	unsigned int i;
+
+	for (i = 0; i < fs_runners_cnt; i++)
+		kill(fs_runners[i].pid, sig);
+}
+
+static bool run_tcases_per_fs_parallel(const char *const *filesystems,
+				       unsigned int jobs)
+{
+	struct fs_runner *runners;
+	bool found_valid_fs = false;
+	unsigned int i;
+
+	/* More runners than filesystems would never be used */
+	for (i = 0; filesystems[i]; i++)
+		;
+
+	jobs = MIN(jobs, i);
+	runners = SAFE_MALLOC(jobs * sizeof(*runners));
+
+	tst_res(TINFO, "Running up to %u filesystems in parallel", jobs);
+
+	/* Each runner acquires its own device */
+	if (tdev.dev) {
+		tst_release_device(tdev.dev);
+		tdev.dev = NULL;
+	}
+
+	fs_runners = runners;
+	show_failure_hints = 1;
+
+	SAFE_SIGNAL(SIGINT, fs_runners_sigint_handler);
+	SAFE_SIGNAL(SIGTERM, fs_runners_sigint_handler);
+
+	for (i = 0; filesystems[i]; i++) {
+		struct tst_fs *fs = lookup_fs_desc(filesystems[i], tst_test->all_filesystems);
+
+		if (!fs)
+			continue;
+
+		found_valid_fs = true;
+
+		if (fs_runners_cnt >= jobs)
+			reap_fs_runner();
+
+		if (tst_atomic_load(&context->abort_flag))
+			break;
+
+		start_fs_runner(fs, filesystems[i]);
+	}
+
+	while (fs_runners_cnt)
+		reap_fs_runner();
+
+	SAFE_SIGNAL(SIGTERM, SIG_DFL);
+	SAFE_SIGNAL(SIGINT, SIG_DFL);
+
+	fs_runners = NULL;
+	free(runners);
+
+	if (tst_atomic_load(&context->abort_flag))
+		do_exit(0);
+
+	return found_valid_fs;
+}
+
 static int run_tcases_per_fs(void)
 {
 	int ret = 0;
-	unsigned int i;
+	unsigned int i, jobs;
 	bool found_valid_fs = false;
 	const char *const *filesystems = tst_get_supported_fs_types(tst_test->skip_filesystems);
 
 	if (!filesystems[0])
 		tst_brk(TCONF, "There are no supported filesystems");
 
+	jobs = get_fs_jobs();
+
+	if (jobs > 1) {
+		if (!run_tcases_per_fs_parallel(filesystems, jobs))
+			tst_brk(TCONF, "No required filesystems are available");
+
+		return ret;
+	}
+
 	for (i = 0; filesystems[i]; i++) {
 		struct tst_fs *fs = lookup_fs_desc(filesystems[i], tst_test->all_filesystems);
 
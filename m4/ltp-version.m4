@@ -0,0 +1 @@
+20250530])
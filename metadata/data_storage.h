@@ -29,13 +29,23 @@ struct data_node_array {
 struct data_hash_elem {
 	struct data_node *node;
 	char *id;
+	unsigned int hash;
 };
 
+/*
+ * The elements are stored in an array in the order they were inserted, which
+ * is the order they are printed in. The slots are an open addressing index
+ * into the elements array, the value is the element index + 1 and zero marks
+ * an empty slot. The slots array is always at least twice as big as the
+ * elements array so there is always an empty slot.
+ */
 struct data_node_hash {
 	enum data_type type;
 	unsigned int elems_len;
 	unsigned int elems_used;
-	struct data_hash_elem elems[];
+	unsigned int slots_mask;
+	unsigned int *slots;
+	struct data_hash_elem *elems;
 };
 
 struct data_node_string {
@@ -79,7 +89,13 @@ static inline const char* data_type_name(enum data_type type)
 static inline struct data_node *data_node_string(const char *string)
 {
 	size_t size = sizeof(struct data_node_string) + strlen(string) + 1;
-	struct data_node *node = malloc(size);
+	struct data_node *node;
+
+	/* The node is accessed through the union, allocate at least its size */
+	if (size < sizeof(struct data_node))
+		size = sizeof(struct data_node);
+
+	node = malloc(size);
 
 	if (!node)
 		return NULL;
@@ -92,7 +108,7 @@ static inline struct data_node *data_node_string(const char *string)
 
 static inline struct data_node *data_node_int(long i)
 {
-	struct data_node *node = malloc(sizeof(struct data_node_int));
+	struct data_node *node = malloc(sizeof(struct data_node));
 
 	if (!node)
 		return NULL;
@@ -116,19 +132,28 @@ static inline struct data_node *data_node_null(void)
 }
 
 #define MAX_ELEMS 100
+#define HASH_INIT_ELEMS 8
 
 static inline struct data_node *data_node_hash(void)
 {
-	size_t size = sizeof(struct data_node_hash)
-	              + MAX_ELEMS * sizeof(struct data_hash_elem);
-	struct data_node *node = malloc(size);
+	struct data_node *node = malloc(sizeof(struct data_node_hash));
 
 	if (!node)
 		return NULL;
 
 	node->type = DATA_HASH;
-	node->hash.elems_len = MAX_ELEMS;
+	node->hash.elems_len = HASH_INIT_ELEMS;
 	node->hash.elems_used = 0;
+	node->hash.slots_mask = 2 * HASH_INIT_ELEMS - 1;
+	node->hash.elems = malloc(HASH_INIT_ELEMS * sizeof(struct data_hash_elem));
+	node->hash.slots = calloc(2 * HASH_INIT_ELEMS, sizeof(unsigned int));
+
+	if (!node->hash.elems || !node->hash.slots) {
+		free(node->hash.elems);
+		free(node->hash.slots);
+		free(node);
+		return NULL;
+	}
 
 	return node;
 }
@@ -149,6 +174,77 @@ static inline struct data_node *data_node_array(void)
 	return node;
 }
 
+static inline unsigned int data_hash_id(const char *id)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*id) {
+		hash ^= (unsigned char)*(id++);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*
+ * Returns the slot that either contains the id or the empty slot that
+ * terminated the search.
+ */
+static inline unsigned int data_hash_slot(struct data_node_hash *hash,
+                                          const char *id, unsigned int id_hash)
+{
+	unsigned int pos = id_hash & hash->slots_mask;
+	struct data_hash_elem *elem;
+
+	while (hash->slots[pos]) {
+		elem = &hash->elems[hash->slots[pos] - 1];
+
+		if (elem->hash == id_hash && !strcmp(elem->id, id))
+			break;
+
+		pos = (pos + 1) & hash->slots_mask;
+	}
+
+	return pos;
+}
+
+static inline void data_hash_slot_set(struct data_node_hash *hash, unsigned int idx)
+{
+	unsigned int pos = hash->elems[idx].hash & hash->slots_mask;
+
+	while (hash->slots[pos])
+		pos = (pos + 1) & hash->slots_mask;
+
+	hash->slots[pos] = idx + 1;
+}
+
+static inline int data_hash_grow(struct data_node_hash *hash)
+{
+	unsigned int i, elems_len = 2 * hash->elems_len;
+	struct data_hash_elem *elems;
+	unsigned int *slots;
+
+	elems = realloc(hash->elems, elems_len * sizeof(struct data_hash_elem));
+	if (!elems)
+		return 1;
+
+	hash->elems = elems;
+
+	slots = calloc(2 * elems_len, sizeof(unsigned int));
+	if (!slots)
+		return 1;
+
+	free(hash->slots);
+	hash->slots = slots;
+	hash->slots_mask = 2 * elems_len - 1;
+	hash->elems_len = elems_len;
+
+	for (i = 0; i < hash->elems_used; i++)
+		data_hash_slot_set(hash, i);
+
+	return 0;
+}
+
 static inline int data_node_hash_add(struct data_node *self, const char *id, struct data_node *payload)
 {
 	if (self->type != DATA_HASH)
@@ -156,13 +252,19 @@ static inline int data_node_hash_add(struct data_node *self, const char *id, str
 
 	struct data_node_hash *hash = &self->hash;
 
-	if (hash->elems_used == hash->elems_len)
+	if (hash->elems_used == hash->elems_len && data_hash_grow(hash))
 		return 1;
 
-	struct data_hash_elem *elem = &hash->elems[hash->elems_used++];
+	struct data_hash_elem *elem = &hash->elems[hash->elems_used];
 
-	elem->node = payload;
 	elem->id = strdup(id);
+	if (!elem->id)
+		return 1;
+
+	elem->node = payload;
+	elem->hash = data_hash_id(id);
+
+	data_hash_slot_set(hash, hash->elems_used++);
 
 	return 0;
 }
@@ -181,6 +283,8 @@ static inline void data_node_free(struct data_node *self)
 			data_node_free(self->hash.elems[i].node);
 			free(self->hash.elems[i].id);
 		}
+		free(self->hash.elems);
+		free(self->hash.slots);
 	break;
 	case DATA_ARRAY:
 		for (i = 0; i < self->array.array_used; i++)
@@ -191,41 +295,75 @@ static inline void data_node_free(struct data_node *self)
 	free(self);
 }
 
-static inline int data_node_hash_del(struct data_node *self, const char *id)
+/*
+ * Removes the slot and shifts the following slots in the probe sequence back
+ * so that lookups do not stop at the hole.
+ */
+static inline void data_hash_slot_clear(struct data_node_hash *hash, unsigned int pos)
 {
-	unsigned int i;
-	struct data_node_hash *hash = &self->hash;
+	unsigned int next = pos, home;
+
+	for (;;) {
+		next = (next + 1) & hash->slots_mask;
 
-	for (i = 0; i < hash->elems_used; i++) {
-		if (!strcmp(hash->elems[i].id, id))
+		if (!hash->slots[next])
 			break;
+
+		home = hash->elems[hash->slots[next] - 1].hash & hash->slots_mask;
+
+		/* Skip slots whose home lies cyclically in (pos, next] */
+		if (pos <= next ? (pos < home && home <= next)
+		                : (pos < home || home <= next))
+			continue;
+
+		hash->slots[pos] = hash->slots[next];
+		pos = next;
 	}
 
-	if (i >= hash->elems_used)
+	hash->slots[pos] = 0;
+}
+
+static inline int data_node_hash_del(struct data_node *self, const char *id)
+{
+	unsigned int i, pos, last;
+	struct data_node_hash *hash = &self->hash;
+
+	pos = data_hash_slot(hash, id, data_hash_id(id));
+	if (!hash->slots[pos])
 		return 0;
 
+	i = hash->slots[pos] - 1;
+
 	data_node_free(hash->elems[i].node);
 	free(hash->elems[i].id);
 
-	hash->elems[i] = hash->elems[--hash->elems_used];
+	data_hash_slot_clear(hash, pos);
+
+	last = --hash->elems_used;
+	if (i == last)
+		return 1;
+
+	/* Move the last element into the hole and fix its slot */
+	pos = hash->elems[last].hash & hash->slots_mask;
+	while (hash->slots[pos] != last + 1)
+		pos = (pos + 1) & hash->slots_mask;
+
+	hash->slots[pos] = i + 1;
+	hash->elems[i] = hash->elems[last];
 
 	return 1;
 }
 
 static inline struct data_node *data_node_hash_get(struct data_node *self, const char *id)
 {
-	unsigned int i;
+	unsigned int pos;
 	struct data_node_hash *hash = &self->hash;
 
-	for (i = 0; i < hash->elems_used; i++) {
-		if (!strcmp(hash->elems[i].id, id))
-			break;
-	}
-
-	if (i >= hash->elems_used)
+	pos = data_hash_slot(hash, id, data_hash_id(id));
+	if (!hash->slots[pos])
 		return NULL;
 
-	return hash->elems[i].node;
+	return hash->elems[hash->slots[pos] - 1].node;
 }
 
 static inline int data_node_array_add(struct data_node *self, struct data_node *payload)
@@ -13,15 +13,31 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "data_storage.h"
+#include "parse_shell.h"
 
 #define INCLUDE_PATH_MAX 5
 
 static int verbose;
 static char *cmdline_includepath[INCLUDE_PATH_MAX];
 static unsigned int cmdline_includepaths;
-static char *includepath;
+
+/*
+ * Files are parsed in parallel, everything that is specific to a parsed file
+ * is thread local.
+ */
+static __thread char *includepath;
+
+/*
+ * Macros are stored in a hash table that is recreated for each parsed file so
+ * that macros defined in one test do not leak into another one.
+ */
+static __thread struct hsearch_data macros;
+static __thread char **macro_strs;
+static __thread unsigned int macro_strs_used;
+static __thread unsigned int macro_strs_len;
 
 #define WARN(str) fprintf(stderr, "WARNING: " str "\n")
 
@@ -218,26 +234,11 @@ exit:
 
 static char *next_token(FILE *f, struct data_node *doc)
 {
-	static char buf[4096];
+	static __thread char buf[4096];
 
 	return next_token2(f, buf, sizeof(buf), doc);
 }
 
-static FILE *open_file(const char *dir, const char *fname)
-{
-	FILE *f;
-	char *path;
-
-	if (asprintf(&path, "%s/%s", dir, fname) < 0)
-		return NULL;
-
-	f = fopen(path, "r");
-
-	free(path);
-
-	return f;
-}
-
 /**
  * List of includes to be skipped.
  *
@@ -252,17 +253,37 @@ static const char *skip_includes[] = {
 	NULL
 };
 
-static FILE *open_include(FILE *f)
+static char *find_file(const char *dir, const char *fname)
 {
-	char buf[256], *fname;
-	FILE *inc;
-	unsigned int i;
+	char *path;
 
-	if (!fscanf(f, "%s\n", buf))
+	if (asprintf(&path, "%s/%s", dir, fname) < 0)
 		return NULL;
 
-	if (buf[0] != '"')
-		return NULL;
+	if (!access(path, R_OK))
+		return path;
+
+	free(path);
+
+	return NULL;
+}
+
+static int read_include_name(FILE *f, char *buf)
+{
+	if (!fscanf(f, "%255s\n", buf))
+		return 1;
+
+	return buf[0] != '"';
+}
+
+/*
+ * Returns allocated path to the include file or NULL if it's not found or
+ * skipped. The buf is modified.
+ */
+static char *find_include(char *buf)
+{
+	char *fname, *path;
+	unsigned int i;
 
 	for (i = 0; skip_includes[i]; i++) {
 		if (!strcmp(skip_includes[i], buf)) {
@@ -285,29 +306,40 @@ static FILE *open_include(FILE *f)
 
 	fname[strlen(fname)-1] = 0;
 
-	inc = open_file(includepath, fname);
-	if (inc) {
-		if (verbose)
-			fprintf(stderr, "INCLUDE %s/%s\n", includepath, fname);
+	path = find_file(includepath, fname);
+	if (path)
+		return path;
 
-		return inc;
+	for (i = 0; i < cmdline_includepaths; i++) {
+		path = find_file(cmdline_includepath[i], fname);
+
+		if (path)
+			return path;
 	}
 
-	for (i = 0; i < cmdline_includepaths; i++) {
-		inc = open_file(cmdline_includepath[i], fname);
+	return NULL;
+}
 
-		if (!inc)
-			continue;
+static FILE *open_include(FILE *f)
+{
+	char buf[256], *path;
+	FILE *inc;
 
-		if (verbose) {
-			fprintf(stderr, "INCLUDE %s/%s\n",
-				cmdline_includepath[i], fname);
-		}
+	if (read_include_name(f, buf))
+		return NULL;
 
-		return inc;
-	}
+	path = find_include(buf);
+	if (!path)
+		return NULL;
 
-	return NULL;
+	inc = fopen(path, "r");
+
+	if (inc && verbose)
+		fprintf(stderr, "INCLUDE %s\n", path);
+
+	free(path);
+
+	return inc;
 }
 
 static void close_include(FILE *inc)
@@ -326,9 +358,7 @@ static void try_apply_macro(char **res)
 
 	ENTRY *ret;
 
-	ret = hsearch(macro, FIND);
-
-	if (!ret)
+	if (!hsearch_r(macro, FIND, &ret, &macros))
 		return;
 
 	if (verbose)
@@ -701,38 +731,225 @@ static void macro_get_val(FILE *f, char *buf, size_t buf_len)
 	}
 }
 
+static void macro_add(char *name, char *val)
+{
+	ENTRY e = {
+		.key = name,
+		.data = val,
+	};
+	ENTRY *ret;
+
+	if (verbose)
+		fprintf(stderr, " MACRO %s=%s\n", e.key, (char*)e.data);
+
+	hsearch_r(e, ENTER, &ret, &macros);
+}
+
+static char *macro_strdup(const char *str)
+{
+	if (macro_strs_used >= macro_strs_len) {
+		macro_strs_len = macro_strs_len ? 2 * macro_strs_len : 128;
+		macro_strs = realloc(macro_strs, macro_strs_len * sizeof(char *));
+		if (!macro_strs) {
+			fprintf(stderr, "Allocation failed :(\n");
+			exit(1);
+		}
+	}
+
+	return macro_strs[macro_strs_used++] = strdup(str);
+}
+
+/*
+ * Returns zero if macro with a value was read and should be defined.
+ */
+static int read_macro(FILE *f, char *name, char *val, size_t val_len)
+{
+	if (!fscanf(f, "%127s[^\n]", name))
+		return 1;
+
+	if (fgetc(f) == '\n')
+		return 1;
+
+	macro_get_val(f, val, val_len);
+
+	if (name[0] == '_')
+		return 1;
+
+	return 0;
+}
+
 static void parse_macro(FILE *f)
 {
 	char name[128];
 	char val[256];
 
-	if (!fscanf(f, "%s[^\n]", name))
+	if (read_macro(f, name, val, sizeof(val)))
 		return;
 
-	if (fgetc(f) == '\n')
-		return;
+	macro_add(macro_strdup(name), macro_strdup(val));
+}
+
+/*
+ * Include files are parsed only once into a list of defines and nested
+ * includes which is replayed for each test that includes the file. Nested
+ * includes are stored unresolved since the lookup depends on the directory
+ * of the test.
+ */
+enum include_event_type {
+	INCLUDE_DEFINE,
+	INCLUDE_INCLUDE,
+};
 
-	macro_get_val(f, val, sizeof(val));
+struct include_event {
+	enum include_event_type type;
+	char *name;
+	char *val;
+};
 
-	if (name[0] == '_')
-		return;
+struct include_file {
+	struct include_file *next;
+	char *path;
+	unsigned int events_used;
+	unsigned int events_len;
+	struct include_event *events;
+};
 
-	ENTRY e = {
-		.key = strdup(name),
-		.data = strdup(val),
-	};
+#define INCLUDE_CACHE_SIZE 1024
 
-	if (verbose)
-		fprintf(stderr, " MACRO %s=%s\n", e.key, (char*)e.data);
+static struct include_file *include_cache[INCLUDE_CACHE_SIZE];
+static pthread_mutex_t include_cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
-	hsearch(e, ENTER);
+static unsigned int include_cache_hash(const char *path)
+{
+	unsigned int hash = 5381;
+
+	while (*path)
+		hash = hash * 33 + (unsigned char)*(path++);
+
+	return hash % INCLUDE_CACHE_SIZE;
 }
 
-static void parse_include_macros(FILE *f, int level)
+static void include_event_add(struct include_file *inc,
+			      enum include_event_type type,
+			      const char *name, const char *val)
 {
-	FILE *inc;
+	struct include_event *ev;
+
+	if (inc->events_used >= inc->events_len) {
+		inc->events_len = inc->events_len ? 2 * inc->events_len : 16;
+		inc->events = realloc(inc->events,
+				      inc->events_len * sizeof(*inc->events));
+		if (!inc->events) {
+			fprintf(stderr, "Allocation failed :(\n");
+			exit(1);
+		}
+	}
+
+	ev = &inc->events[inc->events_used++];
+	ev->type = type;
+	ev->name = strdup(name);
+	ev->val = val ? strdup(val) : NULL;
+}
+
+static struct include_file *include_file_parse(const char *path)
+{
+	struct include_file *inc;
+	char name[256], val[256];
 	const char *token;
 	int hash = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return NULL;
+
+	inc = calloc(1, sizeof(*inc));
+	if (!inc) {
+		fprintf(stderr, "Allocation failed :(\n");
+		exit(1);
+	}
+
+	inc->path = strdup(path);
+
+	while ((token = next_token(f, NULL))) {
+		if (token[0] == '#') {
+			hash = 1;
+			continue;
+		}
+
+		if (!hash)
+			continue;
+
+		if (!strcmp(token, "define")) {
+			if (!read_macro(f, name, val, sizeof(val)))
+				include_event_add(inc, INCLUDE_DEFINE, name, val);
+		} else if (!strcmp(token, "include")) {
+			if (!read_include_name(f, name))
+				include_event_add(inc, INCLUDE_INCLUDE, name, NULL);
+		}
+
+		hash = 0;
+	}
+
+	fclose(f);
+
+	return inc;
+}
+
+static struct include_file *include_file_get(const char *path)
+{
+	unsigned int hash = include_cache_hash(path);
+	struct include_file *inc, *new_inc;
+
+	pthread_mutex_lock(&include_cache_lock);
+	for (inc = include_cache[hash]; inc; inc = inc->next) {
+		if (!strcmp(inc->path, path))
+			break;
+	}
+	pthread_mutex_unlock(&include_cache_lock);
+
+	if (inc)
+		return inc;
+
+	new_inc = include_file_parse(path);
+	if (!new_inc)
+		return NULL;
+
+	pthread_mutex_lock(&include_cache_lock);
+	for (inc = include_cache[hash]; inc; inc = inc->next) {
+		if (!strcmp(inc->path, path))
+			break;
+	}
+
+	/* Another thread may have parsed the file in the meantime */
+	if (!inc) {
+		new_inc->next = include_cache[hash];
+		include_cache[hash] = new_inc;
+		inc = new_inc;
+		new_inc = NULL;
+	}
+	pthread_mutex_unlock(&include_cache_lock);
+
+	if (new_inc) {
+		while (new_inc->events_used--) {
+			free(new_inc->events[new_inc->events_used].name);
+			free(new_inc->events[new_inc->events_used].val);
+		}
+		free(new_inc->events);
+		free(new_inc->path);
+		free(new_inc);
+	}
+
+	return inc;
+}
+
+static void replay_include(char *name, int level)
+{
+	struct include_file *inc;
+	struct include_event *ev;
+	char buf[256];
+	unsigned int i;
+	char *path;
 
 	/**
 	 * Allow only three levels of include indirection.
@@ -742,28 +959,45 @@ static void parse_include_macros(FILE *f, int level)
 	if (level >= 3)
 		return;
 
-	inc = open_include(f);
-	if (!inc)
+	strcpy(buf, name);
+
+	path = find_include(buf);
+	if (!path)
 		return;
 
-	while ((token = next_token(inc, NULL))) {
-		if (token[0] == '#') {
-			hash = 1;
-			continue;
-		}
+	inc = include_file_get(path);
+	free(path);
 
-		if (!hash)
-			continue;
+	if (!inc)
+		return;
 
-		if (!strcmp(token, "define"))
-			parse_macro(inc);
-		else if (!strcmp(token, "include"))
-			parse_include_macros(inc, level+1);
+	if (verbose)
+		fprintf(stderr, "INCLUDE %s\n", inc->path);
 
-		hash = 0;
+	for (i = 0; i < inc->events_used; i++) {
+		ev = &inc->events[i];
+
+		if (ev->type == INCLUDE_DEFINE)
+			macro_add(ev->name, ev->val);
+		else
+			replay_include(ev->name, level+1);
 	}
 
-	close_include(inc);
+	if (verbose)
+		fprintf(stderr, "INCLUDE END\n");
+}
+
+static void parse_include_macros(FILE *f, int level)
+{
+	char buf[256];
+
+	if (level >= 3)
+		return;
+
+	if (read_include_name(f, buf))
+		return;
+
+	replay_include(buf, level);
 }
 
 /* pre-defined macros that makes the output cleaner. */
@@ -795,20 +1029,31 @@ static void load_internal_macros(void)
 	if (verbose)
 		fprintf(stderr, "PREDEFINED MACROS\n");
 
-	for (i = 0; internal_macros[i].from; i++) {
-		ENTRY e = {
-			.key = internal_macros[i].from,
-			.data = internal_macros[i].to,
-		};
+	for (i = 0; internal_macros[i].from; i++)
+		macro_add(internal_macros[i].from, internal_macros[i].to);
 
-		if (verbose)
-			fprintf(stderr, " MACRO %s=%s\n", e.key, (char*)e.data);
+	if (verbose)
+		fprintf(stderr, "END PREDEFINED MACROS\n");
+}
 
-		hsearch(e, ENTER);
+static void macros_init(void)
+{
+	memset(&macros, 0, sizeof(macros));
+
+	if (!hcreate_r(128, &macros)) {
+		fprintf(stderr, "Failed to initialize hash table\n");
+		exit(1);
 	}
 
-	if (verbose)
-		fprintf(stderr, "END PREDEFINED MACROS\n");
+	load_internal_macros();
+}
+
+static void macros_destroy(void)
+{
+	hdestroy_r(&macros);
+
+	while (macro_strs_used)
+		free(macro_strs[--macro_strs_used]);
 }
 
 static struct data_node *parse_file(const char *fname)
@@ -822,13 +1067,14 @@ static struct data_node *parse_file(const char *fname)
 	}
 
 	FILE *f = fopen(fname, "r");
+	char *fname_copy = strdup(fname);
 
-	includepath = dirname(strdup(fname));
+	includepath = dirname(fname_copy);
 
 	struct data_node *res = data_node_hash();
 	struct data_node *doc = data_node_array();
 
-	load_internal_macros();
+	macros_init();
 
 	while ((token = next_token(f, doc))) {
 		if (state < 6 && !strcmp(tokens[state], token)) {
@@ -864,6 +1110,10 @@ static struct data_node *parse_file(const char *fname)
 
 	fclose(f);
 
+	macros_destroy();
+	free(fname_copy);
+	includepath = NULL;
+
 	if (!found) {
 		data_node_free(res);
 		return NULL;
@@ -965,22 +1215,200 @@ const char *strip_name(char *path)
 	return name;
 }
 
+/*
+ * Parses a single file and returns the JSON entry or NULL if there is no
+ * metadata in the file. Shell tests are passed to the shell parser.
+ */
+static char *process_file(const char *fname)
+{
+	unsigned int i, j;
+	struct data_node *res;
+	char *path, *buf = NULL;
+	size_t len = strlen(fname), buf_len;
+	FILE *out;
+
+	out = open_memstream(&buf, &buf_len);
+	if (!out) {
+		fprintf(stderr, "open_memstream() failed: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	path = strdup(fname);
+
+	if (len > 3 && !strcmp(fname + len - 3, ".sh")) {
+		parse_shell(out, path);
+		goto done;
+	}
+
+	res = parse_file(fname);
+	if (!res)
+		goto done;
+
+	/* Filter out useless data */
+	for (i = 0; filter_out[i]; i++)
+		data_node_hash_del(res, filter_out[i]);
+
+	/* Normalize the result */
+	for (i = 0; implies[i].flag; i++) {
+		if (data_node_hash_get(res, implies[i].flag)) {
+			for (j = 0; implies[i].implies[j]; j++) {
+				if (data_node_hash_get(res, implies[i].implies[j]))
+					fprintf(stderr, "%s: useless tag: %s\n",
+						fname, implies[i].implies[j]);
+			}
+		}
+	}
+
+	/* Normalize types */
+	check_normalize_types(res);
+
+	for (i = 0; implies[i].flag; i++) {
+		if (data_node_hash_get(res, implies[i].flag)) {
+			for (j = 0; implies[i].implies[j]; j++) {
+				if (!data_node_hash_get(res, implies[i].implies[j]))
+					data_node_hash_add(res, implies[i].implies[j],
+							   data_node_string("1"));
+			}
+		}
+	}
+
+	data_node_hash_add(res, "fname", data_node_string(fname));
+	fprintf(out, "  \"%s\": ", strip_name(path));
+	data_to_json(res, out, 2);
+	data_node_free(res);
+
+done:
+	free(path);
+	fclose(out);
+
+	if (!buf_len) {
+		free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+struct batch {
+	char **files;
+	char **results;
+	unsigned int files_cnt;
+	unsigned int next;
+};
+
+static void *batch_worker(void *arg)
+{
+	struct batch *batch = arg;
+	unsigned int i;
+
+	for (;;) {
+		i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+		if (i >= batch->files_cnt)
+			return NULL;
+
+		batch->results[i] = process_file(batch->files[i]);
+	}
+}
+
+static void run_batch(struct batch *batch, unsigned int jobs)
+{
+	pthread_t *threads;
+	unsigned int i;
+
+	if (jobs > batch->files_cnt)
+		jobs = batch->files_cnt;
+
+	if (jobs <= 1) {
+		batch_worker(batch);
+		return;
+	}
+
+	threads = malloc(jobs * sizeof(*threads));
+	if (!threads) {
+		fprintf(stderr, "Allocation failed :(\n");
+		exit(1);
+	}
+
+	for (i = 0; i < jobs; i++) {
+		if (pthread_create(&threads[i], NULL, batch_worker, batch)) {
+			fprintf(stderr, "pthread_create() failed\n");
+			exit(1);
+		}
+	}
+
+	for (i = 0; i < jobs; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+}
+
+static void read_file_list(struct batch *batch)
+{
+	unsigned int files_len = 0;
+	char *line = NULL;
+	size_t line_len = 0;
+	ssize_t ret;
+
+	while ((ret = getline(&line, &line_len, stdin)) > 0) {
+		if (line[ret-1] == '\n')
+			line[--ret] = 0;
+
+		if (!ret)
+			continue;
+
+		if (batch->files_cnt >= files_len) {
+			files_len = files_len ? 2 * files_len : 1024;
+			batch->files = realloc(batch->files,
+					       files_len * sizeof(char *));
+			if (!batch->files) {
+				fprintf(stderr, "Allocation failed :(\n");
+				exit(1);
+			}
+		}
+
+		batch->files[batch->files_cnt++] = strdup(line);
+	}
+
+	free(line);
+}
+
+static void print_testsuite_header(const char *version)
+{
+	printf("{\n");
+	printf(" \"testsuite\": {\n");
+	printf("  \"name\": \"Linux Test Project\",\n");
+	printf("  \"short_name\": \"LTP\",\n");
+	printf("  \"url\": \"https://github.com/linux-test-project/ltp/\",\n");
+	printf("  \"scm_url_base\": \"https://github.com/linux-test-project/ltp/tree/master/\",\n");
+	printf("  \"version\": \"%s\"\n", version);
+	printf(" },\n");
+	printf(" \"defaults\": {\n");
+	printf("  \"timeout\": 30\n");
+	printf(" },\n");
+	printf(" \"tests\": {\n");
+}
+
 static void print_help(const char *prgname)
 {
-	printf("usage: %s [-vh] input.c\n\n", prgname);
+	printf("usage: %s [-vh] [-j jobs] [-T version] input.c|input.sh|- ...\n\n", prgname);
 	printf("-v sets verbose mode\n");
 	printf("-I add include path\n");
+	printf("-j number of parallel jobs (defaults to number of CPUs)\n");
+	printf("-T print the whole testsuite JSON with the version\n");
+	printf("-  read the list of input files from stdin\n");
 	printf("-h prints this help\n\n");
 	exit(0);
 }
 
 int main(int argc, char *argv[])
 {
-	unsigned int i, j;
-	struct data_node *res;
+	struct batch batch = {};
+	const char *version = NULL;
+	unsigned int i, first = 1;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
 	int opt;
 
-	while ((opt = getopt(argc, argv, "hI:v")) != -1) {
+	while ((opt = getopt(argc, argv, "hI:j:T:v")) != -1) {
 		switch (opt) {
 		case 'h':
 			print_help(argv[0]);
@@ -993,6 +1421,16 @@ int main(int argc, char *argv[])
 
 			cmdline_includepath[cmdline_includepaths++] = optarg;
 		break;
+		case 'j':
+			jobs = atol(optarg);
+			if (jobs < 1) {
+				fprintf(stderr, "Invalid number of jobs '%s'\n", optarg);
+				exit(1);
+			}
+		break;
+		case 'T':
+			version = optarg;
+		break;
 		case 'v':
 			verbose = 1;
 		break;
@@ -1004,47 +1442,46 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	if (!hcreate(128)) {
-		fprintf(stderr, "Failed to initialize hash table\n");
-		return 1;
+	if (!strcmp(argv[optind], "-")) {
+		read_file_list(&batch);
+	} else {
+		batch.files = argv + optind;
+		batch.files_cnt = argc - optind;
 	}
 
-	res = parse_file(argv[optind]);
-	if (!res)
-		return 0;
-
-	/* Filter out useless data */
-	for (i = 0; filter_out[i]; i++)
-		data_node_hash_del(res, filter_out[i]);
+	/* Verbose output would be interleaved otherwise */
+	if (verbose)
+		jobs = 1;
 
-	/* Normalize the result */
-	for (i = 0; implies[i].flag; i++) {
-		if (data_node_hash_get(res, implies[i].flag)) {
-			for (j = 0; implies[i].implies[j]; j++) {
-				if (data_node_hash_get(res, implies[i].implies[j]))
-					fprintf(stderr, "%s: useless tag: %s\n",
-						argv[optind], implies[i].implies[j]);
-			}
-		}
+	batch.results = calloc(batch.files_cnt + 1, sizeof(char *));
+	if (!batch.results) {
+		fprintf(stderr, "Allocation failed :(\n");
+		exit(1);
 	}
 
-	/* Normalize types */
-	check_normalize_types(res);
+	run_batch(&batch, jobs);
 
-	for (i = 0; implies[i].flag; i++) {
-		if (data_node_hash_get(res, implies[i].flag)) {
-			for (j = 0; implies[i].implies[j]; j++) {
-				if (!data_node_hash_get(res, implies[i].implies[j]))
-					data_node_hash_add(res, implies[i].implies[j],
-							   data_node_string("1"));
-			}
-		}
+	if (version)
+		print_testsuite_header(version);
+
+	for (i = 0; i < batch.files_cnt; i++) {
+		if (!batch.results[i])
+			continue;
+
+		if (!first)
+			printf(",\n");
+
+		/* The whole testsuite output matches the output of parse.sh */
+		printf(version ? "%s\n" : "%s", batch.results[i]);
+		first = 0;
+		free(batch.results[i]);
 	}
 
-	data_node_hash_add(res, "fname", data_node_string(argv[optind]));
-	printf("  \"%s\": ", strip_name(argv[optind]));
-	data_to_json(res, stdout, 2);
-	data_node_free(res);
+	if (version) {
+		printf("\n");
+		printf(" }\n");
+		printf("}\n");
+	}
 
 	return 0;
 }
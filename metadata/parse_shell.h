@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (c) 2025 Cyril Hrubis <chrubis@suse.cz>
+ */
+
+#ifndef PARSE_SHELL_H__
+#define PARSE_SHELL_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <libgen.h>
+
+#include "data_storage.h"
+
+enum parse_shell_state {
+	NONE,
+	START,
+	DOC_FIRST,
+	DOC,
+	ENV_START,
+	ENV_FIRST,
+	ENV
+};
+
+static inline void parse_shell_json_start(FILE *out, char *path, int *started)
+{
+	char *path_copy;
+
+	if (*started)
+		return;
+
+	*started = 1;
+
+	path_copy = strdup(path);
+	fprintf(out, "   \"%s\": {\n", basename(path_copy));
+	free(path_copy);
+}
+
+static inline void parse_shell_json_finish(FILE *out, const char *path, int started)
+{
+	if (!started)
+		return;
+
+	fprintf(out, "   \"fname\": \"%s\"\n", path);
+	fprintf(out, "  }");
+}
+
+/*
+ * Parses the doc and env blocks from a shell test and writes the JSON entry
+ * for the test into the out file. Nothing is written if the test does not
+ * have any metadata.
+ */
+static inline void parse_shell(FILE *out, char *path)
+{
+	char line[4096];
+	FILE *f = fopen(path, "r");
+	enum parse_shell_state state = NONE;
+	int started = 0;
+
+	if (!f) {
+		fprintf(stderr, "Failed to open '%s': %s\n",
+			path, strerror(errno));
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		/* Strip newline */
+		line[strlen(line)-1] = 0;
+
+		switch (state) {
+		case NONE:
+			if (!strcmp(line, "# ---"))
+				state = START;
+		break;
+		case START:
+			if (!strcmp(line, "# doc")) {
+				parse_shell_json_start(out, path, &started);
+				state = DOC_FIRST;
+				fprintf(out, "   \"doc\": [\n");
+			} else if (!strcmp(line, "# env")) {
+				parse_shell_json_start(out, path, &started);
+				state = ENV_START;
+			} else {
+				state = NONE;
+			}
+		break;
+		case DOC:
+		case DOC_FIRST:
+			if (!strcmp(line, "# ---")) {
+				state = NONE;
+				fprintf(out, "\n   ],\n");
+				continue;
+			}
+
+			if (state == DOC_FIRST)
+				state = DOC;
+			else
+				fprintf(out, ",\n");
+
+			data_fprintf_esc(out, 4, line+2);
+		break;
+		case ENV_START:
+			if (!strcmp(line, "# {")) {
+				state = ENV_FIRST;
+			} else {
+				fprintf(stderr,
+					"%s: Invalid line in JSON block '%s'",
+					path, line);
+			}
+		break;
+		case ENV:
+		case ENV_FIRST:
+			if (!strcmp(line, "# }")) {
+				state = NONE;
+				fprintf(out, ",\n");
+				continue;
+			}
+
+			if (state == ENV_FIRST)
+				state = ENV;
+			else
+				fprintf(out, "\n");
+
+			line[0] = ' ';
+			line[1] = ' ';
+
+			fprintf(out, "%s", line);
+		break;
+		}
+	}
+
+	fclose(f);
+
+	parse_shell_json_finish(out, path, started);
+}
+
+#endif /* PARSE_SHELL_H__ */
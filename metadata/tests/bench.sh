@@ -0,0 +1,43 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-or-later
+# Copyright (c) Linux Test Project, 2026
+#
+# Measures how long it takes to parse metadata for all tests in the
+# testcases/ directory with a single metaparse thread.
+#
+# Usage: bench.sh [runs]
+
+runs=${1:-5}
+top_srcdir="$(cd $(dirname $0)/../..; pwd)"
+metaparse="$(cd $(dirname $0)/..; pwd)/metaparse"
+files=$(mktemp)
+
+cd $top_srcdir
+
+find testcases/ -name '*.c' | sort > $files
+find testcases/ -not -path "testcases/lib/*" -name '*.sh' | sort >> $files
+
+echo "Parsing $(wc -l < $files) files $runs times"
+
+total=0
+best=
+
+for i in $(seq $runs); do
+	start=$(date +%s%N)
+	$metaparse -j 1 -Iinclude -Itestcases/kernel/syscalls/utils/ \
+		-Itestcases/kernel/include -T bench - < $files > /dev/null 2>&1
+	end=$(date +%s%N)
+
+	t=$(( (end - start) / 1000 ))
+	total=$((total + t))
+
+	if [ -z "$best" ] || [ $t -lt $best ]; then
+		best=$t
+	fi
+
+	echo "Run $i: $t us"
+done
+
+echo "Best: $best us, average: $((total / runs)) us"
+
+rm -f $files
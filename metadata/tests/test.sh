@@ -1,6 +1,7 @@
 #!/bin/sh
 
 fail=0
+first=
 
 for i in *.c; do
 	../metaparse $i > tmp.json
@@ -13,6 +14,23 @@ for i in *.c; do
 	fi
 done
 
-rm -f tmp.json
+# Batch mode has to produce the same entries as the single file runs
+for i in *.c; do
+	[ -s $i.json ] || continue
+	[ -n "$first" ] && printf ',\n' >> expected.json
+	cat $i.json >> expected.json
+	first=1
+done
+
+ls *.c | ../metaparse -j 4 - > tmp.json
+if ! diff tmp.json expected.json >/dev/null 2>&1; then
+	echo "***"
+	echo "batch output differs!"
+	diff -u tmp.json expected.json
+	echo "***"
+	fail=1
+fi
+
+rm -f tmp.json expected.json
 
 exit $fail
@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (c) Linux Test Project, 2026
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "history.h"
+
+struct hist_entry {
+	char *tag;
+	long ms;
+};
+
+static struct hist_entry *entries;
+static size_t entries_cnt, entries_size;
+
+static int entry_cmp(const void *a, const void *b)
+{
+	const struct hist_entry *ea = a, *eb = b;
+
+	return strcmp(ea->tag, eb->tag);
+}
+
+static struct hist_entry *find_entry(const char *tag)
+{
+	struct hist_entry key = {.tag = (char *)tag};
+
+	if (!entries_cnt)
+		return NULL;
+
+	return bsearch(&key, entries, entries_cnt, sizeof(*entries), entry_cmp);
+}
+
+static int add_entry(const char *tag, long ms)
+{
+	struct hist_entry *new;
+
+	if (entries_cnt >= entries_size) {
+		entries_size = entries_size ? 2 * entries_size : 1024;
+		new = realloc(entries, entries_size * sizeof(*entries));
+		if (!new)
+			return -1;
+
+		entries = new;
+	}
+
+	entries[entries_cnt].tag = strdup(tag);
+	if (!entries[entries_cnt].tag)
+		return -1;
+
+	entries[entries_cnt++].ms = ms;
+
+	return 0;
+}
+
+/*
+ * Drops the duplicate tags from the sorted array, these can only come from a
+ * hand edited file since hist_save() writes each tag once.
+ */
+static void remove_duplicates(void)
+{
+	size_t i, j = 0;
+
+	for (i = 1; i < entries_cnt; i++) {
+		if (!strcmp(entries[j].tag, entries[i].tag)) {
+			free(entries[i].tag);
+			continue;
+		}
+
+		entries[++j] = entries[i];
+	}
+
+	if (entries_cnt)
+		entries_cnt = j + 1;
+}
+
+int hist_load(const char *path)
+{
+	char tag[256];
+	FILE *f;
+	long ms;
+	int ret;
+
+	f = fopen(path, "r");
+	if (!f) {
+		if (errno == ENOENT)
+			return 0;
+
+		fprintf(stderr, "Failed to open '%s': %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+
+	while ((ret = fscanf(f, "%255s %ld", tag, &ms)) == 2) {
+		if (ms < 0)
+			continue;
+
+		if (add_entry(tag, ms)) {
+			fprintf(stderr, "Failed to allocate memory\n");
+			fclose(f);
+			return -1;
+		}
+	}
+
+	fclose(f);
+
+	if (ret != EOF)
+		fprintf(stderr, "Ignoring malformed lines in '%s'\n", path);
+
+	qsort(entries, entries_cnt, sizeof(*entries), entry_cmp);
+	remove_duplicates();
+
+	return 0;
+}
+
+long hist_get(const char *tag)
+{
+	struct hist_entry *entry = find_entry(tag);
+
+	return entry ? entry->ms : -1;
+}
+
+void hist_set(const char *tag, long ms)
+{
+	struct hist_entry *entry = find_entry(tag);
+
+	/* Average with the previous run to smooth out the outliers */
+	if (entry) {
+		entry->ms = (entry->ms + ms) / 2;
+		return;
+	}
+
+	if (add_entry(tag, ms))
+		return;
+
+	qsort(entries, entries_cnt, sizeof(*entries), entry_cmp);
+}
+
+int hist_save(const char *path)
+{
+	char *tmp;
+	size_t i;
+	FILE *f;
+
+	if (asprintf(&tmp, "%s.tmp", path) < 0)
+		return -1;
+
+	f = fopen(tmp, "w");
+	if (!f) {
+		fprintf(stderr, "Failed to open '%s': %s\n", tmp,
+			strerror(errno));
+		free(tmp);
+		return -1;
+	}
+
+	for (i = 0; i < entries_cnt; i++)
+		fprintf(f, "%s %ld\n", entries[i].tag, entries[i].ms);
+
+	if (fclose(f) || rename(tmp, path)) {
+		fprintf(stderr, "Failed to write '%s': %s\n", path,
+			strerror(errno));
+		unlink(tmp);
+		free(tmp);
+		return -1;
+	}
+
+	free(tmp);
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (c) Linux Test Project, 2026
+ */
+
+/*
+ * Test durations from the previous runs.
+ *
+ * The durations are kept in a text file with one "tag milliseconds" line per
+ * test, sorted by the tag. They are used to start the longest tests first
+ * when tests run in parallel, so that a long test does not end up running
+ * alone at the end of the run.
+ */
+
+#ifndef HISTORY_H__
+#define HISTORY_H__
+
+/*
+ * Loads the durations, a missing file is not an error.
+ *
+ * Returns 0 on success, -1 and prints an error on failure.
+ */
+int hist_load(const char *path);
+
+/*
+ * Returns the duration of the test in ms or -1 if it is not known.
+ */
+long hist_get(const char *tag);
+
+/*
+ * Records the duration of a finished test.
+ */
+void hist_set(const char *tag, long ms);
+
+/*
+ * Writes the durations back, the file is replaced atomically.
+ *
+ * Returns 0 on success, -1 and prints an error on failure.
+ */
+int hist_save(const char *path);
+
+#endif /* HISTORY_H__ */
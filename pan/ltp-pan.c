@@ -52,6 +52,7 @@
 /* $Id: ltp-pan.c,v 1.4 2009/10/15 18:45:55 yaberauneya Exp $ */
 
 #include <sys/param.h>
+#include <sys/epoll.h>
 #include <sys/stat.h>
 #include <stdarg.h>
 #include <sys/times.h>
@@ -70,12 +71,19 @@
 #include "splitstr.h"
 #include "zoolib.h"
 #include "tst_res_flags.h"
+#include "lapi/syscalls.h"
+#include "resources.h"
+#include "history.h"
 
 /* One entry in the command line collection.  */
 struct coll_entry {
 	char *name;		/* tag name */
 	char *cmdline;		/* command line */
 	char *pcnt_f;		/* location of %f in the command line args, flag */
+	const struct test_res *res;	/* resources needed, NULL if unknown */
+	int started;		/* started in this sequential pass */
+	long est_ms;		/* expected duration, -1 if unknown */
+	int order;		/* position in the command file */
 	struct coll_entry *next;
 };
 
@@ -86,8 +94,10 @@ struct collection {
 
 struct tag_pgrp {
 	int pgrp;
+	int pidfd;		/* -1 if the child is not watched by epoll */
 	int stopping;
 	time_t mystime;
+	struct timespec mystart;	/* CLOCK_MONOTONIC start time */
 	struct coll_entry *cmd;
 	char output[PATH_MAX];
 };
@@ -116,6 +126,12 @@ static char *subst_pcnt_f(struct coll_entry *colle);
 static void mark_orphan(struct orphan_pgrp *orphans, pid_t cpid);
 static void orphans_running(struct orphan_pgrp *orphans);
 static void check_orphans(struct orphan_pgrp *orphans, int sig);
+static int pick_command(struct collection *coll, int c, int sequential);
+static void watch_child(struct tag_pgrp *active);
+static void unwatch_child(struct tag_pgrp *active);
+static pid_t wait_child(int *stat_loc, struct tag_pgrp **active);
+static void sort_longest_first(struct collection *coll);
+static void record_duration(struct tag_pgrp *running);
 
 static void copy_buffered_output(struct tag_pgrp *running);
 static void write_test_start(struct tag_pgrp *running, int no_kmsg);
@@ -130,6 +146,16 @@ static char *panname = NULL;
 static char *test_out_dir = NULL;	/* dir to buffer output to */
 zoo_t zoofile;
 static char *reporttype = NULL;
+static char *histfilename = NULL;	/* test durations from previous runs */
+
+/*
+ * The running children are waited for with pidfds in an epoll set, which
+ * hands back the slot of the child that exited. If pidfds are not supported
+ * or some child could not get one, pan falls back to wait().
+ */
+static int epfd = -1;
+static int watched;		/* children with a pidfd in the epoll set */
+static int unwatched;		/* children without a pidfd */
 
 /* Common format string for ltp-pan results */
 #define ResultFmt	"%-50s %-10.10s"
@@ -143,6 +169,7 @@ int Debug = 0;
 #define Dbuffile	0x000400	/* buffer file use */
 #define	Dsetup		0x000200	/* one-time set-up */
 #define	Dshutdown	0x000100	/* killed by signal */
+#define Dsched		0x000040	/* resource scheduling */
 #define	Dexit		0x000020	/* exit status */
 #define	Drunning	0x000010	/* current pids running */
 #define	Dstartup	0x000004	/* started command */
@@ -159,6 +186,7 @@ int main(int argc, char **argv)
 	char *failcmdfilename = NULL;
 	char *tconfcmdfilename = NULL;
 	char *outputfilename = NULL;
+	char *metadatafilename = NULL;	/* schedule by test resources */
 	struct collection *coll = NULL;
 	struct tag_pgrp *running;
 	struct orphan_pgrp *orphans, *orph;
@@ -167,6 +195,7 @@ int main(int argc, char **argv)
 	FILE *failcmdfile = NULL;
 	FILE *tconfcmdfile = NULL;
 	int keep_active = 1;
+	int devices = -1;	/* number of tests allowed to use a device */
 	int num_active = 0;
 	int failcnt = 0;  /* count of total testcases that failed. */
 	int tconfcnt = 0; /* count of total testcases that return TCONF */
@@ -191,7 +220,7 @@ int main(int argc, char **argv)
 	struct sigaction sa;
 
 	while ((c =
-		getopt(argc, argv, "AO:Sa:C:QT:d:ef:hl:n:o:pqr:s:t:x:y"))
+		getopt(argc, argv, "AO:Sa:C:D:H:M:QT:d:ef:hl:n:o:pqr:s:t:x:y"))
 		       != -1) {
 		switch (c) {
 		case 'A':	/* all-stop flag */
@@ -210,6 +239,15 @@ int main(int argc, char **argv)
 		case 'C':	/* name of the file where all failed commands will be */
 			failcmdfilename = strdup(optarg);
 			break;
+		case 'D':	/* number of tests using a device at a time */
+			devices = atoi(optarg);
+			break;
+		case 'H':	/* test durations, run the longest first */
+			histfilename = strdup(optarg);
+			break;
+		case 'M':	/* test metadata for resource scheduling */
+			metadatafilename = strdup(optarg);
+			break;
 		case 'Q':
 			no_kmsg = 1;
 			break;
@@ -236,7 +274,9 @@ int main(int argc, char **argv)
 				"[ -a active-file ] [ -f command-file ] "
 				"[ -C fail-command-file ] "
 				"[ -d debug-level ]\n\t[-o output-file] "
-				"[-O output-buffer-directory] [cmd]\n");
+				"[-O output-buffer-directory] "
+				"[ -M metadata-file [ -D ndevices ] ]\n\t"
+				"[ -H durations-file ] [cmd]\n");
 			exit(0);
 		case 'l':	/* log file */
 			logfilename = strdup(optarg);
@@ -372,6 +412,41 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (metadatafilename) {
+		if (res_load(metadatafilename)) {
+			fprintf(stderr, "pan(%s): Failed to load -M arg '%s'\n",
+				panname, metadatafilename);
+			exit(1);
+		}
+
+		for (i = 0; i < coll->cnt; i++) {
+			coll->ary[i]->res = res_lookup(coll->ary[i]->cmdline);
+			if (!coll->ary[i]->res)
+				coll->ary[i]->res = res_lookup(coll->ary[i]->name);
+		}
+
+		/*
+		 * Tests find a free loop device unless LTP_DEV is set, in
+		 * which case they would all share the same one.
+		 */
+		if (devices < 0)
+			devices = getenv("LTP_DEV") ? 1 : keep_active;
+
+		res_set_limits(keep_active, res_mem_avail_mb(), devices);
+	}
+
+	if (histfilename) {
+		if (hist_load(histfilename)) {
+			fprintf(stderr, "pan(%s): Failed to load -H arg '%s'\n",
+				panname, histfilename);
+			exit(1);
+		}
+
+		/* the order matters only for tests run in sequence in parallel */
+		if (sequential && keep_active > 1)
+			sort_longest_first(coll);
+	}
+
 	if (Debug & Dsetup)
 		dump_coll(coll);
 
@@ -387,6 +462,8 @@ int main(int argc, char **argv)
 	memset(running, 0, keep_active * sizeof(struct tag_pgrp));
 	running[keep_active].pgrp = -1;	/* end sentinel */
 
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+
 	/* a head to the orphaned pgrp list */
 	orphans = malloc(sizeof(struct orphan_pgrp));
 	memset(orphans, 0, sizeof(struct orphan_pgrp));
@@ -530,6 +607,13 @@ int main(int argc, char **argv)
 			if (!sequential)
 				c = lrand48() % coll->cnt;
 
+			if (metadatafilename) {
+				i = pick_command(coll, c, sequential);
+				if (i < 0)
+					break;
+				c = i;
+			}
+
 			/* find a slot for the child */
 			for (i = 0; i < keep_active; ++i) {
 				if (running[i].pgrp == 0)
@@ -547,8 +631,11 @@ int main(int argc, char **argv)
 			cpid =
 			    run_child(coll->ary[c], running + i, quiet_mode,
 				      &failcnt, fmt_print, logfile, no_kmsg);
-			if (cpid != -1)
+			if (cpid != -1) {
 				++num_active;
+				res_acquire(coll->ary[c]->res);
+			}
+			coll->ary[c]->started = 1;
 			if ((cpid != -1 || sequential) && starts > 0)
 				--starts;
 
@@ -647,6 +734,10 @@ int main(int argc, char **argv)
 		fprintf(stderr, "pan(%s): %s\n", panname, zoo_error);
 		++exit_stat;
 	}
+
+	if (histfilename && hist_save(histfilename))
+		fprintf(stderr, "pan(%s): Failed to save -H arg '%s'\n",
+			panname, histfilename);
 	fclose(zoofile);
 	if (logfile && fmt_print) {
 		if (uname(&unamebuf) == -1)
@@ -725,6 +816,7 @@ check_pids(struct tag_pgrp *running, int *num_active, int keep_active,
 	char *result_str;
 	int signaled = 0;
 	struct tms tms1, tms2;
+	struct tag_pgrp *active = NULL;
 	clock_t tck;
 
 	check_orphans(orphans, 0);
@@ -734,7 +826,10 @@ check_pids(struct tag_pgrp *running, int *num_active, int keep_active,
 		fprintf(stderr, "pan(%s): times(&tms1) failed.  errno:%d  %s\n",
 			panname, errno, strerror(errno));
 	}
-	cpid = wait(&stat_loc);
+	if (epfd >= 0 && watched && !unwatched)
+		cpid = wait_child(&stat_loc, &active);
+	else
+		cpid = wait(&stat_loc);
 	tck = times(&tms2);
 	if (tck == -1) {
 		fprintf(stderr, "pan(%s): times(&tms2) failed.  errno:%d  %s\n",
@@ -782,7 +877,8 @@ check_pids(struct tag_pgrp *running, int *num_active, int keep_active,
 			ret++;
 		}
 
-		for (i = 0; i < keep_active; ++i) {
+		/* the slot is known if the child was waited for by its pidfd */
+		for (i = active ? active - running : 0; i < keep_active; ++i) {
 			if (running[i].pgrp == cpid) {
 				if ((w == 130) && running[i].stopping &&
 				    (strcmp(status, "exited") == 0)) {
@@ -853,6 +949,8 @@ check_pids(struct tag_pgrp *running, int *num_active, int keep_active,
 
 				if (running[i].stopping)
 					status = "driver_interrupt";
+				else if (histfilename)
+					record_duration(running + i);
 
 				if (test_out_dir) {
 					if (!quiet_mode)
@@ -873,6 +971,8 @@ check_pids(struct tag_pgrp *running, int *num_active, int keep_active,
 					ret++;
 
 				running[i].pgrp = 0;
+				unwatch_child(running + i);
+				res_release(running[i].cmd->res);
 				if (zoo_clear(zoofile, cpid)) {
 					fprintf(stderr, "pan(%s): %s\n",
 						panname, zoo_error);
@@ -900,6 +1000,71 @@ check_pids(struct tag_pgrp *running, int *num_active, int keep_active,
 	return ret;
 }
 
+static void watch_child(struct tag_pgrp *active)
+{
+	struct epoll_event ev = {.events = EPOLLIN, .data.ptr = active};
+
+	active->pidfd = -1;
+
+	if (epfd < 0)
+		goto unwatched;
+
+	active->pidfd = syscall(__NR_pidfd_open, active->pgrp, 0);
+	if (active->pidfd < 0) {
+		/* not supported by the kernel, stop trying */
+		if (errno == ENOSYS) {
+			close(epfd);
+			epfd = -1;
+		}
+		goto unwatched;
+	}
+
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, active->pidfd, &ev)) {
+		fprintf(stderr, "pan(%s): epoll_ctl() failed.  errno:%d  %s\n",
+			panname, errno, strerror(errno));
+		close(active->pidfd);
+		active->pidfd = -1;
+		goto unwatched;
+	}
+
+	watched++;
+	return;
+unwatched:
+	unwatched++;
+}
+
+static void unwatch_child(struct tag_pgrp *active)
+{
+	if (active->pidfd < 0) {
+		unwatched--;
+		return;
+	}
+
+	/* closing the last reference removes the pidfd from the epoll set */
+	close(active->pidfd);
+	active->pidfd = -1;
+	watched--;
+}
+
+/*
+ * Waits until a watched child exits and reaps it, the child slot is
+ * returned in active.
+ */
+static pid_t wait_child(int *stat_loc, struct tag_pgrp **active)
+{
+	struct epoll_event ev;
+	pid_t cpid;
+
+	if (epoll_wait(epfd, &ev, 1, -1) < 1)
+		return -1;
+
+	cpid = waitpid(((struct tag_pgrp *)ev.data.ptr)->pgrp, stat_loc, 0);
+	if (cpid > 0)
+		*active = ev.data.ptr;
+
+	return cpid;
+}
+
 static pid_t
 run_child(struct coll_entry *colle, struct tag_pgrp *active, int quiet_mode,
 	  int *failcnt, int fmt_print, FILE * logfile, int no_kmsg)
@@ -952,6 +1117,7 @@ run_child(struct coll_entry *colle, struct tag_pgrp *active, int quiet_mode,
 	}
 
 	time(&active->mystime);
+	clock_gettime(CLOCK_MONOTONIC, &active->mystart);
 	active->cmd = colle;
 
 	if (!test_out_dir && !quiet_mode)
@@ -1133,6 +1299,7 @@ run_child(struct coll_entry *colle, struct tag_pgrp *active, int quiet_mode,
 
 	active->pgrp = cpid;
 	active->stopping = 0;
+	watch_child(active);
 
 	if (zoo_mark_cmdline(zoofile, cpid, colle->name, colle->cmdline)) {
 		fprintf(stderr, "pan(%s): %s\n", panname, zoo_error);
@@ -1196,7 +1363,7 @@ static struct collection *get_collection(char *file, int optind, int argc,
 
 		/* If this is line isn't a comment */
 		if ((*a != '#') && (*a != '\0') && (*a != ' ')) {
-			n = malloc(sizeof(struct coll_entry));
+			n = calloc(1, sizeof(struct coll_entry));
 			if ((n->pcnt_f = strstr(a, "%f"))) {
 				n->pcnt_f[1] = 's';
 			}
@@ -1238,7 +1405,7 @@ static struct collection *get_collection(char *file, int optind, int argc,
 			workstr_left--;
 		}
 
-		n = malloc(sizeof(struct coll_entry));
+		n = calloc(1, sizeof(struct coll_entry));
 		if ((n->pcnt_f = strstr(workstr, "%f"))) {
 			n->pcnt_f[1] = 's';
 		}
@@ -1449,6 +1616,63 @@ static void orphans_running(struct orphan_pgrp *orphans)
 	fprintf(stderr, "\n");
 }
 
+static void record_duration(struct tag_pgrp *running)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	hist_set(running->cmd->name,
+		 (now.tv_sec - running->mystart.tv_sec) * 1000 +
+		 (now.tv_nsec - running->mystart.tv_nsec) / 1000000);
+}
+
+/*
+ * The expected duration is taken from the previous runs, then from the
+ * test metadata. Unknown tests sort after the known ones.
+ */
+static long estimate_ms(struct coll_entry *colle)
+{
+	long ms = hist_get(colle->name);
+
+	if (ms >= 0 || !colle->res)
+		return ms;
+
+	if (colle->res->runtime)
+		return colle->res->runtime * 1000L;
+
+	if (colle->res->timeout)
+		return colle->res->timeout * 1000L;
+
+	return -1;
+}
+
+static int longest_first_cmp(const void *a, const void *b)
+{
+	struct coll_entry *const *ca = a, *const *cb = b;
+
+	if ((*ca)->est_ms != (*cb)->est_ms)
+		return (*ca)->est_ms < (*cb)->est_ms ? 1 : -1;
+
+	return (*ca)->order - (*cb)->order;
+}
+
+/*
+ * Longest processing time first: starting the longest tests first keeps the
+ * slots busy until the end of the run with the short tests.
+ */
+static void sort_longest_first(struct collection *coll)
+{
+	int i;
+
+	for (i = 0; i < coll->cnt; i++) {
+		coll->ary[i]->est_ms = estimate_ms(coll->ary[i]);
+		coll->ary[i]->order = i;
+	}
+
+	qsort(coll->ary, coll->cnt, sizeof(*coll->ary), longest_first_cmp);
+}
+
 static void dump_coll(struct collection *coll)
 {
 	int i;
@@ -1457,7 +1681,58 @@ static void dump_coll(struct collection *coll)
 		fprintf(stderr, "coll %d\n", i);
 		fprintf(stderr, "  name=%s cmdline=%s\n", coll->ary[i]->name,
 			coll->ary[i]->cmdline);
+		if (coll->ary[i]->res) {
+			const struct test_res *res = coll->ary[i]->res;
+			unsigned int j;
+
+			fprintf(stderr, "  slots=%u mem=%luMB devices=%u locks=",
+				res->slots, res->mem_mb, res->devices);
+			for (j = 0; j < res->lock_cnt; j++)
+				fprintf(stderr, "%s%s", j ? "," : "",
+					res->locks[j]);
+			fprintf(stderr, "\n");
+		}
+	}
+}
+
+/*
+ * Returns the index of a command whose resources are available, searching
+ * from c, or -1 if all of them have to wait for a running test to finish.
+ * In sequential mode each command is started once per pass over the
+ * collection, the search starts from the first command not started yet so
+ * that the commands that did not fit run as soon as possible.
+ */
+static int pick_command(struct collection *coll, int c, int sequential)
+{
+	int i, j;
+
+	if (sequential) {
+		for (i = 0; i < coll->cnt; i++) {
+			if (!coll->ary[i]->started)
+				break;
+		}
+
+		if (i == coll->cnt) {
+			for (i = 0; i < coll->cnt; i++)
+				coll->ary[i]->started = 0;
+		}
 	}
+
+	for (i = 0; i < coll->cnt; i++) {
+		j = sequential ? i : (c + i) % coll->cnt;
+
+		if (sequential && coll->ary[j]->started)
+			continue;
+
+		if (res_fits(coll->ary[j]->res))
+			return j;
+
+		if (Debug & Dsched)
+			fprintf(stderr, "pan(%s): %s waits for resources\n",
+				panname, coll->ary[j]->name);
+	}
+
+	return -1;
 }
 
 void wait_handler(int sig)
@@ -0,0 +1,378 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (c) Linux Test Project, 2026
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ujson.h"
+#include "resources.h"
+
+static struct test_res *tests;
+static size_t tests_cnt;
+
+static unsigned int slots_max = 1, slots_used;
+static unsigned long mem_max, mem_used;
+static unsigned int devices_max = 1, devices_used;
+
+/* Locks held by the running tests */
+static const char **held;
+static unsigned int held_cnt, held_size;
+
+static struct test_res default_res = {.slots = 1};
+
+static void skip_val(ujson_reader *reader, ujson_val *val)
+{
+	if (val->type == UJSON_OBJ)
+		ujson_obj_skip(reader);
+	else if (val->type == UJSON_ARR)
+		ujson_arr_skip(reader);
+}
+
+/* The metadata values are mostly stored as strings, e.g. "1" */
+static unsigned long val_to_ulong(ujson_val *val)
+{
+	switch (val->type) {
+	case UJSON_INT:
+		return val->val_int > 0 ? val->val_int : 0;
+	case UJSON_BOOL:
+		return val->val_bool;
+	case UJSON_STR:
+		return strtoul(val->val_str, NULL, 0);
+	default:
+		return 0;
+	}
+}
+
+static void add_lock(struct test_res *res, const char *fmt, const char *arg)
+{
+	char **locks;
+	char *lock;
+
+	if (asprintf(&lock, fmt, arg) < 0)
+		return;
+
+	locks = realloc(res->locks, (res->lock_cnt + 1) * sizeof(*locks));
+	if (!locks) {
+		free(lock);
+		return;
+	}
+
+	res->locks = locks;
+	res->locks[res->lock_cnt++] = lock;
+}
+
+static void parse_cgroup_ctrls(ujson_reader *reader, ujson_val *val,
+			       struct test_res *res)
+{
+	UJSON_ARR_FOREACH(reader, val) {
+		if (val->type == UJSON_STR)
+			add_lock(res, "cgroup:%s", val->val_str);
+		else
+			skip_val(reader, val);
+	}
+}
+
+/* Each entry is [path, value, flags], the path is locked */
+static void parse_save_restore(ujson_reader *reader, ujson_val *val,
+			       struct test_res *res)
+{
+	unsigned int i;
+
+	UJSON_ARR_FOREACH(reader, val) {
+		if (val->type != UJSON_ARR) {
+			skip_val(reader, val);
+			continue;
+		}
+
+		i = 0;
+		UJSON_ARR_FOREACH(reader, val) {
+			if (!i++ && val->type == UJSON_STR)
+				add_lock(res, "file:%s", val->val_str);
+			else
+				skip_val(reader, val);
+		}
+	}
+}
+
+static void parse_test(ujson_reader *reader, ujson_val *val,
+		       struct test_res *res)
+{
+	int has_hugepages = 0;
+
+	res->slots = 1;
+
+	UJSON_OBJ_FOREACH(reader, val) {
+		if (!strcmp(val->id, "min_cpus") && val_to_ulong(val)) {
+			res->slots = val_to_ulong(val);
+		} else if (!strcmp(val->id, "runtime")) {
+			res->runtime = val_to_ulong(val);
+		} else if (!strcmp(val->id, "timeout")) {
+			res->timeout = val_to_ulong(val);
+		} else if (!strcmp(val->id, "min_mem_avail")) {
+			res->mem_mb = val_to_ulong(val);
+		} else if (!strcmp(val->id, "needs_device") ||
+			   !strcmp(val->id, "all_filesystems")) {
+			if (val_to_ulong(val))
+				res->devices = 1;
+		} else if (!strcmp(val->id, "hugepages") ||
+			   !strcmp(val->id, "needs_hugetlbfs")) {
+			has_hugepages = 1;
+			skip_val(reader, val);
+		} else if (!strcmp(val->id, "restore_wallclock")) {
+			if (val_to_ulong(val))
+				add_lock(res, "%s", "wallclock");
+		} else if (!strcmp(val->id, "needs_cgroup_ctrls") &&
+			   val->type == UJSON_ARR) {
+			parse_cgroup_ctrls(reader, val, res);
+		} else if (!strcmp(val->id, "save_restore") &&
+			   val->type == UJSON_ARR) {
+			parse_save_restore(reader, val, res);
+		} else {
+			skip_val(reader, val);
+		}
+	}
+
+	/* The hugepage pool is resized by the tests */
+	if (has_hugepages)
+		add_lock(res, "%s", "hugepages");
+}
+
+static int res_cmp(const void *a, const void *b)
+{
+	const struct test_res *ra = a, *rb = b;
+
+	return strcmp(ra->name, rb->name);
+}
+
+static int parse_tests(ujson_reader *reader, ujson_val *val)
+{
+	struct test_res *new;
+	size_t size = 0;
+
+	UJSON_OBJ_FOREACH(reader, val) {
+		if (val->type != UJSON_OBJ) {
+			skip_val(reader, val);
+			continue;
+		}
+
+		if (tests_cnt >= size) {
+			size = size ? 2 * size : 1024;
+			new = realloc(tests, size * sizeof(*tests));
+			if (!new)
+				return -1;
+
+			tests = new;
+		}
+
+		memset(&tests[tests_cnt], 0, sizeof(*tests));
+		tests[tests_cnt].name = strdup(val->id);
+		if (!tests[tests_cnt].name)
+			return -1;
+
+		parse_test(reader, val, &tests[tests_cnt++]);
+	}
+
+	return 0;
+}
+
+int res_load(const char *path)
+{
+	char str_buf[4096];
+	ujson_val val = UJSON_VAL_INIT(str_buf, sizeof(str_buf));
+	ujson_reader *reader;
+	int ret = 0;
+
+	reader = ujson_reader_load(path);
+	if (!reader) {
+		fprintf(stderr, "Failed to load metadata '%s'\n", path);
+		return -1;
+	}
+
+	UJSON_OBJ_FOREACH(reader, &val) {
+		if (!strcmp(val.id, "tests") && val.type == UJSON_OBJ) {
+			if (parse_tests(reader, &val)) {
+				fprintf(stderr, "Failed to allocate memory\n");
+				ret = -1;
+				break;
+			}
+		} else {
+			skip_val(reader, &val);
+		}
+	}
+
+	ujson_reader_finish(reader);
+
+	if (ujson_reader_err(reader)) {
+		fprintf(stderr, "Failed to parse metadata '%s'\n", path);
+		ret = -1;
+	}
+
+	ujson_reader_free(reader);
+
+	qsort(tests, tests_cnt, sizeof(*tests), res_cmp);
+
+	return ret;
+}
+
+void res_set_limits(unsigned int slots, unsigned long mem_mb,
+		    unsigned int devices)
+{
+	slots_max = slots;
+	mem_max = mem_mb;
+	devices_max = devices;
+}
+
+static const struct test_res *find_test(const char *name)
+{
+	struct test_res key = {.name = (char *)name};
+
+	if (!tests_cnt)
+		return NULL;
+
+	return bsearch(&key, tests, tests_cnt, sizeof(*tests), res_cmp);
+}
+
+const struct test_res *res_lookup(const char *cmdline)
+{
+	const struct test_res *res;
+	char name[256];
+	const char *start;
+	size_t len;
+
+	cmdline += strspn(cmdline, " \t");
+	len = strcspn(cmdline, " \t\n");
+
+	/* Strip the path, the metadata are keyed by the test name */
+	for (start = cmdline + len; start > cmdline && start[-1] != '/'; start--)
+		;
+
+	len -= start - cmdline;
+	if (!len || len >= sizeof(name))
+		return NULL;
+
+	memcpy(name, start, len);
+	name[len] = 0;
+
+	res = find_test(name);
+	if (res)
+		return res;
+
+	/* The 16 and 64 bit variants share the metadata with the test */
+	if (len > 3 && (!strcmp(name + len - 3, "_16") ||
+			!strcmp(name + len - 3, "_64"))) {
+		name[len - 3] = 0;
+		return find_test(name);
+	}
+
+	return NULL;
+}
+
+static int lock_held(const char *lock)
+{
+	unsigned int i;
+
+	for (i = 0; i < held_cnt; i++) {
+		if (!strcmp(held[i], lock))
+			return 1;
+	}
+
+	return 0;
+}
+
+int res_fits(const struct test_res *res)
+{
+	unsigned int i;
+
+	if (!slots_used)
+		return 1;
+
+	if (!res)
+		res = &default_res;
+
+	if (slots_used + res->slots > slots_max)
+		return 0;
+
+	if (res->mem_mb && mem_max && mem_used + res->mem_mb > mem_max)
+		return 0;
+
+	if (res->devices && devices_used + res->devices > devices_max)
+		return 0;
+
+	for (i = 0; i < res->lock_cnt; i++) {
+		if (lock_held(res->locks[i]))
+			return 0;
+	}
+
+	return 1;
+}
+
+void res_acquire(const struct test_res *res)
+{
+	const char **new;
+	unsigned int i;
+
+	if (!res)
+		res = &default_res;
+
+	slots_used += res->slots;
+	mem_used += res->mem_mb;
+	devices_used += res->devices;
+
+	for (i = 0; i < res->lock_cnt; i++) {
+		if (held_cnt >= held_size) {
+			new = realloc(held, (held_size + 16) * sizeof(*held));
+			if (!new)
+				return;
+
+			held = new;
+			held_size += 16;
+		}
+
+		held[held_cnt++] = res->locks[i];
+	}
+}
+
+void res_release(const struct test_res *res)
+{
+	unsigned int i, j;
+
+	if (!res)
+		res = &default_res;
+
+	slots_used -= res->slots;
+	mem_used -= res->mem_mb;
+	devices_used -= res->devices;
+
+	for (i = 0; i < res->lock_cnt; i++) {
+		for (j = 0; j < held_cnt; j++) {
+			if (held[j] == res->locks[i]) {
+				held[j] = held[--held_cnt];
+				break;
+			}
+		}
+	}
+}
+
+unsigned long res_mem_avail_mb(void)
+{
+	unsigned long kb = 0;
+	char line[256];
+	FILE *f;
+
+	f = fopen("/proc/meminfo", "r");
+	if (!f)
+		return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "MemAvailable: %lu kB", &kb) == 1)
+			break;
+	}
+
+	fclose(f);
+
+	return kb / 1024;
+}
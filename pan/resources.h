@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (c) Linux Test Project, 2026
+ */
+
+/*
+ * Resource accounting for running tests in parallel.
+ *
+ * The resources a test needs are derived from the test metadata, i.e.
+ * metadata/ltp.json. Each running test holds a number of job slots, the
+ * memory it asked for, a block device if it needs one, and exclusive locks
+ * on global state it modifies, e.g. the hugepage pool or files in /proc/sys.
+ * A test is started only when everything it needs is available, so tests
+ * that would interfere with each other are serialised while the rest of
+ * them run concurrently.
+ */
+
+#ifndef RESOURCES_H__
+#define RESOURCES_H__
+
+struct test_res {
+	char *name;
+	unsigned int slots;
+	unsigned long mem_mb;
+	unsigned int devices;
+	unsigned int lock_cnt;
+	char **locks;
+	/* runtime and timeout in seconds, 0 if not set */
+	unsigned int runtime;
+	unsigned int timeout;
+};
+
+/*
+ * Loads the test resources from the metadata file.
+ *
+ * Returns 0 on success, -1 and prints an error on failure.
+ */
+int res_load(const char *path);
+
+/*
+ * Sets the amount of resources available to the running tests.
+ */
+void res_set_limits(unsigned int slots, unsigned long mem_mb,
+		    unsigned int devices);
+
+/*
+ * Returns the resources for a runtest command line or NULL if there is no
+ * metadata for the test. Tests without metadata take a single job slot.
+ */
+const struct test_res *res_lookup(const char *cmdline);
+
+/*
+ * Returns non-zero if the test can be started now. Tests that need more than
+ * the limits are started only if nothing else is running.
+ */
+int res_fits(const struct test_res *res);
+
+void res_acquire(const struct test_res *res);
+void res_release(const struct test_res *res);
+
+/*
+ * Returns MemAvailable in MB or 0 if it cannot be determined.
+ */
+unsigned long res_mem_avail_mb(void);
+
+#endif /* RESOURCES_H__ */
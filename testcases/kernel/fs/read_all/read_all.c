@@ -14,17 +14,41 @@
  * It is not required to run this as root, but test coverage will be much
  * higher with full privileges.
  *
- * The reads are preformed by worker processes which are given file paths by a
- * single parent process. The parent process recursively scans a given
- * directory and passes the file paths it finds to the child processes using a
- * queue structure stored in shared memory.
+ * The reads are performed by worker processes which also traverse the
+ * directory tree. Each worker has a deque of work items, directories to visit
+ * and files to read, stored in shared memory. A worker pushes the
+ * subdirectories it finds to the bottom of its own deque and pops from the
+ * bottom as well, so it traverses its part of the tree depth first. When its
+ * deque is empty it steals from the top of the other workers' deques, which
+ * hold the oldest and usually the largest subtrees. The parent process only
+ * supervises the workers and restarts the ones which get stuck. The worker
+ * keeps the position in the directories it visits in shared memory, so the
+ * visits it was killed in are requeued and only the file it got stuck on is
+ * skipped.
  *
  * This allows the file system and individual files to be accessed in
- * parallel. Passing the 'reads' parameter (-r) will encourage this. The
- * number of worker processes is based on the number of available
- * processors. However this is limited by default to 15 to avoid this becoming
- * an IPC stress test on systems with large numbers of weak cores. This can be
- * overridden with the 'w' parameters.
+ * parallel. Passing the 'reads' parameter (-r) will encourage this, the
+ * worker which finds a file reads it and each additional read is pushed to
+ * the deque of a different worker. The number of worker processes is
+ * based on the number of available processors. However this is limited by
+ * default to 15 to avoid this becoming an IPC stress test on systems with
+ * large numbers of weak cores. This can be overridden with the 'w'
+ * parameters.
+ *
+ * The time each open and read takes is recorded. With the 'o' parameter the
+ * slowest files and a latency histogram for each top level directory are
+ * written as JSON at the end, which is useful for building skip and rate
+ * limit lists for a particular kernel.
+ *
+ * With the 'u' parameter the workers read the files with io_uring instead of
+ * the open, read and close syscalls. The three operations are submitted as
+ * linked requests using a registered file table slot and a registered buffer,
+ * so a single worker keeps up to URING_DEPTH reads in flight. This exercises
+ * the files from the io_uring worker threads, it is not faster than read() on
+ * machines with few CPUs. With the 'o' parameter the reads are waited for one
+ * at a time so that the latencies do not include the time the reads wait for
+ * each other. The test falls back to the syscalls when io_uring is not
+ * available.
  */
 #include <signal.h>
 #include <sys/types.h>
@@ -40,35 +64,137 @@
 #include <unistd.h>
 #include <string.h>
 #include <limits.h>
-#include <semaphore.h>
+#include <pthread.h>
 #include <ctype.h>
 #include <pwd.h>
 #include <grp.h>
 
 #include "tst_atomic.h"
 #include "tst_safe_clocks.h"
+#include "tst_safe_pthread.h"
+#include "tst_safe_io_uring.h"
 #include "tst_test.h"
-#include "tst_timer.h"
+#include "ujson.h"
 
-#define QUEUE_SIZE 16384
+#define DEQUE_SIZE 1024
 #define BUFFER_SIZE 1024
 #define MAX_PATH 4096
 #define MAX_DISPLAY 40
+#define SLOW_FILES 20
+#define TOP_DIRS 64
+#define LAT_BUCKETS 24
+#define URING_DEPTH 32
+#define URING_BATCH 8
+#define VISIT_DEPTH 16
+
+/* The values of struct worker busy */
+#define WORKER_IDLE 0
+#define WORKER_ITEM 1
+#define WORKER_FLUSH 2
+
+enum work_type {
+	WORK_VISIT,
+	WORK_READ,
+};
+
+struct work {
+	enum work_type type;
+	/* The telldir() position to resume the visit at, zero for the start */
+	long loc;
+	char path[BUFFER_SIZE];
+};
+
+/*
+ * The owner pushes and pops at the bottom, the other workers steal from the
+ * top. The mutex is robust so that a worker killed while holding it does not
+ * block the others.
+ */
+struct deque {
+	pthread_mutex_t mutex;
+	unsigned int top;
+	unsigned int bottom;
+	struct work items[DEQUE_SIZE];
+};
+
+struct slow_file {
+	int us;
+	char path[BUFFER_SIZE];
+};
+
+/* Latencies of the reads under a single top level directory */
+struct dir_stat {
+	char name[NAME_MAX + 1];
+	unsigned int reads;
+	long long total_us;
+	int max_us;
+	/* Bucket i > 0 counts reads which took [2^(i-1), 2^i) us */
+	unsigned int hist[LAT_BUCKETS];
+};
+
+struct read_stats {
+	unsigned int slow_cnt;
+	int slow_min_us;
+	struct slow_file slow[SLOW_FILES];
+	unsigned int dirs_cnt;
+	struct dir_stat dirs[TOP_DIRS];
+};
+
+/* A directory being visited and the position after the last entry read */
+struct visit {
+	long loc;
+	char path[BUFFER_SIZE];
+};
 
-struct queue {
-	sem_t sem;
-	tst_atomic_t front;
-	int back;
-	char data[QUEUE_SIZE];
-	char popped[BUFFER_SIZE];
+/*
+ * An io_uring read in flight, kept in shared memory so that the parent can
+ * requeue the reads of a killed worker. The slot is free when the path is
+ * empty and the start is -1 until the read is submitted.
+ */
+struct inflight_read {
+	int start;
+	/* Whether the read is a work item which is done on completion */
+	int item;
+	char path[BUFFER_SIZE];
 };
 
 struct worker {
 	int i;
 	pid_t pid;
-	struct queue *q;
 	tst_atomic_t last_seen;
+	/* Whether the worker processes a work item or waits for io_uring */
+	tst_atomic_t busy;
+	/*
+	 * The number of work items taken and finished, items are in progress
+	 * when they differ. The worker increments the done count, the io_uring
+	 * reads of stolen items are finished when they complete. Both only
+	 * grow, so the parent can finish the items of a killed worker by
+	 * storing the taken count without counting them twice.
+	 */
+	tst_atomic_t taken;
+	tst_atomic_t done;
 	unsigned int kill_sent:1;
+	/* How long the worker was stuck when it was killed */
+	int stuck_us;
+	struct work work;
+	/* The path the worker accessed last */
+	char path[BUFFER_SIZE];
+	/* The visits in progress, the inner ones were descended inline */
+	unsigned int visit_depth;
+	int in_readdir;
+	struct visit visits[VISIT_DEPTH];
+	/* Whether the worker is in io_uring_enter() */
+	int in_uring;
+	struct inflight_read inflight[URING_DEPTH];
+	struct read_stats stats;
+	struct deque deque;
+};
+
+struct pool {
+	/* The number of work items ever queued */
+	tst_atomic_t queued;
+	/* Makes the workers exit before all work is done */
+	tst_atomic_t stop;
+	struct worker workers[];
 };
 
 enum dent_action {
@@ -87,11 +213,16 @@ static char *str_worker_count;
 static long worker_count;
 static char *str_max_workers;
 static long max_workers = 15;
+static struct pool *pool;
+static size_t pool_size;
 static struct worker *workers;
 static char *drop_privs;
 static char *str_worker_timeout;
 static int worker_timeout;
 static int timeout_warnings_left = 15;
+static char *report_path;
+static char *use_uring;
+static int uring_enabled;
 
 static char *blacklist[] = {
 	"/reserved/", /* reserved for -e parameter */
@@ -109,80 +240,110 @@ static char *ratelimit_list[] = {
 
 static long long epoch;
 
+/*
+ * tst_timer.h can not be used here, its kernel time types conflict with
+ * linux/time_types.h which is included by linux/io_uring.h.
+ */
+static long long timespec_to_us(const struct timespec t)
+{
+	return t.tv_sec * 1000000LL + t.tv_nsec / 1000;
+}
+
 static int atomic_timestamp(void)
 {
 	struct timespec now;
 
 	SAFE_CLOCK_GETTIME(CLOCK_MONOTONIC_RAW, &now);
 
-	return tst_timespec_to_us(now) - epoch;
+	return timespec_to_us(now) - epoch;
 }
 
-static int queue_pop(struct queue *q)
+static void deque_init(struct deque *dq)
 {
-	int i = q->front, j = 0;
+	pthread_mutexattr_t attr;
 
-	sem_wait(&q->sem);
+	SAFE_PTHREAD_MUTEXATTR_INIT(&attr);
 
-	if (!q->data[i])
-		return 0;
+	TEST(pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED));
+	if (TST_RET)
+		tst_brk(TBROK | TRERRNO, "pthread_mutexattr_setpshared()");
 
-	while (q->data[i]) {
-		q->popped[j] = q->data[i];
+	TEST(pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST));
+	if (TST_RET)
+		tst_brk(TBROK | TRERRNO, "pthread_mutexattr_setrobust()");
 
-		if (++j >= BUFFER_SIZE - 1)
-			tst_brk(TBROK, "Buffer is too small for path");
+	SAFE_PTHREAD_MUTEX_INIT(&dq->mutex, &attr);
+	SAFE_PTHREAD_MUTEXATTR_DESTROY(&attr);
+}
 
-		 i = (i + 1) % QUEUE_SIZE;
-	}
+static void deque_lock(struct deque *dq)
+{
+	int ret = pthread_mutex_lock(&dq->mutex);
 
-	q->popped[j] = '\0';
-	tst_atomic_store((i + 1) % QUEUE_SIZE, &q->front);
+	if (ret == EOWNERDEAD)
+		ret = pthread_mutex_consistent(&dq->mutex);
 
-	return 1;
+	if (ret)
+		tst_brk(TBROK, "pthread_mutex_lock(): %s", tst_strerrno(ret));
 }
 
-static int queue_push(struct queue *q, const char *buf)
+static int deque_push(struct deque *dq, enum work_type type, long loc,
+		      const char *path)
 {
-	int i = q->back, j = 0;
-	int front = tst_atomic_load(&q->front);
+	size_t len = strlen(path);
+	struct work *w;
 
-	do {
-		q->data[i] = buf[j];
+	if (len >= BUFFER_SIZE)
+		return 0;
 
-		i = (i + 1) % QUEUE_SIZE;
+	deque_lock(dq);
 
-		if (i == front)
-			return 0;
+	if (dq->bottom - dq->top >= DEQUE_SIZE) {
+		SAFE_PTHREAD_MUTEX_UNLOCK(&dq->mutex);
+		return 0;
+	}
 
-	} while (buf[j++]);
+	w = &dq->items[dq->bottom % DEQUE_SIZE];
+	w->type = type;
+	w->loc = loc;
+	memcpy(w->path, path, len + 1);
+	dq->bottom++;
 
-	q->back = i;
-	sem_post(&q->sem);
+	SAFE_PTHREAD_MUTEX_UNLOCK(&dq->mutex);
 
 	return 1;
 }
 
-static struct queue *queue_init(void)
+/*
+ * Moves a work item from the bottom of the deque, or from the top when
+ * stealing, to the worker and marks the worker busy.
+ */
+static int deque_take(struct deque *dq, struct worker *self, int steal)
 {
-	struct queue *q = SAFE_MMAP(NULL, sizeof(*q),
-				    PROT_READ | PROT_WRITE,
-				    MAP_SHARED | MAP_ANONYMOUS,
-				    0, 0);
+	struct work *w;
 
-	sem_init(&q->sem, 1, 0);
-	q->front = 0;
-	q->back = 0;
+	deque_lock(dq);
 
-	return q;
-}
+	if (dq->top == dq->bottom) {
+		SAFE_PTHREAD_MUTEX_UNLOCK(&dq->mutex);
+		return 0;
+	}
 
-static void queue_destroy(struct queue *q, int is_worker)
-{
-	if (is_worker)
-		sem_destroy(&q->sem);
+	w = &dq->items[(steal ? dq->top : dq->bottom - 1) % DEQUE_SIZE];
+	self->work.type = w->type;
+	self->work.loc = w->loc;
+	strcpy(self->work.path, w->path);
+	tst_atomic_store(WORKER_ITEM, &self->busy);
+	tst_atomic_inc(&self->taken);
+
+	if (steal)
+		dq->top++;
+	else
+		dq->bottom--;
 
-	SAFE_MUNMAP(q, sizeof(*q));
+	SAFE_PTHREAD_MUTEX_UNLOCK(&dq->mutex);
+
+	return 1;
 }
 
 static void sanitize_str(char *buf, ssize_t count)
@@ -255,318 +416,1097 @@ static int worker_ttl(const int worker)
 	return MAX(0, worker_timeout - worker_elapsed(worker));
 }
 
-static void read_test(const int worker, const char *const path)
+static unsigned int lat_bucket(int us)
 {
-	char buf[BUFFER_SIZE];
-	int fd;
-	ssize_t count;
-	const pid_t pid = workers[worker].pid;
-	int elapsed;
-
-	if (is_blacklisted(path))
-		return;
-
-	if (verbose)
-		tst_res(TINFO, "Worker %d: %s(%s)", pid, __func__, path);
-
-	fd = open(path, O_RDONLY | O_NONBLOCK);
-	if (fd < 0) {
-		if (!quiet) {
-			tst_res(TINFO | TERRNO, "Worker %d (%d): open(%s)",
-				pid, worker, path);
-		}
-		return;
-	}
-
-	worker_heartbeat(worker);
-	count = read(fd, buf, sizeof(buf) - 1);
-	elapsed = worker_elapsed(worker);
+	unsigned int i = 0;
 
-	if (count > 0 && verbose) {
-		sanitize_str(buf, count);
-		tst_res(TINFO,
-			"Worker %d (%d): read(%s, buf) = %zi, buf = %s, elapsed = %dus",
-			pid, worker, path, count, buf, elapsed);
-	} else if (!count && verbose) {
-		tst_res(TINFO,
-			"Worker %d (%d): read(%s) = EOF, elapsed = %dus",
-			pid, worker, path, elapsed);
-	} else if (count < 0 && !quiet) {
-		tst_res(TINFO | TERRNO,
-			"Worker %d (%d): read(%s), elapsed = %dus",
-			pid, worker, path, elapsed);
+	while (us > 0 && i < LAT_BUCKETS - 1) {
+		us >>= 1;
+		i++;
 	}
 
-	SAFE_CLOSE(fd);
+	return i;
 }
 
-static void maybe_drop_privs(void)
+/*
+ * Returns the first path component under the root directory. Names made of
+ * digits only, e.g. the /proc PIDs, are merged into a single pattern and the
+ * files directly in the root directory are accounted to ".".
+ */
+static void top_dir_name(const char *path, char *name)
 {
-	struct passwd *nobody;
+	const char *p = path + strlen(root_dir);
+	size_t len;
 
-	if (!drop_privs)
-		return;
+	while (*p == '/')
+		p++;
 
-	TEST(setgroups(0, NULL));
-	if (TST_RET < 0 && TST_ERR != EPERM) {
-		tst_brk(TBROK | TTERRNO,
-			"Failed to clear suplementary group set");
-	}
+	len = strcspn(p, "/");
 
-	nobody = SAFE_GETPWNAM("nobody");
+	if (!p[len]) {
+		strcpy(name, ".");
+		return;
+	}
 
-	TEST(setgid(nobody->pw_gid));
-	if (TST_RET < 0 && TST_ERR != EPERM)
-		tst_brk(TBROK | TTERRNO, "Failed to use nobody gid");
+	if (strspn(p, "0123456789") >= len) {
+		strcpy(name, "[0-9]*");
+		return;
+	}
 
-	TEST(setuid(nobody->pw_uid));
-	if (TST_RET < 0 && TST_ERR != EPERM)
-		tst_brk(TBROK | TTERRNO, "Failed to use nobody uid");
+	len = MIN(len, (size_t)NAME_MAX);
+	memcpy(name, p, len);
+	name[len] = '\0';
 }
 
-static int worker_run(int worker)
+/* Once the table is full the remaining directories are merged into "*" */
+static struct dir_stat *dir_stat_get(struct read_stats *st, const char *name)
 {
-	struct sigaction term_sa = {
-		.sa_handler = SIG_IGN,
-		.sa_flags = 0,
-	};
-	struct worker *const self = workers + worker;
-	struct queue *q = self->q;
-
-	sigaction(SIGTTIN, &term_sa, NULL);
-	maybe_drop_privs();
-	self->pid = getpid();
-
-	if (!worker_ttl(self->i)) {
-		tst_brk(TBROK,
-			"Worker timeout is too short; restarts take >%dus",
-			worker_elapsed(self->i));
-	}
-
-	while (1) {
-		worker_heartbeat(worker);
+	struct dir_stat *d;
+	unsigned int i;
 
-		if (!queue_pop(q))
-			break;
-
-		read_test(worker, q->popped);
+	for (i = 0; i < st->dirs_cnt; i++) {
+		if (!strcmp(st->dirs[i].name, name))
+			return &st->dirs[i];
 	}
 
-	queue_destroy(q, 1);
-	tst_flush();
-	return 0;
-}
-
-static void spawn_workers(void)
-{
-	int i;
-	struct worker *wa = workers;
+	if (st->dirs_cnt >= TOP_DIRS - 1 && strcmp(name, "*"))
+		return dir_stat_get(st, "*");
 
-	memset(workers, 0, worker_count * sizeof(*workers));
+	d = &st->dirs[st->dirs_cnt++];
+	memset(d, 0, sizeof(*d));
+	strcpy(d->name, name);
 
-	for (i = 0; i < worker_count; i++) {
-		wa[i].i = i;
-		wa[i].q = queue_init();
-		wa[i].last_seen = atomic_timestamp();
-		wa[i].pid = SAFE_FORK();
-		if (!wa[i].pid)
-			exit(worker_run(i));
-	}
+	return d;
 }
 
-static void restart_worker(const int worker)
+static void slow_file_add(struct read_stats *st, const char *path, int us)
 {
-	struct worker *const w = workers + worker;
-	int wstatus, ret, i, q_len;
-
-	if (!w->kill_sent) {
-		SAFE_KILL(w->pid, SIGKILL);
-		w->kill_sent = 1;
-		worker_heartbeat(worker);
-	}
-
-	ret = waitpid(w->pid, &wstatus, WNOHANG);
+	unsigned int i, min = 0;
 
-	if (!ret) {
-		if (worker_ttl(worker) > 0)
-			return;
+	if (st->slow_cnt == SLOW_FILES && us <= st->slow_min_us)
+		return;
 
-		if (!quiet || timeout_warnings_left) {
-			tst_res(TINFO,
-				"Worker %d (%d): Timeout waiting after kill",
-				w->pid, worker);
-		}
-	} else if (ret != w->pid) {
-		tst_brk(TBROK | TERRNO, "Worker %d (%d): waitpid = %d",
-			w->pid, worker, ret);
+	for (i = 0; i < st->slow_cnt; i++) {
+		if (!strcmp(st->slow[i].path, path))
+			break;
 	}
 
-	w->kill_sent = 0;
-
-	if (!w->q->popped[0]) {
-		tst_brk(TBROK,
-			"Worker %d (%d): Timed out, but doesn't appear to be reading anything",
-			w->pid, worker);
-	}
+	if (i < st->slow_cnt) {
+		st->slow[i].us = MAX(st->slow[i].us, us);
+	} else {
+		if (st->slow_cnt < SLOW_FILES)
+			i = st->slow_cnt++;
+		else
+			for (i = 0; st->slow[i].us != st->slow_min_us; i++)
+				;
 
-	if (!quiet || timeout_warnings_left) {
-		tst_res(TINFO, "Worker %d (%d): Last popped '%s'",
-			w->pid, worker, w->q->popped);
+		st->slow[i].us = us;
+		snprintf(st->slow[i].path, BUFFER_SIZE, "%s", path);
 	}
 
-	/* Make sure the queue length and semaphore match. Threre is a
-	 * race in qeue_pop where the semaphore can be decremented
-	 * then the worker killed before updating q->front
-	 */
-	q_len = 0;
-	i = w->q->front;
-	while (i != w->q->back) {
-		if (!w->q->data[i])
-			q_len++;
-
-		i = (i + 1) % QUEUE_SIZE;
+	for (i = 1; i < st->slow_cnt; i++) {
+		if (st->slow[i].us < st->slow[min].us)
+			min = i;
 	}
 
-	ret = sem_destroy(&w->q->sem);
-	if (ret == -1)
-		tst_brk(TBROK | TERRNO, "sem_destroy");
-	ret = sem_init(&w->q->sem, 1, q_len);
-	if (ret == -1)
-		tst_brk(TBROK | TERRNO, "sem_init");
-
-	worker_heartbeat(worker);
-	w->pid = SAFE_FORK();
-
-	if (!w->pid)
-		exit(worker_run(worker));
+	st->slow_min_us = st->slow[min].us;
 }
 
-static void check_timeout_warnings_limit(void)
+static void record_latency(struct read_stats *st, const char *path, int us)
 {
-	if (!quiet)
-		return;
+	char name[NAME_MAX + 1];
+	struct dir_stat *d;
 
-	timeout_warnings_left--;
+	top_dir_name(path, name);
+	d = dir_stat_get(st, name);
 
-	if (timeout_warnings_left)
-		return;
+	d->reads++;
+	d->total_us += us;
+	d->max_us = MAX(d->max_us, us);
+	d->hist[lat_bucket(us)]++;
 
-	tst_res(TINFO,
-		"Silencing timeout warnings; consider increasing LTP_RUNTIME_MUL or removing -q");
+	slow_file_add(st, path, us);
 }
 
-static int try_push_work(const int worker, const char *buf)
+/*
+ * Queues work on the worker's deque, any worker may push to any deque. Returns
+ * zero if the deque is full and the caller has to do the work right away.
+ */
+static int queue_work(const int worker, enum work_type type, long loc,
+		      const char *path)
 {
-	int ret = 0;
-	int elapsed;
-	struct worker *const w = workers + worker;
-
-	if (w->kill_sent) {
-		restart_worker(worker);
-		return 0;
-	}
+	tst_atomic_inc(&pool->queued);
 
-	ret = queue_push(w->q, buf);
-	if (ret)
+	if (deque_push(&workers[worker].deque, type, loc, path))
 		return 1;
 
-	elapsed = worker_elapsed(worker);
-
-	if (elapsed > worker_timeout) {
-		if (!quiet || timeout_warnings_left) {
-			tst_res(TINFO,
-				"Worker %d (%d): Stuck for %dus, restarting it",
-				w->pid, worker, elapsed);
-			check_timeout_warnings_limit();
-		}
-		restart_worker(worker);
-	}
+	tst_atomic_dec(&pool->queued);
 
 	return 0;
 }
 
-static void push_work(const int worker, const char *buf)
+/* Finishes the work item the worker processes */
+static void work_done(struct worker *const w)
 {
-	int sleep_time = 1;
-
-	while (!try_push_work(worker, buf)) {
-		const int ttl = worker_ttl(worker);
+	tst_atomic_inc(&w->done);
+	tst_atomic_store(WORKER_IDLE, &w->busy);
+}
 
-		sleep_time = MIN(2 * sleep_time, ttl);
-		usleep(sleep_time);
-	}
+/*
+ * Finishes all items taken by a killed worker. Storing the taken count is
+ * idempotent, unlike incrementing the done count.
+ */
+static void work_abandon(struct worker *const w)
+{
+	tst_atomic_store(tst_atomic_load(&w->taken), &w->done);
+	tst_atomic_store(WORKER_IDLE, &w->busy);
 }
 
-static void stop_workers(void)
+/*
+ * The finished counts are read before the queued count, so the result can
+ * only overestimate the work left. New work is queued only by a work item
+ * in progress, so once there is none left there will be no more.
+ */
+static int work_left(void)
 {
-	const char stop_code[1] = { '\0' };
-	int i;
+	int i, done = 0;
 
-	if (!workers)
-		return;
+	for (i = 0; i < worker_count; i++)
+		done += tst_atomic_load(&workers[i].done);
 
-	for (i = 0; i < worker_count; i++) {
-		if (workers[i].q)
-			push_work(i, stop_code);
-	}
+	return tst_atomic_load(&pool->queued) - done > 0;
 }
 
-static void destroy_workers(void)
+static int take_work(const int worker)
 {
+	struct worker *const self = workers + worker;
 	int i;
 
-	if (!workers)
-		return;
+	if (deque_take(&self->deque, self, 0))
+		return 1;
 
-	for (i = 0; i < worker_count; i++) {
-		if (workers[i].q) {
-			queue_destroy(workers[i].q, 0);
-			workers[i].q = 0;
-		}
+	for (i = 1; i < worker_count; i++) {
+		if (deque_take(&workers[(worker + i) % worker_count].deque,
+			       self, 1))
+			return 1;
 	}
+
+	return 0;
 }
 
-static int sched_work(const int first_worker,
-		      const char *path, int repetitions)
+static void report_read(const int worker, const char *const path, char *buf,
+			ssize_t count, int err, int elapsed)
 {
-	int i, j;
-	int min_ttl = worker_timeout, sleep_time = 1;
-	int pushed, workers_pushed = 0;
-
-	if (is_ratelimitted(path))
-		repetitions = 1;
-
-	for (i = 0, j = first_worker; i < repetitions; j++) {
-		if (j >= worker_count)
-			j = 0;
-
-		if (j == first_worker && !workers_pushed) {
-			sleep_time = MIN(2 * sleep_time, min_ttl);
-			usleep(sleep_time);
-			min_ttl = worker_timeout;
-		}
-
-		if (j == first_worker)
-			workers_pushed = 0;
-
-		pushed = try_push_work(j, path);
-		i += pushed;
-		workers_pushed += pushed;
+	const pid_t pid = workers[worker].pid;
 
-		if (!pushed)
-			min_ttl = MIN(min_ttl, worker_ttl(j));
+	if (count > 0 && verbose) {
+		sanitize_str(buf, count);
+		tst_res(TINFO,
+			"Worker %d (%d): read(%s, buf) = %zi, buf = %s, elapsed = %dus",
+			pid, worker, path, count, buf, elapsed);
+	} else if (!count && verbose) {
+		tst_res(TINFO,
+			"Worker %d (%d): read(%s) = EOF, elapsed = %dus",
+			pid, worker, path, elapsed);
+	} else if (count < 0 && !quiet) {
+		errno = err;
+		tst_res(TINFO | TERRNO,
+			"Worker %d (%d): read(%s), elapsed = %dus",
+			pid, worker, path, elapsed);
 	}
-
-	return j;
 }
 
-static void setup(void)
+static void read_test(const int worker, const int dir_fd, const char *name,
+		      const char *const path)
 {
-	struct timespec now;
+	char buf[BUFFER_SIZE];
+	int fd;
+	ssize_t count;
+	const pid_t pid = workers[worker].pid;
+	int elapsed, start;
 
-	if (tst_parse_int(str_reads, &reads, 1, INT_MAX))
-		tst_brk(TBROK,
-			"Invalid reads (-r) argument: '%s'", str_reads);
+	if (verbose)
+		tst_res(TINFO, "Worker %d: %s(%s)", pid, __func__, path);
+
+	snprintf(workers[worker].path, BUFFER_SIZE, "%s", path);
+
+	start = atomic_timestamp();
+	fd = openat(dir_fd, name, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		if (!quiet) {
+			tst_res(TINFO | TERRNO, "Worker %d (%d): open(%s)",
+				pid, worker, path);
+		}
+		return;
+	}
+
+	worker_heartbeat(worker);
+	count = read(fd, buf, sizeof(buf) - 1);
+	elapsed = worker_elapsed(worker);
+
+	report_read(worker, path, buf, count, errno, elapsed);
+
+	SAFE_CLOSE(fd);
+
+	record_latency(&workers[worker].stats, path, atomic_timestamp() - start);
+}
+
+#ifdef IORING_FILE_INDEX_ALLOC
+
+enum uring_op {
+	URING_OPEN,
+	URING_READ,
+	URING_CLOSE,
+	URING_OPS,
+};
+
+/*
+ * The completion state of a read in flight, the index is used as the file and
+ * buffer slot and the path is in struct worker inflight.
+ */
+struct uring_read {
+	unsigned int done;
+	int res[URING_OPS];
+};
+
+static struct tst_io_uring uring;
+static struct uring_read *uring_reads;
+static char *uring_bufs;
+static unsigned int uring_free[URING_DEPTH];
+static unsigned int uring_free_cnt;
+static unsigned int uring_to_submit;
+/* The slots queued since the last io_uring_enter() */
+static unsigned int uring_pending[URING_DEPTH];
+static unsigned int uring_pending_cnt;
+
+static int uring_register_files(void)
+{
+	int i, fds[URING_DEPTH];
+
+	for (i = 0; i < URING_DEPTH; i++)
+		fds[i] = -1;
+
+	return syscall(__NR_io_uring_register, uring.fd,
+		       IORING_REGISTER_FILES, fds, URING_DEPTH);
+}
+
+static struct io_uring_sqe *uring_get_sqe(void)
+{
+	uint32_t tail = *uring.sqr_tail;
+	uint32_t idx = tail & *uring.sqr_mask;
+	struct io_uring_sqe *sqe = &uring.sqr_entries[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	uring.sqr_array[idx] = idx;
+
+	tail++;
+	__atomic_store(uring.sqr_tail, &tail, __ATOMIC_RELEASE);
+	uring_to_submit++;
+
+	return sqe;
+}
+
+/*
+ * Checks that io_uring can be used and supports opening files directly into
+ * the registered file table, the read and close are linked to the open with
+ * the table slot. Older kernels ignore the slot and return a normal fd.
+ */
+static int uring_probe(void)
+{
+	const char *disabled_path = "/proc/sys/kernel/io_uring_disabled";
+	struct io_uring_params params = {};
+	const struct io_uring_cqe *cqe;
+	struct io_uring_sqe *sqe;
+	int fd, res, disabled = 0;
+
+	if (!access(disabled_path, F_OK))
+		SAFE_FILE_SCANF(disabled_path, "%d", &disabled);
+
+	if (disabled == 2 || (disabled == 1 && drop_privs)) {
+		tst_res(TINFO, "io_uring is disabled by %s", disabled_path);
+		return 0;
+	}
+
+	fd = syscall(__NR_io_uring_setup, URING_DEPTH, &params);
+	if (fd < 0) {
+		tst_res(TINFO | TERRNO, "io_uring_setup()");
+		return 0;
+	}
+	SAFE_CLOSE(fd);
+
+	memset(&params, 0, sizeof(params));
+	SAFE_IO_URING_INIT(URING_DEPTH, &params, &uring);
+
+	if (uring_register_files()) {
+		tst_res(TINFO | TERRNO, "io_uring_register(IORING_REGISTER_FILES)");
+		SAFE_IO_URING_CLOSE(&uring);
+		return 0;
+	}
+
+	sqe = uring_get_sqe();
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uintptr_t)root_dir;
+	sqe->open_flags = O_RDONLY | O_DIRECTORY;
+	sqe->file_index = 1;
+
+	SAFE_IO_URING_ENTER(1, uring.fd, uring_to_submit, 1,
+			    IORING_ENTER_GETEVENTS, NULL);
+	uring_to_submit = 0;
+
+	cqe = &uring.cqr_entries[*uring.cqr_head & *uring.cqr_mask];
+	res = cqe->res;
+
+	if (res > 0)
+		SAFE_CLOSE(res);
+
+	SAFE_IO_URING_CLOSE(&uring);
+
+	if (res) {
+		tst_res(TINFO, "io_uring does not support direct descriptors");
+		return 0;
+	}
+
+	return 1;
+}
+
+static void uring_init(const int worker)
+{
+	struct inflight_read *const inflight = workers[worker].inflight;
+	struct io_uring_params params = {};
+	struct iovec iov[URING_DEPTH];
+	unsigned int i;
+
+	SAFE_IO_URING_INIT(URING_OPS * URING_DEPTH, &params, &uring);
+
+	if (uring_register_files())
+		tst_brk(TBROK | TERRNO, "io_uring_register(IORING_REGISTER_FILES)");
+
+	uring_reads = SAFE_MALLOC(URING_DEPTH * sizeof(*uring_reads));
+	uring_bufs = SAFE_MALLOC(URING_DEPTH * BUFFER_SIZE);
+
+	for (i = 0; i < URING_DEPTH; i++) {
+		iov[i].iov_base = uring_bufs + i * BUFFER_SIZE;
+		iov[i].iov_len = BUFFER_SIZE;
+		uring_reads[i].done = 0;
+		uring_free[i] = i;
+		inflight[i].path[0] = '\0';
+	}
+
+	uring_free_cnt = URING_DEPTH;
+	uring_pending_cnt = 0;
+
+	if (syscall(__NR_io_uring_register, uring.fd, IORING_REGISTER_BUFFERS,
+		    iov, URING_DEPTH))
+		tst_brk(TBROK | TERRNO, "io_uring_register(IORING_REGISTER_BUFFERS)");
+}
+
+static void uring_release(const int worker, const unsigned int slot)
+{
+	struct inflight_read *const in = &workers[worker].inflight[slot];
+
+	uring_reads[slot].done = 0;
+	uring_free[uring_free_cnt++] = slot;
+	in->path[0] = '\0';
+
+	if (in->item)
+		tst_atomic_inc(&workers[worker].done);
+}
+
+static void uring_complete(const int worker, const unsigned int slot,
+			   const int now)
+{
+	struct uring_read *r = &uring_reads[slot];
+	struct inflight_read *const in = &workers[worker].inflight[slot];
+	int count = r->res[URING_READ];
+	int elapsed = now - in->start;
+
+	if (r->res[URING_OPEN] < 0) {
+		if (!quiet) {
+			errno = -r->res[URING_OPEN];
+			tst_res(TINFO | TERRNO, "Worker %d (%d): open(%s)",
+				workers[worker].pid, worker, in->path);
+		}
+		uring_release(worker, slot);
+		return;
+	}
+
+	report_read(worker, in->path, uring_bufs + slot * BUFFER_SIZE,
+		    count < 0 ? -1 : count, -count, elapsed);
+
+	if (r->res[URING_CLOSE] < 0) {
+		tst_brk(TBROK, "close(%s): %s", in->path,
+			tst_strerrno(-r->res[URING_CLOSE]));
+	}
+
+	record_latency(&workers[worker].stats, in->path, elapsed);
+	uring_release(worker, slot);
+}
+
+/*
+ * Processes the completions without entering the kernel. The reads are timed
+ * from their submission until their completion is seen here, so this is also
+ * done for each queued read to keep the completions from waiting in the ring.
+ */
+static void uring_reap(const int worker)
+{
+	const struct io_uring_cqe *cqe;
+	struct uring_read *r;
+	uint32_t head, tail;
+	int now;
+
+	head = *uring.cqr_head;
+	__atomic_load(uring.cqr_tail, &tail, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return;
+
+	now = atomic_timestamp();
+
+	for (; head != tail; head++) {
+		cqe = &uring.cqr_entries[head & *uring.cqr_mask];
+		r = &uring_reads[cqe->user_data / URING_OPS];
+		r->res[cqe->user_data % URING_OPS] = cqe->res;
+
+		if (++r->done == URING_OPS)
+			uring_complete(worker, cqe->user_data / URING_OPS, now);
+	}
+
+	__atomic_store(uring.cqr_head, &head, __ATOMIC_RELEASE);
+}
+
+/* Submits the queued requests and waits for min_complete completions */
+static void uring_wait(const int worker, unsigned int min_complete)
+{
+	struct worker *const self = workers + worker;
+	int now = atomic_timestamp();
+	unsigned int i;
+
+	for (i = 0; i < uring_pending_cnt; i++)
+		self->inflight[uring_pending[i]].start = now;
+
+	uring_pending_cnt = 0;
+
+	self->in_uring = 1;
+	SAFE_IO_URING_ENTER(1, uring.fd, uring_to_submit, min_complete,
+			    min_complete ? IORING_ENTER_GETEVENTS : 0, NULL);
+	self->in_uring = 0;
+
+	uring_to_submit = 0;
+	worker_heartbeat(worker);
+
+	uring_reap(worker);
+}
+
+static unsigned int uring_inflight(void)
+{
+	return URING_DEPTH - uring_free_cnt;
+}
+
+/*
+ * The open is relative to dir_fd, which has to stay open until the request
+ * is completed, see uring_flush(). Returns zero if the read was queued, a
+ * work item is then finished when the read completes.
+ */
+static int uring_queue_read(const int worker, const int dir_fd,
+			    const char *name, const char *const path,
+			    const int item)
+{
+	struct io_uring_sqe *sqe;
+	struct inflight_read *in;
+	size_t len = strlen(path);
+	unsigned int slot;
+
+	if (len >= BUFFER_SIZE) {
+		read_test(worker, dir_fd, name, path);
+		return 1;
+	}
+
+	uring_reap(worker);
+
+	while (!uring_free_cnt)
+		uring_wait(worker, 1);
+
+	slot = uring_free[--uring_free_cnt];
+	in = &workers[worker].inflight[slot];
+	in->start = -1;
+	in->item = item;
+	memcpy(in->path, path, len + 1);
+	uring_pending[uring_pending_cnt++] = slot;
+
+	sqe = uring_get_sqe();
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->flags = IOSQE_IO_LINK;
+	sqe->fd = dir_fd;
+	sqe->addr = (uintptr_t)(in->path + len - strlen(name));
+	sqe->open_flags = O_RDONLY | O_NONBLOCK;
+	sqe->file_index = slot + 1;
+	sqe->user_data = slot * URING_OPS + URING_OPEN;
+
+	/* The close has to be done even if the read fails */
+	sqe = uring_get_sqe();
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+	sqe->fd = slot;
+	sqe->addr = (uintptr_t)(uring_bufs + slot * BUFFER_SIZE);
+	sqe->len = BUFFER_SIZE - 1;
+	sqe->buf_index = slot;
+	sqe->user_data = slot * URING_OPS + URING_READ;
+
+	sqe = uring_get_sqe();
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->file_index = slot + 1;
+	sqe->user_data = slot * URING_OPS + URING_CLOSE;
+
+	/*
+	 * The reads in flight wait for each other and for the CPU, so for the
+	 * latency report each read is waited for right away, otherwise the
+	 * slowest files would be the ones queued behind the others.
+	 */
+	if (report_path)
+		uring_wait(worker, URING_OPS);
+	else if (uring_to_submit >= URING_OPS * URING_BATCH)
+		uring_wait(worker, 0);
+
+	return 0;
+}
+
+static void uring_flush(const int worker)
+{
+	while (uring_inflight())
+		uring_wait(worker, 1);
+}
+
+#else
+
+static int uring_probe(void)
+{
+	tst_res(TINFO, "io_uring direct descriptors are not supported by the system headers");
+	return 0;
+}
+
+static void uring_init(const int worker LTP_ATTRIBUTE_UNUSED) {}
+
+static unsigned int uring_inflight(void)
+{
+	return 0;
+}
+
+static int uring_queue_read(const int worker LTP_ATTRIBUTE_UNUSED,
+			    const int dir_fd LTP_ATTRIBUTE_UNUSED,
+			    const char *name LTP_ATTRIBUTE_UNUSED,
+			    const char *const path LTP_ATTRIBUTE_UNUSED,
+			    const int item LTP_ATTRIBUTE_UNUSED)
+{
+	return 1;
+}
+
+static void uring_flush(const int worker LTP_ATTRIBUTE_UNUSED) {}
+
+#endif /* IORING_FILE_INDEX_ALLOC */
+
+/*
+ * Returns zero if the read was queued to io_uring and the work item is
+ * finished on its completion.
+ */
+static int read_one(const int worker, const int dir_fd, const char *name,
+		    const char *const path, const int item)
+{
+	if (uring_enabled)
+		return uring_queue_read(worker, dir_fd, name, path, item);
+
+	read_test(worker, dir_fd, name, path);
+
+	return 1;
+}
+
+/*
+ * The worker which found the file reads it, the additional reads are queued
+ * to the following workers so that the file is accessed in parallel.
+ */
+static void read_file(const int worker, const int dir_fd, const char *name,
+		      const char *const path)
+{
+	int i, repetitions = reads;
+
+	if (is_blacklisted(path))
+		return;
+
+	if (is_ratelimitted(path))
+		repetitions = 1;
+
+	for (i = 1; i < repetitions; i++) {
+		if (!queue_work((worker + i) % worker_count, WORK_READ, 0,
+				path))
+			read_one(worker, dir_fd, name, path, 0);
+	}
+
+	read_one(worker, dir_fd, name, path, 0);
+}
+
+/*
+ * Records the visit so that it can be resumed if the worker is killed. The
+ * paths which do not fit are not recorded and the rest of such a visit is
+ * lost on a kill.
+ */
+static struct visit *visit_push(struct worker *const self, const char *path,
+				long loc)
+{
+	struct visit *v;
+
+	if (self->visit_depth++ >= VISIT_DEPTH)
+		return NULL;
+
+	v = &self->visits[self->visit_depth - 1];
+	v->loc = loc;
+
+	if (strlen(path) >= BUFFER_SIZE)
+		v->path[0] = '\0';
+	else
+		strcpy(v->path, path);
+
+	return v;
+}
+
+static void visit_dir(const int worker, const int dir_fd, const char *name,
+		      const char *const path, long loc)
+{
+	struct worker *const self = workers + worker;
+	DIR *dir;
+	struct dirent *dent;
+	struct stat dent_st;
+	char dent_path[MAX_PATH];
+	enum dent_action act;
+	struct visit *v;
+	int fd;
+
+	snprintf(self->path, BUFFER_SIZE, "%s", path);
+
+	fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
+		tst_res(TINFO | TERRNO, "opendir(%s)", path);
+		return;
+	}
+
+	dir = fdopendir(fd);
+	if (!dir) {
+		tst_res(TINFO | TERRNO, "fdopendir(%s)", path);
+		SAFE_CLOSE(fd);
+		return;
+	}
+
+	if (loc)
+		seekdir(dir, loc);
+
+	v = visit_push(self, path, loc);
+
+	while (1) {
+		worker_heartbeat(worker);
+
+		self->in_readdir = 1;
+		errno = 0;
+		dent = readdir(dir);
+		self->in_readdir = 0;
+
+		if (dent && v)
+			v->loc = telldir(dir);
+
+		if (!dent && errno) {
+			tst_res(TINFO | TERRNO, "readdir(%s)", path);
+			break;
+		} else if (!dent) {
+			break;
+		}
+
+		if (!strcmp(dent->d_name, ".") ||
+		    !strcmp(dent->d_name, ".."))
+			continue;
+
+		if (dent->d_type == DT_DIR)
+			act = DA_VISIT;
+		else if (dent->d_type == DT_LNK)
+			act = DA_IGNORE;
+		else if (dent->d_type == DT_UNKNOWN)
+			act = DA_UNKNOWN;
+		else
+			act = DA_READ;
+
+		snprintf(dent_path, MAX_PATH,
+			 "%s/%s", path, dent->d_name);
+
+		if (act == DA_UNKNOWN) {
+			if (fstatat(fd, dent->d_name, &dent_st,
+				    AT_SYMLINK_NOFOLLOW))
+				tst_res(TINFO | TERRNO, "lstat(%s)", dent_path);
+			else if ((dent_st.st_mode & S_IFMT) == S_IFDIR)
+				act = DA_VISIT;
+			else if ((dent_st.st_mode & S_IFMT) == S_IFLNK)
+				act = DA_IGNORE;
+			else
+				act = DA_READ;
+		}
+
+		/*
+		 * The subdirectories are queued so that idle workers can steal
+		 * them, when the deque is full we descend right away.
+		 */
+		if (act == DA_VISIT) {
+			if (!queue_work(worker, WORK_VISIT, 0, dent_path))
+				visit_dir(worker, fd, dent->d_name, dent_path, 0);
+		} else if (act == DA_READ) {
+			read_file(worker, fd, dent->d_name, dent_path);
+		}
+	}
+
+	if (uring_enabled)
+		uring_flush(worker);
+
+	self->visit_depth--;
+
+	if (closedir(dir))
+		tst_res(TINFO | TERRNO, "closedir(%s)", path);
+}
+
+/* Returns zero if the item is finished later, see read_one() */
+static int do_work(const int worker)
+{
+	struct work *const w = &workers[worker].work;
+
+	if (w->type == WORK_READ)
+		return read_one(worker, AT_FDCWD, w->path, w->path, 1);
+
+	visit_dir(worker, AT_FDCWD, w->path, w->path, w->loc);
+
+	return 1;
+}
+
+static void maybe_drop_privs(void)
+{
+	struct passwd *nobody;
+
+	if (!drop_privs)
+		return;
+
+	TEST(setgroups(0, NULL));
+	if (TST_RET < 0 && TST_ERR != EPERM) {
+		tst_brk(TBROK | TTERRNO,
+			"Failed to clear suplementary group set");
+	}
+
+	nobody = SAFE_GETPWNAM("nobody");
+
+	TEST(setgid(nobody->pw_gid));
+	if (TST_RET < 0 && TST_ERR != EPERM)
+		tst_brk(TBROK | TTERRNO, "Failed to use nobody gid");
+
+	TEST(setuid(nobody->pw_uid));
+	if (TST_RET < 0 && TST_ERR != EPERM)
+		tst_brk(TBROK | TTERRNO, "Failed to use nobody uid");
+}
+
+static int worker_run(int worker)
+{
+	struct sigaction term_sa = {
+		.sa_handler = SIG_IGN,
+		.sa_flags = 0,
+	};
+	struct worker *const self = workers + worker;
+	int sleep_time = 1;
+
+	sigaction(SIGTTIN, &term_sa, NULL);
+	maybe_drop_privs();
+	self->pid = getpid();
+
+	if (uring_enabled)
+		uring_init(worker);
+
+	if (!worker_ttl(self->i)) {
+		tst_brk(TBROK,
+			"Worker timeout is too short; restarts take >%dus",
+			worker_elapsed(self->i));
+	}
+
+	while (!tst_atomic_load(&pool->stop)) {
+		worker_heartbeat(worker);
+
+		if (take_work(worker)) {
+			if (do_work(worker))
+				work_done(self);
+			else
+				tst_atomic_store(WORKER_IDLE, &self->busy);
+			sleep_time = 1;
+			continue;
+		}
+
+		/* The reads of the stolen items are not waited for in do_work() */
+		if (uring_enabled && uring_inflight()) {
+			tst_atomic_store(WORKER_FLUSH, &self->busy);
+			uring_flush(worker);
+			tst_atomic_store(WORKER_IDLE, &self->busy);
+			continue;
+		}
+
+		if (!work_left())
+			break;
+
+		usleep(sleep_time);
+		sleep_time = MIN(2 * sleep_time, 1000);
+	}
+
+	tst_flush();
+	return 0;
+}
+
+static void spawn_workers(void)
+{
+	int i;
+	struct worker *wa = workers;
+
+	pool->queued = 0;
+	pool->stop = 0;
+
+	for (i = 0; i < worker_count; i++) {
+		wa[i].i = i;
+		wa[i].busy = WORKER_IDLE;
+		wa[i].taken = 0;
+		wa[i].done = 0;
+		wa[i].visit_depth = 0;
+		wa[i].in_uring = 0;
+		memset(wa[i].inflight, 0, sizeof(wa[i].inflight));
+		wa[i].kill_sent = 0;
+		wa[i].path[0] = '\0';
+		memset(&wa[i].stats, 0, sizeof(wa[i].stats));
+		wa[i].deque.top = 0;
+		wa[i].deque.bottom = 0;
+		wa[i].last_seen = atomic_timestamp();
+	}
+
+	if (!queue_work(0, WORK_VISIT, 0, root_dir))
+		tst_brk(TBROK, "Path '%s' is too long", root_dir);
+
+	for (i = 0; i < worker_count; i++) {
+		wa[i].pid = SAFE_FORK();
+		if (!wa[i].pid)
+			exit(worker_run(i));
+	}
+}
+
+/*
+ * Requeues the rest of the visits the worker was killed in, starting after
+ * the entry it was processing. A directory the worker got stuck reading is
+ * not retried. The deque of the killed worker is likely full, since that is
+ * when the visits are descended inline, so the other deques are tried too.
+ */
+static void requeue_visits(const int worker)
+{
+	struct worker *const w = workers + worker;
+	unsigned int i, depth = MIN(w->visit_depth, VISIT_DEPTH);
+	struct visit *v;
+	int j;
+
+	if (w->in_readdir && depth == w->visit_depth)
+		depth--;
+
+	for (i = 0; i < depth; i++) {
+		v = &w->visits[i];
+
+		if (!v->path[0])
+			continue;
+
+		for (j = 0; j < worker_count; j++) {
+			if (queue_work((worker + j) % worker_count, WORK_VISIT,
+				       v->loc, v->path))
+				break;
+		}
+
+		if (j == worker_count && (!quiet || timeout_warnings_left)) {
+			tst_res(TINFO, "Worker %d (%d): Skipping the rest of '%s'",
+				w->pid, worker, v->path);
+		}
+	}
+
+	w->visit_depth = 0;
+	w->in_readdir = 0;
+}
+
+/*
+ * Returns the io_uring read the worker is most likely stuck on, the oldest
+ * submitted one when it was killed waiting in io_uring_enter(), or -1.
+ */
+static int stuck_read(const int worker)
+{
+	struct worker *const w = workers + worker;
+	int i, stuck = -1;
+
+	if (!w->in_uring)
+		return -1;
+
+	for (i = 0; i < URING_DEPTH; i++) {
+		if (!w->inflight[i].path[0] || w->inflight[i].start < 0)
+			continue;
+
+		if (stuck < 0 ||
+		    w->inflight[i].start < w->inflight[stuck].start)
+			stuck = i;
+	}
+
+	return stuck;
+}
+
+/*
+ * Requeues the io_uring reads the worker was killed with, except the one it
+ * got stuck on. The visits have already moved past these files.
+ */
+static void requeue_reads(const int worker, const int stuck)
+{
+	struct worker *const w = workers + worker;
+	struct inflight_read *in;
+	int i, j;
+
+	for (i = 0; i < URING_DEPTH; i++) {
+		in = &w->inflight[i];
+
+		if (!in->path[0] || i == stuck)
+			continue;
+
+		for (j = 0; j < worker_count; j++) {
+			if (queue_work((worker + j) % worker_count, WORK_READ,
+				       0, in->path))
+				break;
+		}
+
+		if (j == worker_count && (!quiet || timeout_warnings_left)) {
+			tst_res(TINFO, "Worker %d (%d): Skipping '%s'",
+				w->pid, worker, in->path);
+		}
+	}
+
+	memset(w->inflight, 0, sizeof(w->inflight));
+	w->in_uring = 0;
+}
+
+static void restart_worker(const int worker)
+{
+	struct worker *const w = workers + worker;
+	const char *stuck_path = w->path;
+	int wstatus, ret, stuck;
+
+	if (!w->kill_sent) {
+		SAFE_KILL(w->pid, SIGKILL);
+		w->kill_sent = 1;
+		w->stuck_us = worker_elapsed(worker);
+		worker_heartbeat(worker);
+	}
+
+	ret = waitpid(w->pid, &wstatus, WNOHANG);
+
+	if (!ret) {
+		if (worker_ttl(worker) > 0)
+			return;
+
+		if (!quiet || timeout_warnings_left) {
+			tst_res(TINFO,
+				"Worker %d (%d): Timeout waiting after kill",
+				w->pid, worker);
+		}
+	} else if (ret != w->pid) {
+		tst_brk(TBROK | TERRNO, "Worker %d (%d): waitpid = %d",
+			w->pid, worker, ret);
+	}
+
+	w->kill_sent = 0;
+
+	stuck = stuck_read(worker);
+	if (stuck >= 0)
+		stuck_path = w->inflight[stuck].path;
+
+	if (!quiet || timeout_warnings_left) {
+		tst_res(TINFO, "Worker %d (%d): Last accessed '%s'",
+			w->pid, worker, stuck_path);
+	}
+
+	/*
+	 * The file the worker got stuck on is recorded with the time until the
+	 * kill and skipped, anything it queued stays in its deque.
+	 */
+	if (tst_atomic_load(&w->busy))
+		record_latency(&w->stats, stuck_path, w->stuck_us);
+
+	if (tst_atomic_load(&w->busy) == WORKER_ITEM)
+		requeue_visits(worker);
+
+	requeue_reads(worker, stuck);
+	work_abandon(w);
+
+	worker_heartbeat(worker);
+	w->pid = SAFE_FORK();
+
+	if (!w->pid)
+		exit(worker_run(worker));
+}
+
+static void check_timeout_warnings_limit(void)
+{
+	if (!quiet)
+		return;
+
+	timeout_warnings_left--;
+
+	if (timeout_warnings_left)
+		return;
+
+	tst_res(TINFO,
+		"Silencing timeout warnings; consider increasing LTP_RUNTIME_MUL or removing -q");
+}
+
+static void supervise_workers(void)
+{
+	int i, elapsed;
+	struct worker *w;
+
+	while (work_left()) {
+		for (i = 0; i < worker_count; i++) {
+			w = workers + i;
+
+			if (w->kill_sent) {
+				restart_worker(i);
+				continue;
+			}
+
+			if (!tst_atomic_load(&w->busy))
+				continue;
+
+			elapsed = worker_elapsed(i);
+			if (elapsed <= worker_timeout)
+				continue;
+
+			if (!quiet || timeout_warnings_left) {
+				tst_res(TINFO,
+					"Worker %d (%d): Stuck for %dus, restarting it",
+					w->pid, i, elapsed);
+				check_timeout_warnings_limit();
+			}
+			restart_worker(i);
+		}
+
+		usleep(1000);
+	}
+}
+
+static void stop_workers(void)
+{
+	if (pool)
+		tst_atomic_store(1, &pool->stop);
+}
+
+static void setup(void)
+{
+	struct timespec now;
+	int i;
+
+	if (tst_parse_int(str_reads, &reads, 1, INT_MAX))
+		tst_brk(TBROK,
+			"Invalid reads (-r) argument: '%s'", str_reads);
 
 	if (tst_parse_long(str_max_workers, &max_workers, 1, LONG_MAX)) {
 		tst_brk(TBROK,
@@ -585,7 +1525,14 @@ static void setup(void)
 
 	if (!worker_count)
 		worker_count = MIN(MAX(tst_ncpus() - 1, 1L), max_workers);
-	workers = SAFE_MALLOC(worker_count * sizeof(*workers));
+
+	pool_size = sizeof(*pool) + worker_count * sizeof(*workers);
+	pool = SAFE_MMAP(NULL, pool_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	workers = pool->workers;
+
+	for (i = 0; i < worker_count; i++)
+		deque_init(&workers[i].deque);
 
 	if (tst_parse_int(str_worker_timeout, &worker_timeout, 1, INT_MAX)) {
 		tst_brk(TBROK,
@@ -604,7 +1551,17 @@ static void setup(void)
 	worker_timeout *= 1000;
 
 	SAFE_CLOCK_GETTIME(CLOCK_MONOTONIC_RAW, &now);
-	epoch = tst_timespec_to_us(now);
+	epoch = timespec_to_us(now);
+
+	if (use_uring) {
+		uring_enabled = uring_probe();
+		if (uring_enabled) {
+			tst_res(TINFO, "Using io_uring, up to %d reads in flight per worker",
+				URING_DEPTH);
+		} else {
+			tst_res(TINFO, "Falling back to read()");
+		}
+	}
 }
 
 static void reap_children(void)
@@ -638,84 +1595,138 @@ static void reap_children(void)
 		"Zombie workers detected; consider increasing LTP_RUNTIME_MUL");
 }
 
-static void cleanup(void)
+static int slow_file_cmp(const void *a, const void *b)
 {
-	stop_workers();
-	reap_children();
-	destroy_workers();
-	free(workers);
+	const struct slow_file *fa = a, *fb = b;
+
+	return fb->us - fa->us;
 }
 
-static void visit_dir(const char *path)
+static void write_dir_stat(ujson_writer *writer, struct dir_stat *d)
 {
-	DIR *dir;
-	struct dirent *dent;
-	struct stat dent_st;
-	char dent_path[MAX_PATH];
-	enum dent_action act;
-	int last_sched = 0;
+	unsigned int i;
 
-	dir = opendir(path);
-	if (!dir) {
-		tst_res(TINFO | TERRNO, "opendir(%s)", path);
-		return;
+	ujson_obj_start(writer, d->name);
+	ujson_int_add(writer, "reads", d->reads);
+	ujson_int_add(writer, "total_us", d->total_us);
+	ujson_int_add(writer, "max_us", d->max_us);
+	ujson_arr_start(writer, "hist");
+
+	for (i = 0; i < LAT_BUCKETS; i++)
+		ujson_int_add(writer, NULL, d->hist[i]);
+
+	ujson_arr_finish(writer);
+	ujson_obj_finish(writer);
+}
+
+/*
+ * Merges the worker statistics and writes them as JSON. The "hist_us" array
+ * holds the upper bounds of the histogram buckets, the last bucket is not
+ * bounded.
+ */
+static void write_report(void)
+{
+	struct read_stats *merged = SAFE_MALLOC(sizeof(*merged));
+	struct slow_file *slow;
+	struct dir_stat *d, *src;
+	unsigned int i, j, k, slow_cnt = 0, written = 0;
+	long long reads = 0;
+	ujson_writer *writer;
+
+	slow = SAFE_MALLOC(worker_count * SLOW_FILES * sizeof(*slow));
+	memset(merged, 0, sizeof(*merged));
+
+	for (i = 0; i < worker_count; i++) {
+		struct read_stats *st = &workers[i].stats;
+
+		for (j = 0; j < st->slow_cnt; j++)
+			slow[slow_cnt++] = st->slow[j];
+
+		for (j = 0; j < st->dirs_cnt; j++) {
+			src = &st->dirs[j];
+			d = dir_stat_get(merged, src->name);
+
+			d->reads += src->reads;
+			d->total_us += src->total_us;
+			d->max_us = MAX(d->max_us, src->max_us);
+
+			for (k = 0; k < LAT_BUCKETS; k++)
+				d->hist[k] += src->hist[k];
+
+			reads += src->reads;
+		}
 	}
 
-	while (1) {
-		errno = 0;
-		dent = readdir(dir);
-		if (!dent && errno) {
-			tst_res(TINFO | TERRNO, "readdir(%s)", path);
-			break;
-		} else if (!dent) {
-			break;
+	qsort(slow, slow_cnt, sizeof(*slow), slow_file_cmp);
+
+	writer = ujson_writer_file_open(report_path);
+	if (!writer)
+		tst_brk(TBROK | TERRNO, "Failed to open '%s'", report_path);
+
+	ujson_obj_start(writer, NULL);
+	ujson_str_add(writer, "root", root_dir);
+	ujson_int_add(writer, "reads", reads);
+
+	ujson_arr_start(writer, "slow_files");
+	for (i = 0; i < slow_cnt && written < SLOW_FILES; i++) {
+		/* The same file may be in the lists of several workers */
+		for (j = 0; j < i; j++) {
+			if (!strcmp(slow[i].path, slow[j].path))
+				break;
 		}
 
-		if (!strcmp(dent->d_name, ".") ||
-		    !strcmp(dent->d_name, ".."))
+		if (j < i)
 			continue;
 
-		if (dent->d_type == DT_DIR)
-			act = DA_VISIT;
-		else if (dent->d_type == DT_LNK)
-			act = DA_IGNORE;
-		else if (dent->d_type == DT_UNKNOWN)
-			act = DA_UNKNOWN;
-		else
-			act = DA_READ;
+		ujson_obj_start(writer, NULL);
+		ujson_str_add(writer, "path", slow[i].path);
+		ujson_int_add(writer, "us", slow[i].us);
+		ujson_obj_finish(writer);
+		written++;
+	}
+	ujson_arr_finish(writer);
 
-		snprintf(dent_path, MAX_PATH,
-			 "%s/%s", path, dent->d_name);
+	ujson_arr_start(writer, "hist_us");
+	for (i = 0; i < LAT_BUCKETS - 1; i++)
+		ujson_int_add(writer, NULL, 1L << i);
+	ujson_arr_finish(writer);
 
-		if (act == DA_UNKNOWN) {
-			if (lstat(dent_path, &dent_st))
-				tst_res(TINFO | TERRNO, "lstat(%s)", path);
-			else if ((dent_st.st_mode & S_IFMT) == S_IFDIR)
-				act = DA_VISIT;
-			else if ((dent_st.st_mode & S_IFMT) == S_IFLNK)
-				act = DA_IGNORE;
-			else
-				act = DA_READ;
-		}
+	ujson_obj_start(writer, "dirs");
+	for (i = 0; i < merged->dirs_cnt; i++)
+		write_dir_stat(writer, &merged->dirs[i]);
+	ujson_obj_finish(writer);
+
+	ujson_obj_finish(writer);
+
+	if (ujson_writer_file_close(writer))
+		tst_brk(TBROK | TERRNO, "Failed to write '%s'", report_path);
 
-		if (act == DA_VISIT)
-			visit_dir(dent_path);
-		else if (act == DA_READ)
-			last_sched = sched_work(last_sched, dent_path, reads);
+	if (slow_cnt) {
+		tst_res(TINFO, "Slowest read %s took %dus, report written to %s",
+			slow[0].path, slow[0].us, report_path);
 	}
 
-	if (closedir(dir))
-		tst_res(TINFO | TERRNO, "closedir(%s)", path);
+	free(slow);
+	free(merged);
+}
+
+static void cleanup(void)
+{
+	stop_workers();
+	reap_children();
+
+	if (pool)
+		SAFE_MUNMAP(pool, pool_size);
 }
 
 static void run(void)
 {
 	spawn_workers();
-	visit_dir(root_dir);
-
-	stop_workers();
+	supervise_workers();
 	reap_children();
-	destroy_workers();
+
+	if (report_path)
+		write_report();
 
 	tst_res(TPASS, "Finished reading files");
 }
@@ -740,6 +1751,10 @@ static struct tst_test test = {
 		 "Drop privileges; switch to the nobody user."},
 		{"t:", &str_worker_timeout,
 		 "Milliseconds a worker has to read a file before it is restarted"},
+		{"o:", &report_path,
+		 "Path Write the read latencies report as JSON to the file"},
+		{"u", &use_uring,
+		 "Read the files with io_uring, falls back to read() if not available"},
 		{}
 	},
 	.setup = setup,
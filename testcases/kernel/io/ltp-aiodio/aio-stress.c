@@ -22,6 +22,7 @@
 #include <errno.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -35,6 +36,9 @@
 #include <libaio.h>
 #include "tst_safe_pthread.h"
 #include "tst_safe_sysv_ipc.h"
+#include "tst_safe_stdio.h"
+#include "tst_lat_hist.h"
+#include "ujson.h"
 
 #define IO_FREE 0
 #define IO_PENDING 1
@@ -72,6 +76,8 @@ static unsigned long page_size_mask;
 static int o_flag;
 static char *latency_stats;
 static char *completion_latency_stats;
+static char *latency_json;
+static ujson_writer *json_writer;
 static int io_iter = 8;
 static int iterations = 500;
 static int max_io_submit;
@@ -90,19 +96,12 @@ static char *verify;
 static char *verify_buf;
 static char *unlink_files;
 
-/*
- * latencies during io_submit are measured, these are the
- * granularities for deviations
- */
-#define DEVIATIONS 6
-static int deviations[DEVIATIONS] = { 100, 250, 500, 1000, 5000, 10000 };
-
-struct io_latency {
-	double max;
-	double min;
-	double total_io;
-	double total_lat;
-	double deviations[DEVIATIONS];
+static const double lat_pcts[] = {0.5, 0.9, 0.99, 0.999, 0.9999};
+static const char *const lat_pct_names[] = {
+	"p50", "p90", "p99", "p99.9", "p99.99"
+};
+static const char *const lat_pct_ids[] = {
+	"p50_ns", "p90_ns", "p99_ns", "p999_ns", "p9999_ns"
 };
 
 /* container for a series of operations to a file */
@@ -151,7 +150,7 @@ struct io_oper {
 	struct io_oper *next;
 	struct io_oper *prev;
 
-	struct timeval start_time;
+	struct timespec start_time;
 
 	char *file_name;
 };
@@ -178,7 +177,7 @@ struct io_unit {
 
 	struct io_unit *next;
 
-	struct timeval io_start_time; /* time of io_submit */
+	struct timespec io_start_time; /* time of io_submit */
 };
 
 struct thread_info {
@@ -207,7 +206,7 @@ struct thread_info {
 	int num_global_events;
 
 	/* latency stats for io_submit */
-	struct io_latency io_submit_latency;
+	struct tst_lat_hist io_submit_latency;
 
 	/* list of operations still in progress, and of those finished */
 	struct io_oper *active_opers;
@@ -220,30 +219,23 @@ struct thread_info {
 	double stage_mb_trans;
 
 	/* latency completion stats i/o time from io_submit until io_getevents */
-	struct io_latency io_completion_latency;
+	struct tst_lat_hist io_completion_latency;
 };
 
 /* pthread mutexes and other globals for keeping the threads in sync */
 static pthread_barrier_t worker_barrier;
-static struct timeval global_stage_start_time;
+static struct timespec global_stage_start_time;
 static struct thread_info *global_thread_info;
 
 /*
- * return seconds between start_tv and stop_tv in double precision
+ * return seconds between start_ts and stop_ts in double precision
  */
-static double time_since(struct timeval *start_tv, struct timeval *stop_tv)
+static double time_since(struct timespec *start_ts, struct timespec *stop_ts)
 {
-	double sec, usec;
 	double ret;
 
-	sec = stop_tv->tv_sec - start_tv->tv_sec;
-	usec = stop_tv->tv_usec - start_tv->tv_usec;
-	if (sec > 0 && usec < 0) {
-		sec--;
-		usec += 1000000;
-	}
-
-	ret = sec + usec / (double)1000000;
+	ret = (stop_ts->tv_sec - start_ts->tv_sec) +
+		(stop_ts->tv_nsec - start_ts->tv_nsec) / 1e9;
 	if (ret < 0)
 		ret = 0;
 
@@ -251,44 +243,24 @@ static double time_since(struct timeval *start_tv, struct timeval *stop_tv)
 }
 
 /*
- * return seconds between start_tv and now in double precision
+ * return seconds between start_ts and now in double precision
  */
-static double time_since_now(struct timeval *start_tv)
+static double time_since_now(struct timespec *start_ts)
 {
-	struct timeval stop_time;
+	struct timespec stop_time;
 
-	gettimeofday(&stop_time, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &stop_time);
 
-	return time_since(start_tv, &stop_time);
+	return time_since(start_ts, &stop_time);
 }
 
 /*
  * Add latency info to latency struct
  */
-static void calc_latency(struct timeval *start_tv, struct timeval *stop_tv,
-			 struct io_latency *lat)
+static void calc_latency(struct timespec *start_ts, struct timespec *stop_ts,
+			 struct tst_lat_hist *lat)
 {
-	double delta;
-	int i;
-
-	delta = time_since(start_tv, stop_tv);
-	delta = delta * 1000;
-
-	if (delta > lat->max)
-		lat->max = delta;
-
-	if (!lat->min || delta < lat->min)
-		lat->min = delta;
-
-	lat->total_io++;
-	lat->total_lat += delta;
-
-	for (i = 0; i < DEVIATIONS; i++) {
-		if (delta < deviations[i]) {
-			lat->deviations[i]++;
-			break;
-		}
-	}
+	tst_lat_hist_add(lat, tst_lat_ts_diff_ns(stop_ts, start_ts));
 }
 
 static void oper_list_add(struct io_oper *oper, struct io_oper **list)
@@ -411,41 +383,88 @@ static void print_time(struct io_oper *oper)
 		stage_name(oper->rw), oper->file_name, tput, mb, runtime);
 }
 
-static void print_lat(char *str, struct io_latency *lat)
+static void print_lat(char *str, char *stage, struct tst_lat_hist *lat)
 {
-	char out[4 * 1024];
+	char out[256];
 	char *ptr = out;
-	double avg = lat->total_lat / lat->total_io;
-	int i;
-	double total_counted = 0;
-
-	tst_res(TINFO, "%s min %.2f avg %.2f max %.2f", str, lat->min, avg, lat->max);
+	unsigned int i;
 
-	for (i = 0; i < DEVIATIONS; i++) {
-		ptr += sprintf(ptr, "%.0f < %d", lat->deviations[i], deviations[i]);
-		total_counted += lat->deviations[i];
-	}
+	if (!lat->count)
+		return;
 
-	if (total_counted && lat->total_io - total_counted)
-		ptr += sprintf(ptr, " < %.0f", lat->total_io - total_counted);
+	tst_res(TINFO, "%s %s usec: min %.2f avg %.2f max %.2f", stage, str,
+		lat->min / 1e3, lat->total / 1e3 / lat->count, lat->max / 1e3);
 
-	tst_res(TINFO, "%s", out);
+	for (i = 0; i < ARRAY_SIZE(lat_pcts); i++) {
+		ptr += sprintf(ptr, "%s%s %.2f", i ? " " : "", lat_pct_names[i],
+			       tst_lat_hist_percentile(lat, lat_pcts[i]) / 1e3);
+	}
 
-	memset(lat, 0, sizeof(*lat));
+	tst_res(TINFO, "%s %s usec: %s", stage, str, out);
 }
 
-static void print_latency(struct thread_info *t)
+static void write_lat(char *id, struct tst_lat_hist *lat)
 {
-	struct io_latency *lat = &t->io_submit_latency;
+	unsigned int i;
+
+	ujson_obj_start(json_writer, id);
+	ujson_int_add(json_writer, "count", lat->count);
+
+	if (lat->count) {
+		ujson_int_add(json_writer, "min_ns", lat->min);
+		ujson_int_add(json_writer, "avg_ns", lat->total / lat->count);
+		ujson_int_add(json_writer, "max_ns", lat->max);
 
-	print_lat("latency", lat);
+		for (i = 0; i < ARRAY_SIZE(lat_pcts); i++) {
+			ujson_int_add(json_writer, lat_pct_ids[i],
+				      tst_lat_hist_percentile(lat, lat_pcts[i]));
+		}
+	}
+
+	ujson_obj_finish(json_writer);
 }
 
-static void print_completion_latency(struct thread_info *t)
+/*
+ * Merges the latencies collected by the threads during the stage, reports
+ * them and resets them for the next stage. Must be called by a single
+ * thread while the rest of them are waiting.
+ */
+static void stage_latency(char *stage)
 {
-	struct io_latency *lat = &t->io_completion_latency;
+	struct tst_lat_hist submit, completion;
+	int i;
+
+	memset(&submit, 0, sizeof(submit));
+	memset(&completion, 0, sizeof(completion));
 
-	print_lat("completion latency", lat);
+	for (i = 0; i < num_threads; i++) {
+		struct thread_info *t = &global_thread_info[i];
+
+		tst_lat_hist_merge(&submit, &t->io_submit_latency);
+		tst_lat_hist_merge(&completion, &t->io_completion_latency);
+		memset(&t->io_submit_latency, 0, sizeof(t->io_submit_latency));
+		memset(&t->io_completion_latency, 0,
+		       sizeof(t->io_completion_latency));
+	}
+
+	if (!stage)
+		return;
+
+	if (latency_stats)
+		print_lat("io_submit latency", stage, &submit);
+
+	if (completion_latency_stats)
+		print_lat("completion latency", stage, &completion);
+
+	if (!json_writer)
+		return;
+
+	ujson_obj_start(json_writer, NULL);
+	ujson_str_add(json_writer, "stage", stage);
+	ujson_int_add(json_writer, "threads", num_threads);
+	write_lat("submit", &submit);
+	write_lat("completion", &completion);
+	ujson_obj_finish(json_writer);
 }
 
 /*
@@ -453,11 +472,11 @@ static void print_completion_latency(struct thread_info *t)
  * io unit, and make the io unit reusable again
  */
 static void finish_io(struct thread_info *t, struct io_unit *io, long result,
-		      struct timeval *tv_now)
+		      struct timespec *ts_now)
 {
 	struct io_oper *oper = io->io_oper;
 
-	calc_latency(&io->io_start_time, tv_now, &t->io_completion_latency);
+	calc_latency(&io->io_start_time, ts_now, &t->io_completion_latency);
 	io->res = result;
 	io->busy = IO_FREE;
 	io->next = t->free_ious;
@@ -479,7 +498,7 @@ static int read_some_events(struct thread_info *t)
 	int nr;
 	int i;
 	int min_nr = io_iter;
-	struct timeval stop_time;
+	struct timespec stop_time;
 
 	if (t->num_global_pending < io_iter)
 		min_nr = t->num_global_pending;
@@ -488,7 +507,7 @@ static int read_some_events(struct thread_info *t)
 	if (nr <= 0)
 		return nr;
 
-	gettimeofday(&stop_time, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &stop_time);
 
 	for (i = 0; i < nr; i++) {
 		event = t->events + i;
@@ -546,12 +565,12 @@ static int io_oper_wait(struct thread_info *t, struct io_oper *oper)
 		 * more than one event at a time
 		 */
 	while (io_getevents(t->io_ctx, 1, 1, &event, NULL) > 0) {
-		struct timeval tv_now;
+		struct timespec ts_now;
 
 		event_io = (struct io_unit *)((unsigned long)event.obj);
 
-		gettimeofday(&tv_now, NULL);
-		finish_io(t, event_io, event.res, &tv_now);
+		clock_gettime(CLOCK_MONOTONIC, &ts_now);
+		finish_io(t, event_io, event.res, &ts_now);
 
 		if (oper->num_pending == 0)
 			break;
@@ -696,7 +715,7 @@ static int build_oper(struct thread_info *t, struct io_oper *oper, int num_ios,
 	struct io_unit *io;
 
 	if (oper->started_ios == 0)
-		gettimeofday(&oper->start_time, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &oper->start_time);
 
 	if (num_ios == 0)
 		num_ios = oper->total_ios;
@@ -719,7 +738,7 @@ static int build_oper(struct thread_info *t, struct io_oper *oper, int num_ios,
  * runs through the iocbs in the array provided and updates
  * counters in the associated oper struct
  */
-static void update_iou_counters(struct iocb **my_iocbs, int nr, struct timeval *tv_now)
+static void update_iou_counters(struct iocb **my_iocbs, int nr, struct timespec *ts_now)
 {
 	struct io_unit *io;
 	int i;
@@ -728,7 +747,7 @@ static void update_iou_counters(struct iocb **my_iocbs, int nr, struct timeval *
 		io = (struct io_unit *)(my_iocbs[i]);
 		io->io_oper->num_pending++;
 		io->io_oper->started_ios++;
-		io->io_start_time = *tv_now; /* set time of io_submit */
+		io->io_start_time = *ts_now; /* set time of io_submit */
 	}
 }
 
@@ -736,14 +755,14 @@ static void update_iou_counters(struct iocb **my_iocbs, int nr, struct timeval *
 static int run_built(struct thread_info *t, int num_ios, struct iocb **my_iocbs)
 {
 	int ret;
-	struct timeval start_time;
-	struct timeval stop_time;
+	struct timespec start_time;
+	struct timespec stop_time;
 
 resubmit:
-	gettimeofday(&start_time, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
 	ret = io_submit(t->io_ctx, num_ios, my_iocbs);
 
-	gettimeofday(&stop_time, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &stop_time);
 	calc_latency(&start_time, &stop_time, &t->io_submit_latency);
 
 	if (ret != num_ios) {
@@ -1036,7 +1055,7 @@ static int *worker(struct thread_info *t)
 {
 	struct io_oper *oper;
 	char *this_stage = NULL;
-	struct timeval stage_time;
+	struct timespec stage_time;
 	int status = 0;
 	int cnt;
 
@@ -1045,12 +1064,12 @@ static int *worker(struct thread_info *t)
 restart:
 	if (num_threads > 1) {
 		if (pthread_barrier_wait(&worker_barrier))
-			gettimeofday(&global_stage_start_time, NULL);
+			clock_gettime(CLOCK_MONOTONIC, &global_stage_start_time);
 	}
 
 	if (t->active_opers) {
 		this_stage = stage_name(t->active_opers->rw);
-		gettimeofday(&stage_time, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &stage_time);
 		t->stage_mb_trans = 0;
 	}
 
@@ -1062,12 +1081,6 @@ restart:
 		cnt++;
 	}
 
-	if (latency_stats)
-		print_latency(t);
-
-	if (completion_latency_stats)
-		print_completion_latency(t);
-
 	/* then we wait for all the operations to finish */
 	oper = t->finished_opers;
 	do {
@@ -1109,8 +1122,15 @@ restart:
 	}
 
 	if (num_threads > 1) {
-		if (pthread_barrier_wait(&worker_barrier))
+		if (pthread_barrier_wait(&worker_barrier)) {
 			global_thread_throughput(t, this_stage);
+			stage_latency(this_stage);
+		}
+
+		/* the other threads must not record until the stats are reset */
+		pthread_barrier_wait(&worker_barrier);
+	} else {
+		stage_latency(this_stage);
 	}
 
 	/* someone got restarted, go back to the beginning */
@@ -1210,6 +1230,11 @@ static void setup(void)
 	if (tst_parse_int(str_num_threads, &num_threads, 1, INT_MAX))
 		tst_brk(TBROK, "Invalid number of threads '%s'", str_num_threads);
 
+	/* The test runs in the tmpdir, relative paths are from the start dir */
+	if (latency_json && latency_json[0] != '/')
+		SAFE_ASPRINTF(&latency_json, "%s/%s", tst_get_startwd(),
+			      latency_json);
+
 	if (str_o_flag) {
 		if (tst_fs_type(".") == TST_TMPFS_MAGIC)
 			tst_brk(TCONF, "O_DIRECT not supported on tmpfs");
@@ -1330,6 +1355,15 @@ static void run(void)
 	for (i = 0; i < num_threads; i++)
 		setup_ious(&t[i], t[i].num_files, depth, rec_len, max_io_submit);
 
+	if (latency_json) {
+		json_writer = ujson_writer_file_open(latency_json);
+		if (!json_writer)
+			tst_brk(TBROK | TERRNO, "Failed to open '%s'", latency_json);
+
+		ujson_obj_start(json_writer, NULL);
+		ujson_arr_start(json_writer, "stages");
+	}
+
 	if (num_threads > 1) {
 		tst_res(TINFO, "Running multi thread version num_threads: %d", num_threads);
 		status = run_workers(t, num_threads);
@@ -1338,6 +1372,16 @@ static void run(void)
 		status = (intptr_t)worker(t);
 	}
 
+	if (json_writer) {
+		ujson_arr_finish(json_writer);
+		ujson_obj_finish(json_writer);
+
+		if (ujson_writer_file_close(json_writer))
+			tst_brk(TBROK | TERRNO, "Failed to write '%s'", latency_json);
+
+		json_writer = NULL;
+	}
+
 	for (i = 0; i < num_files; i++)
 		SAFE_UNLINK(files[i]);
 
@@ -1368,8 +1412,9 @@ static struct tst_test test = {
 		{ "e:", &str_io_iter, "Number of I/O per file sent before switching to the next file (default 8)" },
 		{ "f:", &str_num_files, "Number of files to generate" },
 		{ "g:", &str_context_offset, "Offset between contexts (default 2M)" },
-		{ "l", &latency_stats, "Print io_submit latencies after each stage" },
-		{ "L", &completion_latency_stats, "Print io completion latencies after each stage" },
+		{ "j:", &latency_json, "Write the latencies of each stage as JSON into the file" },
+		{ "l", &latency_stats, "Print io_submit latency percentiles after each stage" },
+		{ "L", &completion_latency_stats, "Print io completion latency percentiles after each stage" },
 		{ "m", &str_use_shm, "SHM use ipc shared memory for io buffers instead of malloc" },
 		{ "n", &no_fsync_stages, "No fsyncs between write stage and read stage" },
 		{ "o:", &str_stages, "Add an operation to the list: write=0, read=1, random write=2, random read=3" },
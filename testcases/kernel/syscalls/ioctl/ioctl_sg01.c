@@ -81,7 +81,7 @@ static void setup(void)
 	tst_res(TINFO, "Found SCSI device %s", devpath);
 
 	/* Pollute some memory to avoid false negatives */
-	tst_pollute_memory(0, 0x42);
+	tst_pollute_memory_flags(0, 0x42, TST_POLLUTE_PARALLEL | TST_POLLUTE_THP);
 
 	devfd = SAFE_OPEN(devpath, O_RDONLY);
 	query.interface_id = 'S';
@@ -67,3 +67,8 @@ endif
 
 %_16.o: %.c $(COMPAT_16_H)
 	$(COMPILE.c) $(OUTPUT_OPTION) $<
+
+%_16.so: CPPFLAGS += -D$(DEF_16)=1
+
+%_16.so: %.c $(COMPAT_16_H)
+	$(LINK_SO.c) $< $(SO_LDLIBS) -o $@
@@ -53,3 +53,8 @@ endif
 
 %_64.o: %.c
 	$(COMPILE.c) $(OUTPUT_OPTION) $<
+
+%_64.so: CFLAGS += -D$(DEF_64)=1
+
+%_64.so: %.c
+	$(LINK_SO.c) $< $(SO_LDLIBS) -o $@
@@ -747,7 +747,7 @@ tst_netload()
 	fi
 
 	OPTIND=0
-	while getopts :a:c:H:n:N:r:R:S:b:t:T:fFe:m:A:D: opt; do
+	while getopts :a:c:H:n:N:r:R:S:b:t:T:fFzGM:e:m:A:D: opt; do
 		case "$opt" in
 		a) c_num="$OPTARG" ;;
 		H) c_opts="${c_opts}-H $OPTARG "
@@ -767,6 +767,9 @@ tst_netload()
 		m) cs_opts="${cs_opts}-m $OPTARG " ;;
 		f) cs_opts="${cs_opts}-f " ;;
 		F) cs_opts="${cs_opts}-F " ;;
+		z) cs_opts="${cs_opts}-z " ;;
+		G) cs_opts="${cs_opts}-G " ;;
+		M) cs_opts="${cs_opts}-M $OPTARG " ;;
 		e) expect_res="$OPTARG" ;;
 		D) [ "$TST_NETLOAD_BINDTODEVICE" = 1 ] && cs_opts="${cs_opts}-d $OPTARG "
 		   bind_to_device=0 ;;
@@ -776,6 +779,10 @@ tst_netload()
 	OPTIND=0
 
 	[ "$setup_srchost" = 1 ] && s_opts="${s_opts}-S $hostopt "
+	[ -n "$TST_NETLOAD_SRV_WORKERS" ] && \
+		s_opts="${s_opts}-w $TST_NETLOAD_SRV_WORKERS "
+	[ -n "$TST_NETLOAD_CLN_ENGINE" ] && \
+		c_opts="${c_opts}-E $TST_NETLOAD_CLN_ENGINE "
 
 	if [ "$bind_to_device" = 1 -a "$TST_NETLOAD_BINDTODEVICE" = 1 ]; then
 		c_opts="${c_opts}-d $(tst_iface) "
@@ -856,9 +863,28 @@ tst_netload()
 
 	tst_res_ TPASS "netstress passed, median time $median ms, data:$results"
 
+	[ -f $rfile.stats ] && \
+		tst_res_ TINFO "last run: $(tr '\n' ' ' < $rfile.stats)"
+
 	return $ret
 }
 
+# Prints a value from the statistics of the last tst_netload run, e.g. the
+# p99 request latency with 'tst_netload_stat p99_ns', so that it can be
+# passed to tst_netload_compare.
+# tst_netload_stat KEY [RESULT_FILE]
+# KEY: time_ms, clients, requests, bytes, p50_ns, p90_ns, p99_ns, p999_ns,
+#      max_ns, client_avg_bps, client_min_bps
+# RESULT_FILE: the tst_netload -c argument, default is tst_netload.res
+tst_netload_stat()
+{
+	local file="${2:-tst_netload.res}.stats"
+
+	[ -f "$file" ] || tst_brk_ TBROK "tst_netload_stat: can't read $file"
+
+	sed -n "s/^$1=//p" "$file"
+}
+
 # Compares results for netload runs.
 # tst_netload_compare TIME_BASE TIME THRESHOLD_LOW [THRESHOLD_HI]
 # TIME_BASE: time taken to run netstress load test - 100%
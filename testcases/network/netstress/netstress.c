@@ -5,12 +5,20 @@
  * Author: Alexey Kodanev <alexey.kodanev@oracle.com>
  */
 
+#define _GNU_SOURCE
 #include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <linux/dccp.h>
+#include <linux/errqueue.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
@@ -31,6 +39,16 @@
 #include "tst_safe_pthread.h"
 #include "tst_test.h"
 #include "tst_safe_net.h"
+#include "tst_safe_io_uring.h"
+#include "tst_lat_hist.h"
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+# define SO_EE_ORIGIN_ZEROCOPY		5
+#endif
+
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+# define SO_EE_CODE_ZEROCOPY_COPIED	1
+#endif
 
 #if !defined(HAVE_RAND_R)
 static int rand_r(LTP_ATTRIBUTE_UNUSED unsigned int *seed)
@@ -116,7 +134,7 @@ static char *port_path = "netstress_port";
 static char *log_path = "netstress.log";
 
 static char *narg, *Narg, *qarg, *rarg, *Rarg, *aarg, *Targ, *barg, *targ,
-	    *Aarg;
+	    *Aarg, *warg, *Marg;
 
 /* common structure for TCP/UDP server and TCP/UDP client */
 struct net_func {
@@ -141,12 +159,57 @@ struct sock_info {
 	int pmtu_err_cnt;
 	int eshutdown_cnt;
 	int timeout;
+	/* MSG_ZEROCOPY sends completed and the ones the kernel had to copy */
+	uint64_t zc_done;
+	uint64_t zc_copied;
 };
 
 static char *zcopy;
 static int send_flags = MSG_NOSIGNAL;
+
+/* how the client moves the requests and the replies */
+enum {
+	ENGINE_SEND = 0,
+	ENGINE_SPLICE,
+	ENGINE_URING,
+};
+static int engine;
+static char *engine_name;
+
+/* Per client thread state of the splice and io_uring engines */
+struct client_io {
+	int pipefd[2];
+	struct tst_io_uring ring;
+	unsigned int to_submit;
+	uint16_t zc_flags;
+};
+
+#define URING_DEPTH	4
+
+/* io_uring fixed buffer indexes and user_data */
+enum {
+	URING_SEND_BUF = 0,
+	URING_RECV_BUF,
+	URING_TIMEOUT,
+};
 static char *reuse_port;
 
+/* number of epoll server workers, 0 is a thread per connection */
+static int server_workers;
+
+/* UDP requests per sendmmsg()/recvmmsg(), 1 is a syscall per datagram */
+static int udp_batch = 1;
+static char *udp_gso;
+
+/* GSO limits, the segments fit into the minimal IPv6 MTU */
+#define UDP_MAX_SEGS		64
+#define UDP_GSO_MAX_SEG		1200
+#define UDP_MAX_PAYLOAD		65507
+#define UDP_GRO_BUF_LEN		65536
+#define UDP_CTRL_LEN		CMSG_SPACE(sizeof(int))
+/* the whole batches are dropped with the default socket buffers */
+#define UDP_SOCK_BUF		(8 * 1024 * 1024)
+
 static void init_socket_opts(int sd)
 {
 	if (busy_poll >= 0)
@@ -200,6 +263,58 @@ static void do_cleanup(void)
 }
 TST_DECLARE_ONCE_FN(cleanup, do_cleanup)
 
+/*
+ * Reads the MSG_ZEROCOPY completion notifications from the socket error
+ * queue. Each notification covers a range of sends, the kernel sets
+ * SO_EE_CODE_ZEROCOPY_COPIED if it had to copy the data after all, e.g. on
+ * loopback. The error queue must be drained, otherwise it fills up the
+ * socket option memory and poll() keeps returning POLLERR. The counters are
+ * NULL in the server, which runs until it is killed and never reports them.
+ */
+static void zc_drain(int fd, uint64_t *done, uint64_t *copied)
+{
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err) +
+				sizeof(struct sockaddr_in6))];
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	struct sock_extended_err *ee;
+	int saved_errno = errno;
+	uint32_t cnt;
+
+	while (1) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (!(cm->cmsg_level == SOL_IP &&
+			      cm->cmsg_type == IP_RECVERR) &&
+			    !(cm->cmsg_level == SOL_IPV6 &&
+			      cm->cmsg_type == IPV6_RECVERR))
+				continue;
+
+			ee = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (ee->ee_errno || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			if (!done)
+				continue;
+
+			cnt = ee->ee_data - ee->ee_info + 1;
+			*done += cnt;
+			if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				*copied += cnt;
+		}
+	}
+	errno = saved_errno;
+}
+
 static int sock_recv_poll(char *buf, int size, struct sock_info *i)
 {
 	struct pollfd pfd;
@@ -229,8 +344,12 @@ static int sock_recv_poll(char *buf, int size, struct sock_info *i)
 
 				getsockopt(i->fd, SOL_SOCKET, SO_ERROR,
 					   &err, &err_len);
-				if (!err)
+				if (!err) {
+					if (zcopy)
+						zc_drain(i->fd, &i->zc_done,
+							 &i->zc_copied);
 					continue;
+				}
 				errno = err;
 			}
 			break;
@@ -253,13 +372,254 @@ static int sock_recv_poll(char *buf, int size, struct sock_info *i)
 	return len;
 }
 
-static int client_recv(char *buf, int srv_msg_len, struct sock_info *i)
+static struct io_uring_sqe *uring_get_sqe(struct client_io *io)
+{
+	uint32_t tail = *io->ring.sqr_tail;
+	uint32_t idx = tail & *io->ring.sqr_mask;
+	struct io_uring_sqe *sqe = &io->ring.sqr_entries[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	io->ring.sqr_array[idx] = idx;
+
+	tail++;
+	__atomic_store(io->ring.sqr_tail, &tail, __ATOMIC_RELEASE);
+	io->to_submit++;
+
+	return sqe;
+}
+
+/* Submits the queued requests and waits for the next completion */
+static void uring_wait_cqe(struct client_io *io, struct io_uring_cqe *cqe)
+{
+	uint32_t head = *io->ring.cqr_head, tail;
+
+	while (1) {
+		__atomic_load(io->ring.cqr_tail, &tail, __ATOMIC_ACQUIRE);
+		if (head != tail)
+			break;
+
+		SAFE_IO_URING_ENTER(0, io->ring.fd, io->to_submit, 1,
+				    IORING_ENTER_GETEVENTS, NULL);
+		io->to_submit = 0;
+	}
+
+	*cqe = io->ring.cqr_entries[head & *io->ring.cqr_mask];
+
+	head++;
+	__atomic_store(io->ring.cqr_head, &head, __ATOMIC_RELEASE);
+}
+
+/*
+ * Sends the message from the registered buffer with IORING_OP_SEND_ZC if
+ * zero-copy is enabled. The zero-copy send posts a second notification
+ * completion once the kernel is done with the buffer, it is waited for
+ * before the buffer can be reused. Kernels older than 6.2 do not report
+ * whether the data has been copied and reject the flag.
+ */
+static void uring_send(struct client_io *io, struct sock_info *i,
+		       const char *msg, int size)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe cqe;
+	int off = 0, wait, res;
+
+	while (off < size) {
+		sqe = uring_get_sqe(io);
+		sqe->fd = i->fd;
+		sqe->addr = (uintptr_t)(msg + off);
+		sqe->len = size - off;
+		sqe->msg_flags = send_flags & ~MSG_ZEROCOPY;
+
+		if (zcopy) {
+			sqe->opcode = IORING_OP_SEND_ZC;
+			sqe->ioprio = IORING_RECVSEND_FIXED_BUF | io->zc_flags;
+			sqe->buf_index = URING_SEND_BUF;
+		} else {
+			sqe->opcode = IORING_OP_SEND;
+		}
+
+		res = 0;
+		wait = 1;
+		while (wait--) {
+			uring_wait_cqe(io, &cqe);
+
+			if (cqe.flags & IORING_CQE_F_NOTIF) {
+				i->zc_done++;
+				if (cqe.res & IORING_NOTIF_USAGE_ZC_COPIED)
+					i->zc_copied++;
+				continue;
+			}
+
+			res = cqe.res;
+			if (cqe.flags & IORING_CQE_F_MORE)
+				wait++;
+		}
+
+		if (res == -EINVAL && io->zc_flags) {
+			io->zc_flags = 0;
+			continue;
+		}
+
+		if (res < 0) {
+			errno = -res;
+			tst_brk(TBROK | TERRNO, "io_uring send failed");
+		}
+
+		off += res;
+	}
+}
+
+/*
+ * Receives into the registered buffer with IORING_OP_READ_FIXED, the read
+ * is linked with a timeout to match sock_recv_poll().
+ */
+static int uring_recv(struct client_io *io, char *buf, int size,
+		      struct sock_info *i)
+{
+	struct __kernel_timespec ts = {
+		.tv_sec = i->timeout / 1000,
+		.tv_nsec = (i->timeout % 1000) * 1000000LL,
+	};
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe cqe;
+	int wait, len = 0;
+
+	sqe = uring_get_sqe(io);
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->fd = i->fd;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = size;
+	sqe->buf_index = URING_RECV_BUF;
+	sqe->user_data = URING_RECV_BUF;
+	sqe->flags = IOSQE_IO_LINK;
+
+	sqe = uring_get_sqe(io);
+	sqe->opcode = IORING_OP_LINK_TIMEOUT;
+	sqe->addr = (uintptr_t)&ts;
+	sqe->len = 1;
+	sqe->user_data = URING_TIMEOUT;
+
+	/* both the read and the timeout post a completion */
+	for (wait = 2; wait; wait--) {
+		uring_wait_cqe(io, &cqe);
+		if (cqe.user_data == URING_RECV_BUF)
+			len = cqe.res;
+	}
+
+	errno = 0;
+
+	if (len == -ECANCELED || len == -EINTR) {
+		errno = ETIME;
+		return -1;
+	}
+
+	if (len < 0) {
+		errno = -len;
+		return -1;
+	}
+
+	if (len == 0)
+		errno = ESHUTDOWN;
+
+	return len;
+}
+
+/*
+ * Maps the message pages into the pipe with vmsplice() and moves them to
+ * the socket with splice(), the data is not copied between the buffers.
+ */
+static void splice_send(struct client_io *io, int fd, const char *msg,
+			int size)
+{
+	struct iovec iov = {.iov_base = (void *)msg, .iov_len = size};
+	ssize_t len, left;
+
+	while (iov.iov_len) {
+		left = vmsplice(io->pipefd[1], &iov, 1, 0);
+		if (left < 0)
+			tst_brk(TBROK | TERRNO, "vmsplice() failed");
+
+		iov.iov_base = (char *)iov.iov_base + left;
+		iov.iov_len -= left;
+
+		while (left) {
+			len = splice(io->pipefd[0], NULL, fd, NULL, left,
+				     SPLICE_F_MOVE |
+				     (iov.iov_len ? SPLICE_F_MORE : 0));
+			if (len <= 0)
+				tst_brk(TBROK | TERRNO, "splice() failed");
+
+			left -= len;
+		}
+	}
+}
+
+static void client_send(struct client_io *io, struct sock_info *i,
+			const char *msg, int size)
+{
+	switch (io ? engine : ENGINE_SEND) {
+	case ENGINE_SPLICE:
+		splice_send(io, i->fd, msg, size);
+	break;
+	case ENGINE_URING:
+		uring_send(io, i, msg, size);
+	break;
+	default:
+		SAFE_SEND(1, i->fd, msg, size, send_flags);
+	}
+}
+
+static void client_io_init(struct client_io *io, char *send_buf,
+			   char *recv_buf)
+{
+	struct io_uring_params params = {};
+	struct iovec iov[] = {
+		[URING_SEND_BUF] = {.iov_base = send_buf, .iov_len = max_msg_len},
+		[URING_RECV_BUF] = {.iov_base = recv_buf, .iov_len = max_msg_len},
+	};
+
+	switch (engine) {
+	case ENGINE_SPLICE:
+		SAFE_PIPE(io->pipefd);
+	break;
+	case ENGINE_URING:
+		SAFE_IO_URING_INIT(URING_DEPTH, &params, &io->ring);
+		io->to_submit = 0;
+		io->zc_flags = IORING_SEND_ZC_REPORT_USAGE;
+
+		if (io_uring_register(io->ring.fd, IORING_REGISTER_BUFFERS,
+				      iov, ARRAY_SIZE(iov))) {
+			tst_brk(TBROK | TERRNO,
+				"io_uring_register(IORING_REGISTER_BUFFERS)");
+		}
+	break;
+	}
+}
+
+static void client_io_cleanup(struct client_io *io)
+{
+	switch (engine) {
+	case ENGINE_SPLICE:
+		SAFE_CLOSE(io->pipefd[0]);
+		SAFE_CLOSE(io->pipefd[1]);
+	break;
+	case ENGINE_URING:
+		SAFE_IO_URING_CLOSE(&io->ring);
+	break;
+	}
+}
+
+static int client_recv(struct client_io *io, char *buf, int srv_msg_len,
+		       struct sock_info *i)
 {
 	int len, offset = 0;
 
 	while (1) {
 		errno = 0;
-		len = sock_recv_poll(buf + offset, srv_msg_len - offset, i);
+		if (io && engine == ENGINE_URING)
+			len = uring_recv(io, buf + offset, srv_msg_len - offset, i);
+		else
+			len = sock_recv_poll(buf + offset, srv_msg_len - offset, i);
 
 		/* socket closed or msg is not valid */
 		if (len < 1 || (offset + len) > srv_msg_len ||
@@ -303,6 +663,9 @@ static int client_recv(char *buf, int srv_msg_len, struct sock_info *i)
 		}
 	}
 
+	if (zcopy)
+		zc_drain(i->fd, &i->zc_done, &i->zc_copied);
+
 	SAFE_CLOSE(i->fd);
 	return (errno) ? -1 : 0;
 }
@@ -328,24 +691,51 @@ static void bind_before_connect(int sd)
 	}
 }
 
-static int client_connect_send(const char *msg, int size)
+static int client_connect_send(struct client_io *io, struct sock_info *i,
+			       const char *msg, int size)
 {
-	int cfd = SAFE_SOCKET(family, sock_type, protocol);
+	i->fd = SAFE_SOCKET(family, sock_type, protocol);
 
-	init_socket_opts(cfd);
+	init_socket_opts(i->fd);
 
 	if (fastopen_api) {
 		/* Replaces connect() + send()/write() */
-		SAFE_SENDTO(1, cfd, msg, size, send_flags | MSG_FASTOPEN,
+		SAFE_SENDTO(1, i->fd, msg, size, send_flags | MSG_FASTOPEN,
 			remote_addrinfo->ai_addr, remote_addrinfo->ai_addrlen);
 	} else {
-		bind_before_connect(cfd);
+		bind_before_connect(i->fd);
 		/* old TCP API */
-		SAFE_CONNECT(cfd, remote_addrinfo->ai_addr,
+		SAFE_CONNECT(i->fd, remote_addrinfo->ai_addr,
 			     remote_addrinfo->ai_addrlen);
-		SAFE_SEND(1, cfd, msg, size, send_flags);
+		client_send(io, i, msg, size);
 	}
-	return cfd;
+	return i->fd;
+}
+
+/*
+ * Per client statistics, written only by the client thread and padded to
+ * a cache line to avoid false sharing between the clients.
+ */
+struct client_stats {
+	/* The request round trip latencies */
+	struct tst_lat_hist lat;
+	uint64_t bytes;
+	uint64_t time_ns;
+	uint64_t zc_done;
+	uint64_t zc_copied;
+} __attribute__((aligned(64)));
+
+static struct client_stats *client_stats;
+
+static void stats_add(struct client_stats *st, struct timespec *start,
+		      int bytes)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+	tst_lat_hist_add(&st->lat, tst_lat_ts_diff_ns(&end, start));
+	st->bytes += bytes;
 }
 
 union net_size_field {
@@ -372,6 +762,334 @@ static void make_client_request(char client_msg[], int *cln_len, int *srv_len,
 	client_msg[*cln_len - 1] = end_byte;
 }
 
+/* sendmmsg() and recvmmsg() buffers of the batched UDP client and server */
+struct udp_bufs {
+	struct mmsghdr *smsgs;
+	struct iovec *siov;
+	char *sctrl;
+	struct mmsghdr *rmsgs;
+	struct iovec *riov;
+	char *rctrl;
+	struct sockaddr_storage *rnames;
+	char *rbuf;
+	int rslots;
+};
+
+static void udp_bufs_init(struct udp_bufs *b, int smsgs, int siovs,
+			  int rslots, int rslot_len, int names)
+{
+	int i;
+
+	b->smsgs = SAFE_MALLOC(smsgs * sizeof(*b->smsgs));
+	b->siov = SAFE_MALLOC(siovs * sizeof(*b->siov));
+	b->sctrl = SAFE_MALLOC(smsgs * UDP_CTRL_LEN);
+	b->rmsgs = SAFE_MALLOC(rslots * sizeof(*b->rmsgs));
+	b->riov = SAFE_MALLOC(rslots * sizeof(*b->riov));
+	b->rctrl = SAFE_MALLOC(rslots * UDP_CTRL_LEN);
+	b->rnames = names ? SAFE_MALLOC(rslots * sizeof(*b->rnames)) : NULL;
+	b->rbuf = SAFE_MALLOC((size_t)rslots * rslot_len);
+	b->rslots = rslots;
+
+	memset(b->rmsgs, 0, rslots * sizeof(*b->rmsgs));
+
+	for (i = 0; i < rslots; i++) {
+		b->riov[i].iov_base = b->rbuf + (size_t)i * rslot_len;
+		b->riov[i].iov_len = rslot_len;
+		b->rmsgs[i].msg_hdr.msg_iov = &b->riov[i];
+		b->rmsgs[i].msg_hdr.msg_iovlen = 1;
+		b->rmsgs[i].msg_hdr.msg_control = b->rctrl + i * UDP_CTRL_LEN;
+		if (names)
+			b->rmsgs[i].msg_hdr.msg_name = &b->rnames[i];
+	}
+}
+
+static void udp_bufs_free(struct udp_bufs *b)
+{
+	free(b->smsgs);
+	free(b->siov);
+	free(b->sctrl);
+	free(b->rmsgs);
+	free(b->riov);
+	free(b->rctrl);
+	free(b->rnames);
+	free(b->rbuf);
+}
+
+/* recvmmsg() overwrites the lengths, reset them before each call */
+static void udp_bufs_reset(struct udp_bufs *b)
+{
+	int i;
+
+	for (i = 0; i < b->rslots; i++) {
+		b->rmsgs[i].msg_hdr.msg_controllen = UDP_CTRL_LEN;
+		if (b->rnames)
+			b->rmsgs[i].msg_hdr.msg_namelen = sizeof(*b->rnames);
+	}
+}
+
+static void udp_enable_gro(int fd)
+{
+	if (setsockopt(fd, SOL_UDP, UDP_GRO, &(int){1}, sizeof(int))) {
+		if (errno == ENOPROTOOPT)
+			tst_brk(TCONF, "UDP_GRO is not supported");
+		tst_brk(TBROK | TERRNO, "setsockopt(UDP_GRO)");
+	}
+}
+
+/*
+ * Enlarges the socket buffers for the batches, the *FORCE variants ignore
+ * the rmem_max and wmem_max limits but they need CAP_NET_ADMIN.
+ */
+static void udp_init_socket(int fd)
+{
+	int size = UDP_SOCK_BUF;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)))
+		SAFE_SETSOCKOPT_INT(fd, SOL_SOCKET, SO_RCVBUF, size);
+
+	if (setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE, &size, sizeof(size)))
+		SAFE_SETSOCKOPT_INT(fd, SOL_SOCKET, SO_SNDBUF, size);
+
+	if (udp_gso)
+		udp_enable_gro(fd);
+}
+
+/* Returns the GRO segment size or 0 if the datagram was not coalesced */
+static int udp_gro_size(struct msghdr *msg)
+{
+	struct cmsghdr *cm;
+	int size;
+
+	for (cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm)) {
+		if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+			memcpy(&size, CMSG_DATA(cm), sizeof(size));
+			return size;
+		}
+	}
+
+	return 0;
+}
+
+/* Returns non-zero if one more segment fits into the GSO datagram */
+static int udp_gso_fits(int seg_len, int len, int segs)
+{
+	return udp_gso && len == seg_len && len <= UDP_GSO_MAX_SEG &&
+	       segs < UDP_MAX_SEGS && (segs + 1) * len <= UDP_MAX_PAYLOAD;
+}
+
+static void udp_set_segment(struct msghdr *msg, char *ctrl, int seg_len)
+{
+	struct cmsghdr *cm;
+	uint16_t val = seg_len;
+
+	msg->msg_control = ctrl;
+	msg->msg_controllen = CMSG_SPACE(sizeof(val));
+
+	cm = CMSG_FIRSTHDR(msg);
+	cm->cmsg_level = SOL_UDP;
+	cm->cmsg_type = UDP_SEGMENT;
+	cm->cmsg_len = CMSG_LEN(sizeof(val));
+	memcpy(CMSG_DATA(cm), &val, sizeof(val));
+}
+
+static void udp_sendmmsg(int fd, struct mmsghdr *msgs, int cnt)
+{
+	int ret, off = 0;
+
+	while (off < cnt) {
+		ret = sendmmsg(fd, msgs + off, cnt - off, send_flags);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			tst_brk(TBROK | TERRNO, "sendmmsg() failed");
+		}
+		off += ret;
+	}
+}
+
+/*
+ * Sends cnt copies of the request with a single sendmmsg(), with -G they
+ * are coalesced into UDP_SEGMENT datagrams.
+ */
+static void udp_send_requests(struct udp_bufs *b, int fd, char *msg, int len,
+			      int cnt)
+{
+	struct msghdr *hdr = NULL;
+	int i, msgs = 0, segs = 0;
+
+	for (i = 0; i < cnt; i++) {
+		b->siov[i].iov_base = msg;
+		b->siov[i].iov_len = len;
+
+		if (hdr && udp_gso_fits(len, len, segs)) {
+			hdr->msg_iovlen++;
+			segs++;
+			continue;
+		}
+
+		hdr = &b->smsgs[msgs++].msg_hdr;
+		memset(hdr, 0, sizeof(*hdr));
+		hdr->msg_iov = &b->siov[i];
+		hdr->msg_iovlen = 1;
+		segs = 1;
+	}
+
+	for (i = 0; i < msgs; i++) {
+		hdr = &b->smsgs[i].msg_hdr;
+		if (hdr->msg_iovlen > 1)
+			udp_set_segment(hdr, b->sctrl + i * UDP_CTRL_LEN, len);
+	}
+
+	udp_sendmmsg(fd, b->smsgs, msgs);
+}
+
+/*
+ * Waits for cnt replies, the replies coalesced by GRO are split by the
+ * segment size. Returns 0 when all the replies arrived or after a timeout,
+ * the lost replies are handled the same way as in client_recv().
+ */
+static int udp_recv_replies(struct udp_bufs *b, struct sock_info *i, int cnt,
+			    struct client_stats *st, struct timespec *start,
+			    int bytes)
+{
+	struct pollfd pfd = {.fd = i->fd, .events = POLLIN};
+	int n, k, off, len, seg, got = 0;
+	struct msghdr *hdr;
+	char *rep;
+
+	while (got < cnt) {
+		n = poll(&pfd, 1, i->timeout);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		if (!n) {
+			if (++(i->etime_cnt) > max_etime_cnt)
+				tst_brk(TFAIL, "client requests timeout %d times, last timeout %dms",
+					i->etime_cnt, i->timeout);
+			/* Increase timeout in poll up to 3.2 sec */
+			if (i->timeout < 3000)
+				i->timeout <<= 1;
+			return 0;
+		}
+
+		udp_bufs_reset(b);
+
+		n = recvmmsg(i->fd, b->rmsgs, b->rslots, MSG_DONTWAIT, NULL);
+		if (n == -1) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			/* packet too big message, resend with new pmtu */
+			if (errno == EMSGSIZE) {
+				if (++(i->pmtu_err_cnt) < max_pmtu_err)
+					return 0;
+				tst_brk(TFAIL, "too many pmtu errors %d",
+					i->pmtu_err_cnt);
+			}
+			return -1;
+		}
+
+		for (k = 0; k < n; k++) {
+			hdr = &b->rmsgs[k].msg_hdr;
+			len = b->rmsgs[k].msg_len;
+			seg = udp_gro_size(hdr);
+			if (!seg)
+				seg = len;
+
+			for (off = 0; off < len; off += seg) {
+				rep = (char *)hdr->msg_iov->iov_base + off;
+
+				if (hdr->msg_flags & MSG_TRUNC ||
+				    rep[0] != start_byte ||
+				    rep[MIN(seg, len - off) - 1] != end_byte) {
+					errno = ENOMSG;
+					return -1;
+				}
+
+				stats_add(st, start, bytes);
+				got++;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * The batched UDP client sends client_max_requests in batches of udp_batch
+ * requests. The latency of each reply is measured from the batch start.
+ */
+void *client_fn_udp(void *id)
+{
+	int cln_len = init_cln_msg_len,
+	    srv_len = init_srv_msg_len;
+	struct sock_info inf;
+	char client_msg[max_msg_len];
+	int i, cnt, rslot_len, rslots;
+	intptr_t err = 0;
+	unsigned int seed = init_seed ^ (intptr_t)id;
+	struct client_stats *st = &client_stats[(intptr_t)id];
+	struct timespec start, req_start;
+	struct udp_bufs b;
+
+	inf.etime_cnt = 0;
+	inf.timeout = wait_timeout;
+	inf.pmtu_err_cnt = 0;
+
+	/* the replies are not larger than the longest request */
+	rslot_len = max_rand_msg_len ? min_msg_len + max_rand_msg_len :
+		    init_srv_msg_len;
+	rslots = udp_batch;
+	if (udp_gso) {
+		rslot_len = UDP_GRO_BUF_LEN;
+		rslots = MIN(udp_batch, 8);
+	}
+
+	udp_bufs_init(&b, udp_batch, udp_batch, rslots, rslot_len, 0);
+
+	inf.fd = SAFE_SOCKET(family, sock_type, protocol);
+	init_socket_opts(inf.fd);
+	udp_init_socket(inf.fd);
+	bind_before_connect(inf.fd);
+	SAFE_CONNECT(inf.fd, remote_addrinfo->ai_addr,
+		     remote_addrinfo->ai_addrlen);
+
+	make_client_request(client_msg, &cln_len, &srv_len, &seed);
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+
+	for (i = 0; i < client_max_requests; i += cnt) {
+		cnt = MIN(udp_batch, client_max_requests - i);
+
+		if (i && max_rand_msg_len)
+			make_client_request(client_msg, &cln_len, &srv_len, &seed);
+
+		clock_gettime(CLOCK_MONOTONIC_RAW, &req_start);
+
+		udp_send_requests(&b, inf.fd, client_msg, cln_len, cnt);
+
+		if (udp_recv_replies(&b, &inf, cnt, st, &req_start,
+				     cln_len + srv_len)) {
+			err = errno;
+			break;
+		}
+	}
+
+	SAFE_CLOSE(inf.fd);
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &req_start);
+	st->time_ns = tst_lat_ts_diff_ns(&req_start, &start);
+
+	udp_bufs_free(&b);
+
+	if (i < client_max_requests)
+		tst_res(TWARN, "client exit on '%d' request", i);
+
+	return (void *) err;
+}
+
 void *client_fn(void *id)
 {
 	int cln_len = init_cln_msg_len,
@@ -382,57 +1100,85 @@ void *client_fn(void *id)
 	int i = 0;
 	intptr_t err = 0;
 	unsigned int seed = init_seed ^ (intptr_t)id;
+	struct client_stats *st = &client_stats[(intptr_t)id];
+	struct timespec start, req_start;
+	struct client_io io;
 
 	inf.raddr_len = sizeof(inf.raddr);
 	inf.etime_cnt = 0;
 	inf.eshutdown_cnt = 0;
 	inf.timeout = wait_timeout;
 	inf.pmtu_err_cnt = 0;
+	inf.zc_done = 0;
+	inf.zc_copied = 0;
 
+	client_io_init(&io, client_msg, buf);
 	make_client_request(client_msg, &cln_len, &srv_len, &seed);
 
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+	req_start = start;
+
 	/* connect & send requests */
-	inf.fd = client_connect_send(client_msg, cln_len);
+	inf.fd = client_connect_send(&io, &inf, client_msg, cln_len);
 	if (inf.fd == -1) {
 		err = errno;
 		goto out;
 	}
 
-	if (client_recv(buf, srv_len, &inf)) {
+	if (client_recv(&io, buf, srv_len, &inf)) {
 		err = errno;
 		goto out;
 	}
 
+	stats_add(st, &req_start, cln_len + srv_len);
+
 	for (i = 1; i < client_max_requests; ++i) {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &req_start);
+
 		if (inf.fd == -1) {
-			inf.fd = client_connect_send(client_msg, cln_len);
+			inf.fd = client_connect_send(&io, &inf, client_msg,
+						     cln_len);
 			if (inf.fd == -1) {
 				err = errno;
 				goto out;
 			}
 
-			if (client_recv(buf, srv_len, &inf)) {
+			if (client_recv(&io, buf, srv_len, &inf)) {
 				err = errno;
 				break;
 			}
+
+			stats_add(st, &req_start, cln_len + srv_len);
 			continue;
 		}
 
 		if (max_rand_msg_len)
 			make_client_request(client_msg, &cln_len, &srv_len, &seed);
 
-		SAFE_SEND(1, inf.fd, client_msg, cln_len, send_flags);
+		client_send(&io, &inf, client_msg, cln_len);
 
-		if (client_recv(buf, srv_len, &inf)) {
+		if (client_recv(&io, buf, srv_len, &inf)) {
 			err = errno;
 			break;
 		}
+
+		stats_add(st, &req_start, cln_len + srv_len);
 	}
 
-	if (inf.fd != -1)
+	if (inf.fd != -1) {
+		if (zcopy)
+			zc_drain(inf.fd, &inf.zc_done, &inf.zc_copied);
 		SAFE_CLOSE(inf.fd);
+	}
 
 out:
+	clock_gettime(CLOCK_MONOTONIC_RAW, &req_start);
+	st->time_ns = tst_lat_ts_diff_ns(&req_start, &start);
+	st->zc_done = inf.zc_done;
+	st->zc_copied = inf.zc_copied;
+
+	client_io_cleanup(&io);
+
 	if (i != client_max_requests)
 		tst_res(TWARN, "client exit on '%d' request", i);
 
@@ -462,6 +1208,8 @@ static void client_init(void)
 	}
 
 	thread_ids = SAFE_MALLOC(sizeof(pthread_t) * clients_num);
+	client_stats = SAFE_MALLOC(sizeof(*client_stats) * clients_num);
+	memset(client_stats, 0, sizeof(*client_stats) * clients_num);
 
 	struct addrinfo hints;
 	memset(&hints, 0, sizeof(struct addrinfo));
@@ -481,8 +1229,88 @@ static void client_init(void)
 
 	clock_gettime(CLOCK_MONOTONIC_RAW, &tv_client_start);
 	intptr_t i;
-	for (i = 0; i < clients_num; ++i)
-		SAFE_PTHREAD_CREATE(&thread_ids[i], &attr, client_fn, (void *)i);
+	for (i = 0; i < clients_num; ++i) {
+		SAFE_PTHREAD_CREATE(&thread_ids[i], &attr,
+				    udp_batch > 1 || udp_gso ? client_fn_udp : client_fn,
+				    (void *)i);
+	}
+}
+
+/*
+ * Merges the per client histograms and reports the request round trip
+ * latencies and the throughput. The results are also written as integer
+ * key=value lines into the rpath.stats file if the rpath is set.
+ */
+static void client_report(long clnt_time)
+{
+	static const double pcts[] = {0.5, 0.9, 0.99, 0.999};
+	static const char *const pct_names[] = {"p50", "p90", "p99", "p999"};
+	struct client_stats *sum = &client_stats[0];
+	double bps, min_bps = 0, sum_bps = 0;
+	uint64_t pct_ns[ARRAY_SIZE(pcts)];
+	unsigned int i;
+	char *path;
+	FILE *f;
+
+	for (i = 0; i < (unsigned int)clients_num; i++) {
+		struct client_stats *st = &client_stats[i];
+
+		bps = st->time_ns ? st->bytes * 1e9 / st->time_ns : 0;
+		sum_bps += bps;
+		if (!i || bps < min_bps)
+			min_bps = bps;
+
+		if (!i)
+			continue;
+
+		tst_lat_hist_merge(&sum->lat, &st->lat);
+		sum->bytes += st->bytes;
+		sum->zc_done += st->zc_done;
+		sum->zc_copied += st->zc_copied;
+	}
+
+	if (!sum->lat.count)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(pcts); i++)
+		pct_ns[i] = tst_lat_hist_percentile(&sum->lat, pcts[i]);
+
+	tst_res(TINFO, "latency us: p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f",
+		pct_ns[0] / 1e3, pct_ns[1] / 1e3, pct_ns[2] / 1e3,
+		pct_ns[3] / 1e3, sum->lat.max / 1e3);
+
+	tst_res(TINFO, "throughput: %.0f B/s, %.0f req/s total, per client avg %.0f B/s, min %.0f B/s",
+		clnt_time ? sum->bytes * 1000.0 / clnt_time : 0,
+		clnt_time ? sum->lat.count * 1000.0 / clnt_time : 0,
+		sum_bps / clients_num, min_bps);
+
+	if (zcopy) {
+		tst_res(TINFO, "zero-copy: %" PRIu64 " completions, %" PRIu64 " copied",
+			sum->zc_done, sum->zc_copied);
+	}
+
+	if (!rpath)
+		return;
+
+	SAFE_ASPRINTF(&path, "%s.stats", rpath);
+	f = SAFE_FOPEN(path, "w");
+
+	fprintf(f, "time_ms=%ld\n", clnt_time);
+	fprintf(f, "clients=%d\n", clients_num);
+	fprintf(f, "requests=%" PRIu64 "\n", sum->lat.count);
+	fprintf(f, "bytes=%" PRIu64 "\n", sum->bytes);
+	for (i = 0; i < ARRAY_SIZE(pcts); i++)
+		fprintf(f, "%s_ns=%" PRIu64 "\n", pct_names[i], pct_ns[i]);
+	fprintf(f, "max_ns=%" PRIu64 "\n", sum->lat.max);
+	fprintf(f, "client_avg_bps=%.0f\n", sum_bps / clients_num);
+	fprintf(f, "client_min_bps=%.0f\n", min_bps);
+	if (zcopy) {
+		fprintf(f, "zc_done=%" PRIu64 "\n", sum->zc_done);
+		fprintf(f, "zc_copied=%" PRIu64 "\n", sum->zc_copied);
+	}
+
+	SAFE_FCLOSE(f);
+	free(path);
 }
 
 static void client_run(void)
@@ -503,6 +1331,7 @@ static void client_run(void)
 		(tv_client_end.tv_nsec - tv_client_start.tv_nsec) / 1000000;
 
 	tst_res(TINFO, "total time '%ld' ms", clnt_time);
+	client_report(clnt_time);
 
 	char client_msg[min_msg_len];
 	int msg_len = min_msg_len;
@@ -511,7 +1340,8 @@ static void client_run(void)
 	make_client_request(client_msg, &msg_len, &msg_len, NULL);
 	/* ask server to terminate */
 	client_msg[0] = start_fin_byte;
-	int cfd = client_connect_send(client_msg, msg_len);
+	struct sock_info inf;
+	int cfd = client_connect_send(NULL, &inf, client_msg, msg_len);
 	if (cfd != -1) {
 		shutdown(cfd, SHUT_WR);
 		SAFE_CLOSE(cfd);
@@ -526,6 +1356,7 @@ static void client_run(void)
 static void client_cleanup(void)
 {
 	free(thread_ids);
+	free(client_stats);
 
 	if (remote_addrinfo)
 		freeaddrinfo(remote_addrinfo);
@@ -553,6 +1384,8 @@ void *server_fn(void *cfd)
 	inf.fd = (intptr_t) cfd;
 	inf.raddr_len = sizeof(inf.raddr);
 	inf.timeout = wait_timeout;
+	inf.zc_done = 0;
+	inf.zc_copied = 0;
 
 	iov[0].iov_base = send_msg;
 	iov[1].iov_base = end;
@@ -674,7 +1507,7 @@ static void server_init(void)
 	/* IPv6 socket is also able to access IPv4 protocol stack */
 	sfd = SAFE_SOCKET(family, sock_type, protocol);
 	SAFE_SETSOCKOPT_INT(sfd, SOL_SOCKET, SO_REUSEADDR, 1);
-	if (reuse_port)
+	if (reuse_port || (sock_type == SOCK_DGRAM && server_workers > 1))
 		SAFE_SETSOCKOPT_INT(sfd, SOL_SOCKET, SO_REUSEPORT, 1);
 
 	tst_res(TINFO, "assigning a name to the server socket...");
@@ -734,11 +1567,207 @@ static void move_to_background(void)
 	SAFE_DUP(fd);
 }
 
+/* Returns the next allowed CPU round-robin or -1 if the set is empty */
+static int next_cpu(cpu_set_t *set, int cpu)
+{
+	if (!CPU_COUNT(set))
+		return -1;
+
+	do {
+		cpu = (cpu + 1) % CPU_SETSIZE;
+	} while (!CPU_ISSET(cpu, set));
+
+	return cpu;
+}
+
+static void pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	if (cpu < 0)
+		return;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		tst_res(TINFO | TERRNO, "Failed to pin worker to CPU %d", cpu);
+}
+
+struct udp_worker {
+	pthread_t id;
+	int fd;
+	int cpu;
+};
+
+/*
+ * The replies are sent from this template without copying, a reply of size
+ * x is the first x - 1 bytes followed by the end byte stored after them.
+ */
+static char *udp_reply;
+
+/* Returns the size of the reply, the server exits on invalid requests */
+static int udp_check_request(int fd, const char *req, int len)
+{
+	int size;
+
+	if (len < min_msg_len ||
+	    (req[0] != start_byte && req[0] != start_fin_byte) ||
+	    req[len - 1] != end_byte) {
+		tst_res(TFAIL, "recv failed, sock '%d'", fd);
+		tst_brk(TBROK, "Server closed");
+	}
+
+	/* client asks to terminate */
+	if (req[0] == start_fin_byte)
+		tst_brk(TBROK, "Server closed");
+
+	size = parse_client_request(req);
+	if (size < 0) {
+		tst_res(TFAIL, "wrong msg size '%d'", size);
+		tst_brk(TBROK, "Server closed");
+	}
+
+	return size;
+}
+
+/*
+ * Receives a batch of requests with recvmmsg() and sends the replies with
+ * a single sendmmsg(). With -G the requests coalesced by GRO are split by
+ * the segment size and the equal replies to the same client are sent as
+ * one UDP_SEGMENT datagram.
+ */
+static void *udp_worker_fn(void *arg)
+{
+	struct udp_worker *w = arg;
+	int segs_max = udp_gso ? UDP_MAX_SEGS : 1;
+	int i, n, off, len, seg, size, segs = 0, replies, iovs;
+	struct msghdr *hdr, *reply;
+	struct udp_bufs b;
+	char *req;
+
+	pin_to_cpu(w->cpu);
+
+	udp_bufs_init(&b, udp_batch * segs_max, 2 * udp_batch * segs_max,
+		      udp_batch, udp_gso ? UDP_GRO_BUF_LEN : max_msg_len, 1);
+
+	while (1) {
+		udp_bufs_reset(&b);
+
+		n = recvmmsg(w->fd, b.rmsgs, b.rslots, MSG_WAITFORONE, NULL);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			tst_brk(TBROK | TERRNO, "recvmmsg() failed");
+		}
+
+		replies = iovs = 0;
+
+		for (i = 0; i < n; i++) {
+			hdr = &b.rmsgs[i].msg_hdr;
+			len = b.rmsgs[i].msg_len;
+			seg = udp_gro_size(hdr);
+			if (!seg || hdr->msg_flags & MSG_TRUNC)
+				seg = len;
+
+			reply = NULL;
+
+			for (off = 0; off < len; off += seg) {
+				req = (char *)hdr->msg_iov->iov_base + off;
+				size = udp_check_request(w->fd, req,
+							 MIN(seg, len - off));
+
+				if (reply && udp_gso_fits(reply->msg_iov->iov_len + 1,
+						  size, segs)) {
+					reply->msg_iovlen += 2;
+					segs++;
+				} else {
+					reply = &b.smsgs[replies++].msg_hdr;
+					memset(reply, 0, sizeof(*reply));
+					reply->msg_name = hdr->msg_name;
+					reply->msg_namelen = hdr->msg_namelen;
+					reply->msg_iov = &b.siov[iovs];
+					reply->msg_iovlen = 2;
+					segs = 1;
+				}
+
+				b.siov[iovs].iov_base = udp_reply;
+				b.siov[iovs++].iov_len = size - 1;
+				b.siov[iovs].iov_base = udp_reply + max_msg_len;
+				b.siov[iovs++].iov_len = 1;
+			}
+		}
+
+		for (i = 0; i < replies; i++) {
+			reply = &b.smsgs[i].msg_hdr;
+			if (reply->msg_iovlen > 2)
+				udp_set_segment(reply, b.sctrl + i * UDP_CTRL_LEN,
+						reply->msg_iov->iov_len + 1);
+		}
+
+		udp_sendmmsg(w->fd, b.smsgs, replies);
+	}
+
+	return NULL;
+}
+
+/*
+ * Each worker has its own socket in the SO_REUSEPORT group of the server
+ * socket, the kernel spreads the clients between them by the address hash.
+ */
+static void server_run_udp_batch(void)
+{
+	struct udp_worker *uw;
+	struct sockaddr_storage addr;
+	socklen_t addr_len = sizeof(addr);
+	int i, nworkers = MAX(server_workers, 1), cpu = -1;
+	cpu_set_t set;
+
+	if (sched_getaffinity(0, sizeof(set), &set))
+		CPU_ZERO(&set);
+
+	udp_reply = SAFE_MALLOC(max_msg_len + 1);
+	memset(udp_reply, server_byte, max_msg_len);
+	udp_reply[0] = start_byte;
+	udp_reply[max_msg_len] = end_byte;
+
+	SAFE_GETSOCKNAME(sfd, (struct sockaddr *)&addr, &addr_len);
+
+	uw = SAFE_MALLOC(sizeof(*uw) * nworkers);
+
+	for (i = 0; i < nworkers; i++) {
+		if (i) {
+			uw[i].fd = SAFE_SOCKET(family, sock_type, protocol);
+			SAFE_SETSOCKOPT_INT(uw[i].fd, SOL_SOCKET, SO_REUSEADDR, 1);
+			SAFE_SETSOCKOPT_INT(uw[i].fd, SOL_SOCKET, SO_REUSEPORT, 1);
+			SAFE_BIND(uw[i].fd, (struct sockaddr *)&addr, addr_len);
+		} else {
+			uw[i].fd = sfd;
+		}
+
+		init_socket_opts(uw[i].fd);
+		udp_init_socket(uw[i].fd);
+
+		uw[i].cpu = cpu = next_cpu(&set, cpu);
+
+		SAFE_PTHREAD_CREATE(&uw[i].id, &attr, udp_worker_fn, &uw[i]);
+	}
+
+	tst_res(TINFO, "Started %d UDP workers, batch %d", nworkers, udp_batch);
+
+	for (i = 0; i < nworkers; i++)
+		SAFE_PTHREAD_JOIN(uw[i].id, NULL);
+}
+
 static void server_run_udp(void)
 {
 	if (server_bg)
 		move_to_background();
 
+	if (server_workers || udp_batch > 1 || udp_gso) {
+		server_run_udp_batch();
+		return;
+	}
+
 	pthread_t p_id = server_thread_add(sfd);
 
 	SAFE_PTHREAD_JOIN(p_id, NULL);
@@ -771,6 +1800,287 @@ static void server_run(void)
 	}
 }
 
+/*
+ * The epoll server state of a connection. Only the message header, the
+ * length and the position in the reply are kept, the payload is not checked
+ * by the server.
+ */
+struct ep_conn {
+	int fd;
+	int num_requests;
+	int recv_len;
+	char hdr[3];
+	int send_len;
+	int send_off;
+	char send_first;
+};
+
+struct ep_worker {
+	pthread_t id;
+	int efd;
+	int cpu;
+	char *recv_buf;
+	char *fill;
+};
+
+static struct ep_worker *workers;
+
+static void ep_close(struct ep_conn *c)
+{
+	SAFE_CLOSE(c->fd);
+	free(c);
+}
+
+static void ep_fail(struct ep_conn *c, const char *msg)
+{
+	tst_res(TFAIL | TERRNO, "%s, sock '%d'", msg, c->fd);
+	ep_close(c);
+	tst_brk(TBROK, "Server closed");
+}
+
+/*
+ * Sends the rest of the reply, returns 1 if the whole reply has been sent
+ * and 0 if the socket buffer is full.
+ */
+static int ep_send(struct ep_worker *w, struct ep_conn *c)
+{
+	char end = end_byte;
+	struct iovec iov[3] = {
+		{.iov_base = &c->send_first, .iov_len = 1},
+		{.iov_base = w->fill, .iov_len = c->send_len - 2},
+		{.iov_base = &end, .iov_len = 1},
+	};
+	struct msghdr msg = {.msg_iov = iov, .msg_iovlen = 3};
+	int skip = c->send_off;
+	ssize_t len;
+
+	while (skip && skip >= (int)msg.msg_iov->iov_len) {
+		skip -= msg.msg_iov->iov_len;
+		msg.msg_iov++;
+		msg.msg_iovlen--;
+	}
+
+	msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + skip;
+	msg.msg_iov->iov_len -= skip;
+
+	len = sendmsg(c->fd, &msg, send_flags);
+	if (len < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		ep_fail(c, "send failed");
+	}
+
+	c->send_off += len;
+
+	return c->send_off == c->send_len;
+}
+
+static void ep_set_events(struct ep_worker *w, struct ep_conn *c,
+			  uint32_t events)
+{
+	struct epoll_event ev = {.events = events, .data.ptr = c};
+
+	if (epoll_ctl(w->efd, EPOLL_CTL_MOD, c->fd, &ev))
+		tst_brk(TBROK | TERRNO, "epoll_ctl(MOD) failed");
+}
+
+/* Returns 1 if the connection has been closed */
+static int ep_reply_done(struct ep_worker *w, struct ep_conn *c)
+{
+	if (c->send_first == start_fin_byte) {
+		/* max reqs, close socket */
+		shutdown(c->fd, SHUT_WR);
+		ep_close(c);
+		return 1;
+	}
+
+	c->send_len = 0;
+	ep_set_events(w, c, EPOLLIN);
+
+	return 0;
+}
+
+static void ep_handle_send(struct ep_worker *w, struct ep_conn *c)
+{
+	if (ep_send(w, c))
+		ep_reply_done(w, c);
+}
+
+static void ep_handle_recv(struct ep_worker *w, struct ep_conn *c)
+{
+	ssize_t len;
+	int i;
+
+	len = recv(c->fd, w->recv_buf, max_msg_len, MSG_DONTWAIT);
+	if (len < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return;
+		ep_fail(c, "recv failed");
+	}
+
+	if (!len) {
+		ep_close(c);
+		return;
+	}
+
+	for (i = 0; c->recv_len + i < 3 && i < len; i++)
+		c->hdr[c->recv_len + i] = w->recv_buf[i];
+
+	c->recv_len += len;
+
+	if (c->recv_len > max_msg_len ||
+	    (c->hdr[0] != start_byte && c->hdr[0] != start_fin_byte)) {
+		errno = 0;
+		ep_fail(c, "recv failed");
+	}
+
+	/* msg is not complete, continue recv */
+	if (w->recv_buf[len - 1] != end_byte)
+		return;
+
+	/* client asks to terminate */
+	if (c->hdr[0] == start_fin_byte) {
+		ep_close(c);
+		tst_brk(TBROK, "Server closed");
+	}
+
+	c->send_len = parse_client_request(c->hdr);
+	if (c->send_len < 0) {
+		tst_res(TFAIL, "wrong msg size '%d'", c->send_len);
+		ep_close(c);
+		tst_brk(TBROK, "Server closed");
+	}
+
+	c->recv_len = 0;
+	c->send_off = 0;
+	c->send_first = start_byte;
+
+	/*
+	 * It will tell client that server is going
+	 * to close this connection.
+	 */
+	if (sock_type == SOCK_STREAM &&
+	    ++c->num_requests >= server_max_requests)
+		c->send_first = start_fin_byte;
+
+	if (ep_send(w, c))
+		ep_reply_done(w, c);
+	else
+		ep_set_events(w, c, EPOLLOUT);
+}
+
+static void ep_accept(struct ep_worker *w)
+{
+	struct epoll_event ev = {.events = EPOLLIN};
+	struct ep_conn *c;
+	int i, fd;
+
+	/* Leave the rest of the backlog to the other workers */
+	for (i = 0; i < 64; i++) {
+		fd = accept4(sfd, NULL, NULL, SOCK_NONBLOCK);
+		if (fd == -1) {
+			if (errno == EAGAIN || errno == ECONNABORTED ||
+			    errno == EINTR)
+				return;
+			tst_brk(TBROK | TERRNO, "Can't create client socket");
+		}
+
+		init_socket_opts(fd);
+
+		c = SAFE_MALLOC(sizeof(*c));
+		memset(c, 0, sizeof(*c));
+		c->fd = fd;
+		ev.data.ptr = c;
+
+		if (epoll_ctl(w->efd, EPOLL_CTL_ADD, fd, &ev))
+			tst_brk(TBROK | TERRNO, "epoll_ctl(ADD) failed");
+	}
+}
+
+static void *ep_worker_fn(void *arg)
+{
+	struct ep_worker *w = arg;
+	struct epoll_event evs[64];
+	struct ep_conn *c;
+	int i, n;
+
+	pin_to_cpu(w->cpu);
+
+	while (1) {
+		n = epoll_wait(w->efd, evs, ARRAY_SIZE(evs), -1);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			tst_brk(TBROK | TERRNO, "epoll_wait() failed");
+		}
+
+		for (i = 0; i < n; i++) {
+			c = evs[i].data.ptr;
+
+			/* socket errors are reported by recv() and send() */
+			if (c && zcopy && (evs[i].events & EPOLLERR))
+				zc_drain(c->fd, NULL, NULL);
+
+			if (!c)
+				ep_accept(w);
+			else if (c->send_len)
+				ep_handle_send(w, c);
+			else
+				ep_handle_recv(w, c);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Each worker has its own epoll instance and handles the connections it has
+ * accepted without blocking. The listening socket is added to all of them
+ * with EPOLLEXCLUSIVE so that a new connection wakes up only one worker.
+ */
+static void server_run_epoll(void)
+{
+	struct epoll_event ev = {.events = EPOLLIN | EPOLLEXCLUSIVE};
+	cpu_set_t set;
+	int i, flags, cpu = -1;
+
+	if (server_bg)
+		move_to_background();
+
+	if (sched_getaffinity(0, sizeof(set), &set))
+		CPU_ZERO(&set);
+
+	flags = SAFE_FCNTL(sfd, F_GETFL);
+	SAFE_FCNTL(sfd, F_SETFL, flags | O_NONBLOCK);
+
+	workers = SAFE_MALLOC(sizeof(*workers) * server_workers);
+
+	for (i = 0; i < server_workers; i++) {
+		struct ep_worker *w = &workers[i];
+
+		w->efd = epoll_create1(EPOLL_CLOEXEC);
+		if (w->efd == -1)
+			tst_brk(TBROK | TERRNO, "epoll_create1() failed");
+
+		ev.data.ptr = NULL;
+		if (epoll_ctl(w->efd, EPOLL_CTL_ADD, sfd, &ev))
+			tst_brk(TBROK | TERRNO, "epoll_ctl(ADD) failed");
+
+		w->recv_buf = SAFE_MALLOC(max_msg_len);
+		w->fill = SAFE_MALLOC(max_msg_len);
+		memset(w->fill, server_byte, max_msg_len);
+
+		w->cpu = cpu = next_cpu(&set, cpu);
+
+		SAFE_PTHREAD_CREATE(&w->id, &attr, ep_worker_fn, w);
+	}
+
+	tst_res(TINFO, "Started %d epoll workers", server_workers);
+
+	for (i = 0; i < server_workers; i++)
+		SAFE_PTHREAD_JOIN(workers[i].id, NULL);
+}
+
 static void require_root(const char *file)
 {
 	if (!geteuid())
@@ -831,6 +2141,79 @@ static void check_tw_reuse(void)
 	tst_res(TINFO, "set '%s' to '1'", tcp_tw_reuse);
 }
 
+static void check_uring_ops(void)
+{
+	const char *disabled_path = "/proc/sys/kernel/io_uring_disabled";
+	const uint8_t ops[] = {
+		zcopy ? IORING_OP_SEND_ZC : IORING_OP_SEND,
+		IORING_OP_READ_FIXED,
+		IORING_OP_LINK_TIMEOUT,
+	};
+	struct io_uring_params params = {};
+	struct io_uring_probe *probe;
+	struct tst_io_uring ring;
+	int disabled = 0, ret;
+	unsigned int i;
+
+	io_uring_setup_supported_by_kernel();
+
+	if (!access(disabled_path, F_OK))
+		SAFE_FILE_SCANF(disabled_path, "%d", &disabled);
+
+	if (disabled == 2)
+		tst_brk(TCONF, "io_uring is disabled by %s", disabled_path);
+
+	probe = SAFE_MALLOC(sizeof(*probe) + 256 * sizeof(probe->ops[0]));
+	memset(probe, 0, sizeof(*probe) + 256 * sizeof(probe->ops[0]));
+
+	SAFE_IO_URING_INIT(URING_DEPTH, &params, &ring);
+	ret = io_uring_register(ring.fd, IORING_REGISTER_PROBE, probe, 256);
+	SAFE_IO_URING_CLOSE(&ring);
+
+	if (ret)
+		tst_brk(TCONF | TERRNO, "io_uring_register(IORING_REGISTER_PROBE)");
+
+	for (i = 0; i < ARRAY_SIZE(ops); i++) {
+		if (ops[i] > probe->last_op ||
+		    !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+			tst_brk(TCONF, "io_uring opcode %u not supported", ops[i]);
+	}
+
+	free(probe);
+}
+
+static void set_engine(void)
+{
+	if (!engine_name || !strcmp(engine_name, "send"))
+		engine = ENGINE_SEND;
+	else if (!strcmp(engine_name, "splice"))
+		engine = ENGINE_SPLICE;
+	else if (!strcmp(engine_name, "uring"))
+		engine = ENGINE_URING;
+	else
+		tst_brk(TBROK, "Invalid engine: '%s'", engine_name);
+}
+
+static void setup_engine(void)
+{
+	switch (engine) {
+	case ENGINE_SPLICE:
+		if (sock_type != SOCK_STREAM)
+			tst_brk(TCONF, "splice engine needs a stream socket");
+		if (zcopy)
+			tst_brk(TBROK, "splice engine can't be used with -z");
+		/* splice() can't be told not to raise SIGPIPE */
+		SAFE_SIGNAL(SIGPIPE, SIG_IGN);
+	break;
+	case ENGINE_URING:
+		check_uring_ops();
+	break;
+	}
+
+	tst_res(TINFO, "client engine: %s%s", engine_name ? engine_name : "send",
+		zcopy ? " with zero-copy" : "");
+}
+
 static void set_protocol_type(void)
 {
 	if (!type || !strcmp(type, "tcp"))
@@ -869,6 +2252,10 @@ static void setup(void)
 		tst_brk(TBROK, "Invalid net.ipv4.tcp_fastopen '%s'", targ);
 	if (tst_parse_int(Aarg, &max_rand_msg_len, 10, max_msg_len))
 		tst_brk(TBROK, "Invalid max random payload size '%s'", Aarg);
+	if (tst_parse_int(warg, &server_workers, 1, MAX_THREADS))
+		tst_brk(TBROK, "Invalid number of server workers '%s'", warg);
+	if (tst_parse_int(Marg, &udp_batch, 1, IOV_MAX))
+		tst_brk(TBROK, "Invalid UDP batch size '%s'", Marg);
 
 	if (!server_addr)
 		server_addr = "localhost";
@@ -885,6 +2272,7 @@ static void setup(void)
 		clients_num = sysconf(_SC_NPROCESSORS_ONLN);
 
 	set_protocol_type();
+	set_engine();
 
 	if (client_mode) {
 		if (source_addr && tst_kvercmp(4, 2, 0) >= 0) {
@@ -921,12 +2309,14 @@ static void setup(void)
 	} else {
 		tst_res(TINFO, "max requests '%d'",
 			server_max_requests);
+		if (server_workers)
+			tst_res(TINFO, "server workers: %d", server_workers);
 		net.init	= server_init;
 		switch (proto_type) {
 		case TYPE_TCP:
 		case TYPE_DCCP:
 		case TYPE_SCTP:
-			net.run		= server_run;
+			net.run		= server_workers ? server_run_epoll : server_run;
 			net.cleanup	= server_cleanup;
 		break;
 		case TYPE_UDP:
@@ -978,6 +2368,23 @@ static void setup(void)
 	break;
 	}
 
+	if ((udp_batch > 1 || udp_gso) && sock_type != SOCK_DGRAM)
+		tst_brk(TBROK, "UDP batches and GSO need UDP or UDP-Lite");
+
+	if (udp_gso && proto_type == TYPE_UDP_LITE)
+		tst_brk(TCONF, "UDP-Lite does not support GSO");
+
+	if ((udp_batch > 1 || udp_gso) && engine != ENGINE_SEND)
+		tst_brk(TBROK, "UDP batches can't be used with -E");
+
+	if (udp_batch > 1 || udp_gso) {
+		tst_res(TINFO, "UDP batch size %d%s", udp_batch,
+			udp_gso ? ", GSO/GRO" : "");
+	}
+
+	if (client_mode)
+		setup_engine();
+
 	if ((errno = pthread_attr_init(&attr)))
 		tst_brk(TBROK | TERRNO, "pthread_attr_init failed");
 
@@ -1022,6 +2429,10 @@ static struct tst_test test = {
 		{"R:", &Rarg, "Server requests after which conn.closed"},
 		{"q:", &qarg, "TFO queue"},
 		{"B:", &server_bg, "Run in background, arg is the process directory"},
+		{"w:", &warg, "Server workers pinned to CPUs, epoll or UDP SO_REUSEPORT"},
+		{"E:", &engine_name, "Client engine: send (default), splice, uring"},
+		{"M:", &Marg, "UDP batch size for sendmmsg() and recvmmsg()"},
+		{"G", &udp_gso, "Use UDP GSO and GRO"},
 		{}
 	},
 	.timeout = 300,
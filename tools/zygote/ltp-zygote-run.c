@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (c) Linux Test Project, 2026
+ */
+
+/*
+ * Runs a test in the ltp-zygote test server when the LTP_ZYGOTE_SOCKET
+ * environment variable is set and the test has been built as a shared
+ * object, i.e. there is a test.so next to the test binary. Otherwise, or if
+ * the server cannot start the test, the test binary is executed.
+ *
+ * The test exit status is passed through and signals are forwarded to the
+ * test, so the client can be used as a prefix for the runtest commands.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "zygote.h"
+
+static volatile sig_atomic_t test_pid;
+
+static void forward_signal(int sig)
+{
+	if (test_pid)
+		kill(-test_pid, sig);
+}
+
+static char *find_test(const char *name)
+{
+	char *paths, *dir, *path;
+
+	if (strchr(name, '/'))
+		return strdup(name);
+
+	paths = getenv("PATH");
+	if (!paths)
+		return NULL;
+
+	paths = strdup(paths);
+	if (!paths)
+		return NULL;
+
+	for (dir = strtok(paths, ":"); dir; dir = strtok(NULL, ":")) {
+		if (asprintf(&path, "%s/%s", dir, name) < 0)
+			break;
+
+		if (!access(path, X_OK)) {
+			free(paths);
+			return path;
+		}
+
+		free(path);
+	}
+
+	free(paths);
+	return NULL;
+}
+
+static int connect_server(const char *socket_path)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	int fd;
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+		return -1;
+
+	strcpy(addr.sun_path, socket_path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static char *append(char *pos, const char *str)
+{
+	size_t len = strlen(str) + 1;
+
+	memcpy(pos, str, len);
+
+	return pos + len;
+}
+
+/* Passes the stdio and the LTP_RESULT_FD to the test */
+static unsigned int get_fds(int *fds)
+{
+	const char *result_fd = getenv("LTP_RESULT_FD");
+	unsigned int nfds = 3;
+	char *end;
+	long fd;
+
+	fds[0] = STDIN_FILENO;
+	fds[1] = STDOUT_FILENO;
+	fds[2] = STDERR_FILENO;
+
+	if (!result_fd)
+		return nfds;
+
+	fd = strtol(result_fd, &end, 10);
+	if (*end || fd <= STDERR_FILENO || fd >= ZYGOTE_FD_BASE)
+		return nfds;
+
+	if (fcntl(fd, F_GETFD) >= 0)
+		fds[nfds++] = fd;
+
+	return nfds;
+}
+
+static int send_request(int fd, const char *so_path, int argc, char *argv[])
+{
+	int fds[ZYGOTE_MAX_FDS];
+	char cbuf[CMSG_SPACE(sizeof(fds))];
+	struct zygote_request hdr = {
+		.magic = ZYGOTE_MAGIC,
+		.argc = argc,
+	};
+	struct iovec iov = {.iov_base = &hdr, .iov_len = sizeof(hdr)};
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	struct cmsghdr *cmsg;
+	char cwd[PATH_MAX], *data, *pos;
+	size_t len, sent;
+	ssize_t ret;
+	int i;
+
+	if (!getcwd(cwd, sizeof(cwd)))
+		return -1;
+
+	len = strlen(so_path) + strlen(cwd) + 2;
+
+	for (i = 0; i < argc; i++)
+		len += strlen(argv[i]) + 1;
+
+	for (i = 0; environ[i]; i++)
+		len += strlen(environ[i]) + 1;
+
+	if (len > ZYGOTE_MAX_DATA)
+		return -1;
+
+	hdr.envc = i;
+	hdr.len = len;
+	hdr.nfds = get_fds(fds);
+	memcpy(hdr.fd_nums, fds, sizeof(fds));
+
+	data = malloc(len);
+	if (!data)
+		return -1;
+
+	pos = append(data, so_path);
+	pos = append(pos, cwd);
+
+	for (i = 0; i < argc; i++)
+		pos = append(pos, argv[i]);
+
+	for (i = 0; environ[i]; i++)
+		pos = append(pos, environ[i]);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(hdr.nfds * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, hdr.nfds * sizeof(int));
+	msg.msg_controllen = CMSG_SPACE(hdr.nfds * sizeof(int));
+
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(hdr))
+		goto err;
+
+	for (sent = 0; sent < len; sent += ret) {
+		ret = send(fd, data + sent, len - sent, MSG_NOSIGNAL);
+		if (ret < 0)
+			goto err;
+	}
+
+	free(data);
+	return 0;
+err:
+	free(data);
+	return -1;
+}
+
+static int recv_reply(int fd, struct zygote_reply *reply)
+{
+	ssize_t ret;
+
+	do {
+		ret = recv(fd, reply, sizeof(*reply), MSG_WAITALL);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret == sizeof(*reply) ? 0 : -1;
+}
+
+static void exit_as(int status)
+{
+	if (WIFSIGNALED(status)) {
+		signal(WTERMSIG(status), SIG_DFL);
+		raise(WTERMSIG(status));
+		exit(128 + WTERMSIG(status));
+	}
+
+	exit(WEXITSTATUS(status));
+}
+
+static void install_handlers(void)
+{
+	static const int sigs[] = {SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGUSR1, SIGUSR2};
+	struct sigaction sa = {.sa_handler = forward_signal};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(sigs) / sizeof(*sigs); i++)
+		sigaction(sigs[i], &sa, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *socket_path = getenv(ZYGOTE_SOCKET_ENV);
+	struct zygote_reply reply;
+	char *path, *so_path, *real_so_path;
+	int fd;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: ltp-zygote-run test [args]\n");
+		return 1;
+	}
+
+	path = find_test(argv[1]);
+	if (!path) {
+		fprintf(stderr, "ltp-zygote-run: %s not found\n", argv[1]);
+		return 127;
+	}
+
+	if (!socket_path || asprintf(&so_path, "%s.so", path) < 0)
+		goto exec;
+
+	/* The server runs in its own working directory */
+	real_so_path = realpath(so_path, NULL);
+	if (!real_so_path || access(real_so_path, R_OK))
+		goto exec;
+
+	fd = connect_server(socket_path);
+	if (fd < 0)
+		goto exec;
+
+	if (send_request(fd, real_so_path, argc - 1, argv + 1) || recv_reply(fd, &reply)) {
+		close(fd);
+		goto exec;
+	}
+
+	if (reply.type == ZYGOTE_FAILED) {
+		fprintf(stderr, "ltp-zygote-run: server failed to start %s: %s\n",
+			argv[1], strerror(reply.val));
+		close(fd);
+		goto exec;
+	}
+
+	test_pid = reply.val;
+	install_handlers();
+
+	if (recv_reply(fd, &reply) || reply.type != ZYGOTE_EXITED) {
+		fprintf(stderr, "ltp-zygote-run: lost connection to the server\n");
+		return 2;
+	}
+
+	exit_as(reply.val);
+exec:
+	execv(path, argv + 1);
+	fprintf(stderr, "ltp-zygote-run: execv(%s): %s\n", path, strerror(errno));
+	return 127;
+}
@@ -0,0 +1,609 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (c) Linux Test Project, 2026
+ */
+
+/*
+ * Test server which runs the tests built as shared objects with
+ * 'make zygote' without executing them.
+ *
+ * The server is linked with the whole libltp and keeps the test shared
+ * objects loaded and relocated between the runs. For each request from
+ * ltp-zygote-run it forks a child which takes over the client stdio, working
+ * directory and environment and calls the test main(). The test library
+ * runs in the child exactly as in a test binary, hence each test still gets
+ * its own tmpdir and shared memory for the results.
+ *
+ * Only tests written with the new test library are supported, tests which
+ * define TCID are refused and the client executes them instead.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "zygote.h"
+
+#define MAX_CONNS 256
+
+struct test_so {
+	struct test_so *next;
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	void *handle;
+	int (*main)(int argc, char *argv[]);
+};
+
+/* A client with a running test, fd is -1 once the client hung up */
+struct conn {
+	int fd;
+	pid_t pid;
+};
+
+struct request {
+	int fds[ZYGOTE_MAX_FDS];
+	int fd_nums[ZYGOTE_MAX_FDS];
+	unsigned int nfds;
+	char *data;
+	char *path;
+	char *cwd;
+	char **argv;
+	char **envp;
+	unsigned int argc;
+};
+
+static struct test_so *tests;
+static struct conn conns[MAX_CONNS];
+static unsigned int conns_cnt;
+static int listen_fd = -1, sig_fd = -1;
+static int verbose;
+
+#define info(fmt, ...) do { \
+	if (verbose) \
+		fprintf(stderr, "ltp-zygote: " fmt "\n", ##__VA_ARGS__); \
+} while (0)
+
+static void send_reply(int fd, int type, int val)
+{
+	struct zygote_reply reply = {.type = type, .val = val};
+
+	if (send(fd, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply))
+		info("send() failed: %s", strerror(errno));
+}
+
+static void free_test(struct test_so *t)
+{
+	if (t->handle)
+		dlclose(t->handle);
+
+	free(t->path);
+	free(t);
+}
+
+/* Returns the cached test or loads it again if the file has changed */
+static struct test_so *load_test(const char *path)
+{
+	struct test_so *t, **prev;
+	struct stat st;
+
+	if (stat(path, &st))
+		return NULL;
+
+	for (prev = &tests; (t = *prev); prev = &t->next) {
+		if (strcmp(t->path, path))
+			continue;
+
+		if (t->dev == st.st_dev && t->ino == st.st_ino &&
+		    t->mtime.tv_sec == st.st_mtim.tv_sec &&
+		    t->mtime.tv_nsec == st.st_mtim.tv_nsec)
+			return t;
+
+		*prev = t->next;
+		free_test(t);
+		break;
+	}
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+
+	t->path = strdup(path);
+	if (!t->path)
+		goto err;
+
+	t->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!t->handle) {
+		fprintf(stderr, "ltp-zygote: %s\n", dlerror());
+		errno = ENOEXEC;
+		goto err;
+	}
+
+	/* The old library uses TCID defined in the test */
+	if (dlsym(t->handle, "TCID")) {
+		fprintf(stderr, "ltp-zygote: %s: old library tests are not supported\n",
+			path);
+		errno = ENOTSUP;
+		goto err;
+	}
+
+	*(void **)&t->main = dlsym(t->handle, "main");
+	if (!t->main) {
+		fprintf(stderr, "ltp-zygote: %s: %s\n", path, dlerror());
+		errno = ENOEXEC;
+		goto err;
+	}
+
+	t->dev = st.st_dev;
+	t->ino = st.st_ino;
+	t->mtime = st.st_mtim;
+	t->next = tests;
+	tests = t;
+
+	info("loaded %s", path);
+
+	return t;
+err:
+	free_test(t);
+	return NULL;
+}
+
+static char **split_strings(char **pos, char *end, unsigned int cnt)
+{
+	char **arr = calloc(cnt + 1, sizeof(*arr));
+	unsigned int i;
+
+	if (!arr)
+		return NULL;
+
+	for (i = 0; i < cnt; i++) {
+		if (*pos >= end) {
+			free(arr);
+			return NULL;
+		}
+
+		arr[i] = *pos;
+		*pos += strlen(*pos) + 1;
+	}
+
+	return arr;
+}
+
+static void free_request(struct request *req)
+{
+	unsigned int i;
+
+	for (i = 0; i < req->nfds; i++)
+		close(req->fds[i]);
+
+	free(req->argv);
+	free(req->envp);
+	free(req->data);
+}
+
+/* Returns 0 or an errno */
+static int recv_request(int fd, struct request *req)
+{
+	char cbuf[CMSG_SPACE(sizeof(req->fds))];
+	struct zygote_request hdr;
+	struct iovec iov = {.iov_base = &hdr, .iov_len = sizeof(hdr)};
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	struct cmsghdr *cmsg;
+	char *pos, *end;
+	unsigned int i;
+	ssize_t ret;
+
+	ret = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+	if (ret < 0)
+		return errno;
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+	    cmsg->cmsg_type == SCM_RIGHTS) {
+		req->nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy(req->fds, CMSG_DATA(cmsg), req->nfds * sizeof(int));
+	} else if (cmsg) {
+		return EPROTO;
+	}
+
+	if (ret != sizeof(hdr) || hdr.magic != ZYGOTE_MAGIC || hdr.nfds != req->nfds)
+		return EPROTO;
+
+	for (i = 0; i < req->nfds; i++) {
+		if (hdr.fd_nums[i] < 0 || hdr.fd_nums[i] >= ZYGOTE_FD_BASE)
+			return EPROTO;
+
+		req->fd_nums[i] = hdr.fd_nums[i];
+	}
+
+	if (!hdr.len || hdr.len > ZYGOTE_MAX_DATA || !hdr.argc)
+		return EPROTO;
+
+	req->data = malloc(hdr.len);
+	if (!req->data)
+		return ENOMEM;
+
+	ret = recv(fd, req->data, hdr.len, MSG_WAITALL);
+	if (ret != (ssize_t)hdr.len || req->data[hdr.len - 1])
+		return EPROTO;
+
+	pos = req->data;
+	end = req->data + hdr.len;
+
+	req->path = pos;
+	pos += strlen(pos) + 1;
+
+	if (pos >= end)
+		return EPROTO;
+
+	req->cwd = pos;
+	pos += strlen(pos) + 1;
+
+	req->argc = hdr.argc;
+	req->argv = split_strings(&pos, end, hdr.argc);
+	req->envp = split_strings(&pos, end, hdr.envc);
+
+	if (!req->argv || !req->envp)
+		return EPROTO;
+
+	return 0;
+}
+
+static int peer_allowed(int fd)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len))
+		return 0;
+
+	return cred.uid == geteuid();
+}
+
+static void close_server_fds(void)
+{
+	unsigned int i;
+
+	close(listen_fd);
+	close(sig_fd);
+
+	for (i = 0; i < conns_cnt; i++) {
+		if (conns[i].fd >= 0)
+			close(conns[i].fd);
+	}
+}
+
+/*
+ * The passed fds are moved out of the way first so that they do not collide
+ * with the numbers they are set up at.
+ */
+static void setup_fds(struct request *req)
+{
+	unsigned int i;
+
+	for (i = 0; i < req->nfds; i++) {
+		int fd = fcntl(req->fds[i], F_DUPFD_CLOEXEC, ZYGOTE_FD_BASE);
+
+		if (fd < 0)
+			_exit(1);
+
+		close(req->fds[i]);
+		req->fds[i] = fd;
+	}
+
+	for (i = 0; i < req->nfds; i++) {
+		if (dup2(req->fds[i], req->fd_nums[i]) < 0)
+			_exit(1);
+	}
+
+	for (i = 0; i < req->nfds; i++)
+		close(req->fds[i]);
+}
+
+static void run_test(struct test_so *t, struct request *req, int conn_fd)
+{
+	sigset_t mask;
+	unsigned int i;
+
+	sigemptyset(&mask);
+	sigprocmask(SIG_SETMASK, &mask, NULL);
+
+	/* The client forwards signals to the process group */
+	setsid();
+
+	close_server_fds();
+	close(conn_fd);
+	setup_fds(req);
+
+	if (chdir(req->cwd)) {
+		fprintf(stderr, "ltp-zygote: chdir(%s): %s\n",
+			req->cwd, strerror(errno));
+		_exit(1);
+	}
+
+	clearenv();
+
+	for (i = 0; req->envp[i]; i++)
+		putenv(req->envp[i]);
+
+	/* Force getopt() to reinitialize after the server option parsing */
+	optind = 0;
+
+	exit(t->main(req->argc, req->argv));
+}
+
+static void handle_client(int fd)
+{
+	struct request req = {};
+	struct timeval timeout = {.tv_sec = 1};
+	struct test_so *t;
+	pid_t pid;
+	int err;
+
+	if (!peer_allowed(fd)) {
+		info("refused client with different uid");
+		goto out;
+	}
+
+	if (conns_cnt >= MAX_CONNS) {
+		send_reply(fd, ZYGOTE_FAILED, EAGAIN);
+		goto out;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	err = recv_request(fd, &req);
+	if (err) {
+		info("invalid request: %s", strerror(err));
+		send_reply(fd, ZYGOTE_FAILED, err);
+		goto out;
+	}
+
+	t = load_test(req.path);
+	if (!t) {
+		send_reply(fd, ZYGOTE_FAILED, errno);
+		goto out;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		send_reply(fd, ZYGOTE_FAILED, errno);
+		goto out;
+	}
+
+	if (!pid)
+		run_test(t, &req, fd);
+
+	info("started %s pid %i", req.argv[0], pid);
+
+	conns[conns_cnt].fd = fd;
+	conns[conns_cnt++].pid = pid;
+	send_reply(fd, ZYGOTE_STARTED, pid);
+	free_request(&req);
+	return;
+out:
+	free_request(&req);
+	close(fd);
+}
+
+static void reap_tests(void)
+{
+	unsigned int i;
+	int status;
+	pid_t pid;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		for (i = 0; i < conns_cnt; i++) {
+			if (conns[i].pid == pid)
+				break;
+		}
+
+		if (i == conns_cnt)
+			continue;
+
+		info("pid %i exited with status 0x%x", pid, status);
+
+		if (conns[i].fd >= 0) {
+			send_reply(conns[i].fd, ZYGOTE_EXITED, status);
+			close(conns[i].fd);
+		}
+
+		conns[i] = conns[--conns_cnt];
+	}
+}
+
+/* The client does not send anything after the request, this is a hangup */
+static void client_gone(struct conn *c)
+{
+	info("client of pid %i hung up, killing the test", c->pid);
+	kill(-c->pid, SIGKILL);
+	close(c->fd);
+	c->fd = -1;
+}
+
+static int handle_signal(void)
+{
+	struct signalfd_siginfo si;
+
+	if (read(sig_fd, &si, sizeof(si)) != sizeof(si))
+		return 0;
+
+	if (si.ssi_signo == SIGCHLD) {
+		reap_tests();
+		return 0;
+	}
+
+	return 1;
+}
+
+static void serve(void)
+{
+	struct pollfd pfds[MAX_CONNS + 2];
+	struct conn *polled[MAX_CONNS];
+	unsigned int i, n;
+	int fd;
+
+	for (;;) {
+		pfds[0].fd = listen_fd;
+		pfds[0].events = POLLIN;
+		pfds[1].fd = sig_fd;
+		pfds[1].events = POLLIN;
+
+		for (i = 0, n = 0; i < conns_cnt; i++) {
+			if (conns[i].fd < 0)
+				continue;
+
+			pfds[n + 2].fd = conns[i].fd;
+			pfds[n + 2].events = POLLIN;
+			polled[n++] = &conns[i];
+		}
+
+		if (poll(pfds, n + 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			perror("ltp-zygote: poll()");
+			return;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (pfds[i + 2].revents)
+				client_gone(polled[i]);
+		}
+
+		if (pfds[1].revents && handle_signal())
+			return;
+
+		if (pfds[0].revents) {
+			fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+			if (fd >= 0)
+				handle_client(fd);
+		}
+	}
+}
+
+static int setup_socket(const char *path)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	struct stat st;
+	mode_t mask;
+	int ret;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "ltp-zygote: socket path too long\n");
+		return -1;
+	}
+
+	strcpy(addr.sun_path, path);
+
+	if (!lstat(path, &st) && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listen_fd < 0) {
+		perror("ltp-zygote: socket()");
+		return -1;
+	}
+
+	mask = umask(0077);
+	ret = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+
+	if (ret) {
+		fprintf(stderr, "ltp-zygote: bind(%s): %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if (listen(listen_fd, 64)) {
+		perror("ltp-zygote: listen()");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void print_help(void)
+{
+	printf("Usage: ltp-zygote [-v] [-s socket]\n\n");
+	printf("Serves ltp-zygote-run requests on the socket, the default is\n");
+	printf("the path in the %s environment variable.\n\n", ZYGOTE_SOCKET_ENV);
+	printf("-s socket  Path to the unix socket\n");
+	printf("-v         Print the test starts and exits\n");
+	printf("-h         Print this help\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = getenv(ZYGOTE_SOCKET_ENV);
+	sigset_t mask;
+	unsigned int i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "hs:v")) != -1) {
+		switch (opt) {
+		case 's':
+			path = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+			print_help();
+			return 0;
+		default:
+			print_help();
+			return 1;
+		}
+	}
+
+	if (!path) {
+		fprintf(stderr, "ltp-zygote: no socket path, use -s or set %s\n",
+			ZYGOTE_SOCKET_ENV);
+		return 1;
+	}
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGHUP);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	sig_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+	if (sig_fd < 0) {
+		perror("ltp-zygote: signalfd()");
+		return 1;
+	}
+
+	if (setup_socket(path))
+		return 1;
+
+	info("listening on %s", path);
+
+	serve();
+
+	for (i = 0; i < conns_cnt; i++)
+		kill(-conns[i].pid, SIGKILL);
+
+	unlink(path);
+
+	return 0;
+}
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (c) Linux Test Project, 2026
+ */
+
+/*
+ * Protocol between the ltp-zygote test server and the ltp-zygote-run client.
+ *
+ * The client connects to the server unix socket and sends a request header
+ * with the file descriptors for the test attached, i.e. stdin, stdout, stderr
+ * and LTP_RESULT_FD if set, and their numbers in the header. The header is
+ * followed by the request data which is a sequence of null terminated
+ * strings: the path to the test shared object, the working directory, argc
+ * arguments and envc environment variables.
+ *
+ * The server answers with ZYGOTE_STARTED and the test pid once the test has
+ * been forked and with ZYGOTE_EXITED and the wait status when it exits. If
+ * the test could not be started ZYGOTE_FAILED with an errno is sent instead
+ * and the client is expected to execute the test binary directly.
+ */
+
+#ifndef ZYGOTE_H__
+#define ZYGOTE_H__
+
+#include <stdint.h>
+
+#define ZYGOTE_SOCKET_ENV "LTP_ZYGOTE_SOCKET"
+#define ZYGOTE_MAGIC 0x4c54505a
+#define ZYGOTE_MAX_DATA (1024 * 1024)
+#define ZYGOTE_MAX_FDS 4
+/* The passed fds are moved above this number before they are set up */
+#define ZYGOTE_FD_BASE 256
+
+struct zygote_request {
+	uint32_t magic;
+	uint32_t argc;
+	uint32_t envc;
+	uint32_t len;
+	uint32_t nfds;
+	int32_t fd_nums[ZYGOTE_MAX_FDS];
+};
+
+enum zygote_reply_type {
+	ZYGOTE_STARTED,
+	ZYGOTE_EXITED,
+	ZYGOTE_FAILED,
+};
+
+struct zygote_reply {
+	int32_t type;
+	int32_t val;
+};
+
+#endif /* ZYGOTE_H__ */